@@ -3,6 +3,7 @@
 // Copyright © 2017-2020 Oliver Waldhorst. All rights reserved.
 //
 
+#include <chrono>
 #include <cstdio>
 #include <unistd.h>
 #include <fcntl.h>
@@ -16,6 +17,9 @@
 #define FILENAME "file"
 #define SMALL_SIZE 1024
 #define LARGE_SIZE 20*1024*1024
+#define RECORD_SIZE 512
+#define TRUNCATE_SIZE 20000
+#define APPEND_SLICE_SIZE (4 * 1024 * 1024)
 
 TEST_CASE("T-1.01", "[Part_1]") {
     printf("Testcase 1.1: Create & remove a single file\n");
@@ -518,3 +522,142 @@ TEST_CASE("T-1.11", "[Part_1]") {
     // Open file (must fail)
     REQUIRE(open(FILENAME, O_EXCL | O_RDWR, 0666) < 0);
 }
+
+TEST_CASE("T-1.12", "[Part_1]") {
+    printf("Testcase 1.12: Shrink & grow a file with truncate\n");
+    int fd;
+
+    // remove file (just to be sure)
+    unlink(FILENAME);
+
+    char* r= new char[TRUNCATE_SIZE];
+    char* w= new char[TRUNCATE_SIZE];
+    gen_random(w, TRUNCATE_SIZE);
+
+    fd = open(FILENAME, O_EXCL | O_RDWR | O_CREAT, 0666);
+    REQUIRE(fd >= 0);
+    REQUIRE(write(fd, w, TRUNCATE_SIZE) == TRUNCATE_SIZE);
+
+    // the cut off bytes must not show up again when the file grows
+    REQUIRE(ftruncate(fd, 100) >= 0);
+    REQUIRE(ftruncate(fd, 8000) >= 0);
+    REQUIRE(pread(fd, r, 8000, 0) == 8000);
+    REQUIRE(memcmp(r, w, 100) == 0);
+    for (int i = 100; i < 8000; i++) {
+        REQUIRE(r[i] == 0);
+    }
+
+    REQUIRE(close(fd) >= 0);
+    REQUIRE(unlink(FILENAME) >= 0);
+    delete[] r;
+    delete[] w;
+}
+
+TEST_CASE("T-1.13", "[Part_1]") {
+    printf("Testcase 1.13: Write behind the end of a shrunk file\n");
+    int fd;
+
+    // remove file (just to be sure)
+    unlink(FILENAME);
+
+    char* r= new char[TRUNCATE_SIZE];
+    char* w= new char[TRUNCATE_SIZE];
+    gen_random(w, TRUNCATE_SIZE);
+
+    fd = open(FILENAME, O_EXCL | O_RDWR | O_CREAT, 0666);
+    REQUIRE(fd >= 0);
+    REQUIRE(write(fd, w, TRUNCATE_SIZE) == TRUNCATE_SIZE);
+
+    // the gap between the old end and the written byte reads as zeros
+    REQUIRE(ftruncate(fd, 100) >= 0);
+    REQUIRE(pwrite(fd, w, 1, 3000) == 1);
+    REQUIRE(pread(fd, r, 3001, 0) == 3001);
+    REQUIRE(memcmp(r, w, 100) == 0);
+    for (int i = 100; i < 3000; i++) {
+        REQUIRE(r[i] == 0);
+    }
+    REQUIRE(r[3000] == w[0]);
+
+    // the same for a gap of whole blocks
+    REQUIRE(ftruncate(fd, 0) >= 0);
+    REQUIRE(pwrite(fd, w, 1, 16000) == 1);
+    REQUIRE(pread(fd, r, 16001, 0) == 16001);
+    for (int i = 0; i < 16000; i++) {
+        REQUIRE(r[i] == 0);
+    }
+
+    REQUIRE(close(fd) >= 0);
+    REQUIRE(unlink(FILENAME) >= 0);
+    delete[] r;
+    delete[] w;
+}
+
+TEST_CASE("T-1.14", "[Part_1]") {
+    printf("Testcase 1.14: Append to a shrunk and to a re-created file\n");
+    int fd;
+
+    // remove file (just to be sure)
+    unlink(FILENAME);
+
+    char* r= new char[TRUNCATE_SIZE];
+    char* w= new char[TRUNCATE_SIZE];
+    gen_random(w, TRUNCATE_SIZE);
+
+    fd = open(FILENAME, O_EXCL | O_RDWR | O_CREAT, 0666);
+    REQUIRE(fd >= 0);
+    REQUIRE(write(fd, w, TRUNCATE_SIZE) == TRUNCATE_SIZE);
+
+    // appends continue behind the new last block
+    REQUIRE(ftruncate(fd, 5000) >= 0);
+    REQUIRE(pwrite(fd, w + 5000, TRUNCATE_SIZE - 5000, 5000) == TRUNCATE_SIZE - 5000);
+    REQUIRE(close(fd) >= 0);
+
+    fd = open(FILENAME, O_EXCL | O_RDWR, 0666);
+    REQUIRE(fd >= 0);
+    REQUIRE(read(fd, r, TRUNCATE_SIZE) == TRUNCATE_SIZE);
+    REQUIRE(memcmp(r, w, TRUNCATE_SIZE) == 0);
+    REQUIRE(close(fd) >= 0);
+
+    // a new file with the same name starts with an empty chain
+    REQUIRE(unlink(FILENAME) >= 0);
+    fd = open(FILENAME, O_EXCL | O_RDWR | O_CREAT, 0666);
+    REQUIRE(fd >= 0);
+    for (int i = 0; i < TRUNCATE_SIZE; i += 5000) {
+        REQUIRE(write(fd, w + i, 5000) == 5000);
+    }
+    REQUIRE(pread(fd, r, TRUNCATE_SIZE, 0) == TRUNCATE_SIZE);
+    REQUIRE(memcmp(r, w, TRUNCATE_SIZE) == 0);
+
+    REQUIRE(close(fd) >= 0);
+    REQUIRE(unlink(FILENAME) >= 0);
+    delete[] r;
+    delete[] w;
+}
+
+// hidden, run with: integrationtests "[benchmark]"
+TEST_CASE("T-APPEND", "[.][benchmark]") {
+    printf("Benchmark: Append small records to a growing file\n");
+
+    // every slice appends the same number of records, its throughput must not drop while the file grows
+    unlink(FILENAME);
+    char record[RECORD_SIZE];
+    gen_random(record, RECORD_SIZE);
+    int fd = open(FILENAME, O_EXCL | O_RDWR | O_CREAT, 0666);
+    REQUIRE(fd >= 0);
+
+    printf("%-16s %10s\n", "file size (MiB)", "MB/s");
+    for (int slice = 0; slice < LARGE_SIZE / APPEND_SLICE_SIZE; slice++) {
+        int failed = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int done = 0; done < APPEND_SLICE_SIZE; done += RECORD_SIZE) {
+            failed += write(fd, record, RECORD_SIZE) != RECORD_SIZE;
+        }
+        std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+        REQUIRE(failed == 0);
+        printf("%7d - %-6d %10.1f\n", slice * APPEND_SLICE_SIZE / (1024 * 1024),
+               (slice + 1) * APPEND_SLICE_SIZE / (1024 * 1024), APPEND_SLICE_SIZE / time.count() / 1e6);
+    }
+
+    REQUIRE(close(fd) >= 0);
+    REQUIRE(unlink(FILENAME) >= 0);
+}
@@ -0,0 +1,232 @@
+//
+// Created by user on 17.10.26.
+//
+
+#include "../catch/catch.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tools.hpp"
+
+#include "BlockCache.h"
+#include "RamBlockDevice.h"
+
+#define BC_BLOCK_SIZE 512
+
+TEST_CASE( "BC_READ_HITS_AND_MISSES", "[blockcache]" ) {
+
+    RamBlockDevice bd(BC_BLOCK_SIZE);
+    REQUIRE(bd.create(nullptr) == 0);
+    BlockCache cache(&bd, BC_BLOCK_SIZE, 4);
+
+    char w[BC_BLOCK_SIZE];
+    char r[BC_BLOCK_SIZE];
+    gen_random(w, BC_BLOCK_SIZE);
+    REQUIRE(bd.write(1, w) == 0);
+
+    // first access misses, second one is served from memory
+    REQUIRE(cache.read(1, r) == 0);
+    REQUIRE(memcmp(w, r, BC_BLOCK_SIZE) == 0);
+    REQUIRE(cache.getMisses() == 1);
+    REQUIRE(cache.read(1, r) == 0);
+    REQUIRE(memcmp(w, r, BC_BLOCK_SIZE) == 0);
+    REQUIRE(cache.getHits() == 1);
+
+    // writes go through to the device and update the cached copy
+    gen_random(w, BC_BLOCK_SIZE);
+    REQUIRE(cache.write(1, w) == 0);
+    REQUIRE(cache.read(1, r) == 0);
+    REQUIRE(memcmp(w, r, BC_BLOCK_SIZE) == 0);
+    REQUIRE(bd.read(1, r) == 0);
+    REQUIRE(memcmp(w, r, BC_BLOCK_SIZE) == 0);
+
+    REQUIRE(bd.close() == 0);
+}
+
+TEST_CASE( "BC_LRU_REPLACEMENT_AND_PINNING", "[blockcache]" ) {
+
+    RamBlockDevice bd(BC_BLOCK_SIZE);
+    REQUIRE(bd.create(nullptr) == 0);
+    BlockCache cache(&bd, BC_BLOCK_SIZE, 2);
+
+    char r[BC_BLOCK_SIZE];
+    int err;
+    const char* pinned= cache.pin(0, &err);
+    REQUIRE(pinned != nullptr);
+    REQUIRE(err == 0);
+
+    // block 0 stays cached while pinned, although it is the least recently used one
+    for (uint32_t b= 1; b <= 4; b++) {
+        REQUIRE(cache.read(b, r) == 0);
+    }
+    uint64_t misses= cache.getMisses();
+    REQUIRE(cache.read(0, r) == 0);
+    REQUIRE(cache.getMisses() == misses);
+
+    // once unpinned, it is replaced like any other block
+    cache.unpin(0);
+    REQUIRE(cache.read(5, r) == 0);
+    REQUIRE(cache.read(6, r) == 0);
+    misses= cache.getMisses();
+    REQUIRE(cache.read(0, r) == 0);
+    REQUIRE(cache.getMisses() == misses + 1);
+
+    // capacity 0 passes everything through
+    cache.setCapacity(0);
+    REQUIRE(cache.pin(0, &err) == nullptr);
+    REQUIRE(err == 0);
+    misses= cache.getMisses();
+    REQUIRE(cache.read(0, r) == 0);
+    REQUIRE(cache.getMisses() == misses);
+
+    REQUIRE(bd.close() == 0);
+}
+
+TEST_CASE( "BC_WRITE_BACK", "[blockcache]" ) {
+
+    RamBlockDevice bd(BC_BLOCK_SIZE);
+    REQUIRE(bd.create(nullptr) == 0);
+    BlockCache cache(&bd, BC_BLOCK_SIZE, 8);
+    cache.setWriteBack(true, 8, 1000);
+
+    char w[BC_BLOCK_SIZE];
+    char r[BC_BLOCK_SIZE];
+    char z[BC_BLOCK_SIZE];
+    memset(z, 0, BC_BLOCK_SIZE);
+
+    // many writes to the same block stay in memory
+    for (int i= 0; i < 100; i++) {
+        gen_random(w, BC_BLOCK_SIZE);
+        REQUIRE(cache.write(3, w) == 0);
+    }
+    REQUIRE(cache.getDirtyCount() == 1);
+    REQUIRE(cache.getDeviceWrites() == 0);
+    REQUIRE(bd.read(3, r) == 0);
+    REQUIRE(memcmp(r, z, BC_BLOCK_SIZE) == 0);
+    REQUIRE(cache.read(3, r) == 0);
+    REQUIRE(memcmp(r, w, BC_BLOCK_SIZE) == 0);
+
+    // ... and reach the device once
+    REQUIRE(cache.flush() == 0);
+    REQUIRE(cache.getDirtyCount() == 0);
+    REQUIRE(cache.getDeviceWrites() == 1);
+    REQUIRE(bd.read(3, r) == 0);
+    REQUIRE(memcmp(r, w, BC_BLOCK_SIZE) == 0);
+
+    // dirty blocks are written before they are replaced
+    char* data= new char[BC_BLOCK_SIZE * 32];
+    gen_random(data, BC_BLOCK_SIZE * 32);
+    for (uint32_t b= 0; b < 32; b++) {
+        REQUIRE(cache.write(100 + b, data + b*BC_BLOCK_SIZE) == 0);
+    }
+    REQUIRE(cache.flush() == 0);
+    for (uint32_t b= 0; b < 32; b++) {
+        REQUIRE(bd.read(100 + b, r) == 0);
+        REQUIRE(memcmp(r, data + b*BC_BLOCK_SIZE, BC_BLOCK_SIZE) == 0);
+    }
+    delete [] data;
+
+    REQUIRE(bd.close() == 0);
+}
+
+TEST_CASE( "BC_DISCARD", "[blockcache]" ) {
+
+    RamBlockDevice bd(BC_BLOCK_SIZE);
+    REQUIRE(bd.create(nullptr) == 0);
+    BlockCache cache(&bd, BC_BLOCK_SIZE, 8);
+    cache.setWriteBack(true, 8, 1000);
+
+    char w[BC_BLOCK_SIZE];
+    char r[BC_BLOCK_SIZE];
+    char z[BC_BLOCK_SIZE];
+    memset(z, 0, BC_BLOCK_SIZE);
+    gen_random(w, BC_BLOCK_SIZE);
+    for (uint32_t b= 0; b < 4; b++) {
+        REQUIRE(cache.write(b, w) == 0);
+    }
+    REQUIRE(cache.flush() == 0);
+
+    // dirty copies of discarded blocks are never written, pinned ones are zeroed
+    int error;
+    const char* pinned= cache.pin(1, &error);
+    REQUIRE(pinned != nullptr);
+    REQUIRE(cache.write(2, w) == 0);
+    REQUIRE(cache.getDirtyCount() == 1);
+    REQUIRE(cache.discard(1, 2) == 0);
+    REQUIRE(cache.getDirtyCount() == 0);
+    REQUIRE(memcmp(pinned, z, BC_BLOCK_SIZE) == 0);
+    cache.unpin(1);
+    for (uint32_t b= 1; b < 3; b++) {
+        REQUIRE(cache.read(b, r) == 0);
+        REQUIRE(memcmp(r, z, BC_BLOCK_SIZE) == 0);
+        REQUIRE(bd.read(b, r) == 0);
+        REQUIRE(memcmp(r, z, BC_BLOCK_SIZE) == 0);
+    }
+    REQUIRE(cache.read(3, r) == 0);
+    REQUIRE(memcmp(r, w, BC_BLOCK_SIZE) == 0);
+
+    REQUIRE(bd.close() == 0);
+}
+
+TEST_CASE( "BC_BACKGROUND_FLUSHER", "[blockcache]" ) {
+
+    RamBlockDevice bd(BC_BLOCK_SIZE);
+    REQUIRE(bd.create(nullptr) == 0);
+    BlockCache cache(&bd, BC_BLOCK_SIZE, 8);
+    cache.setWriteBack(true, 8, 20);
+    cache.startFlusher();
+
+    char w[BC_BLOCK_SIZE];
+    char r[BC_BLOCK_SIZE];
+    gen_random(w, BC_BLOCK_SIZE);
+    REQUIRE(cache.write(5, w) == 0);
+
+    // the flusher writes the block once it is older than 20 ms
+    for (int i= 0; i < 100 && cache.getDirtyCount() > 0; i++) {
+        usleep(10000);
+    }
+    REQUIRE(cache.getDirtyCount() == 0);
+    REQUIRE(bd.read(5, r) == 0);
+    REQUIRE(memcmp(r, w, BC_BLOCK_SIZE) == 0);
+
+    cache.stopFlusher();
+    REQUIRE(bd.close() == 0);
+}
+
+TEST_CASE( "BC_PREFETCH", "[blockcache]" ) {
+
+    RamBlockDevice bd(BC_BLOCK_SIZE);
+    REQUIRE(bd.create(nullptr) == 0);
+    BlockCache cache(&bd, BC_BLOCK_SIZE, 16);
+
+    char* data= new char[BC_BLOCK_SIZE * 8];
+    gen_random(data, BC_BLOCK_SIZE * 8);
+    for (uint32_t b= 0; b < 8; b++) {
+        REQUIRE(bd.write(20 + b, data + b*BC_BLOCK_SIZE) == 0);
+    }
+
+    uint32_t blockNos[8];
+    for (uint32_t b= 0; b < 8; b++) {
+        blockNos[b]= 20 + b;
+    }
+    REQUIRE(cache.prefetch(blockNos, 8) == 0);
+    REQUIRE(cache.getPrefetched() == 8);
+
+    // prefetched blocks are hits
+    char r[BC_BLOCK_SIZE];
+    for (uint32_t b= 0; b < 8; b++) {
+        REQUIRE(cache.read(20 + b, r) == 0);
+        REQUIRE(memcmp(r, data + b*BC_BLOCK_SIZE, BC_BLOCK_SIZE) == 0);
+    }
+    REQUIRE(cache.getMisses() == 0);
+    REQUIRE(cache.getHits() == 8);
+
+    // cached blocks are not fetched again
+    REQUIRE(cache.prefetch(blockNos, 8) == 0);
+    REQUIRE(cache.getPrefetched() == 8);
+
+    delete [] data;
+    REQUIRE(bd.close() == 0);
+}
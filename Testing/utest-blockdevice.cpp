@@ -8,19 +8,28 @@
 
 #include "../catch/catch.hpp"
 
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include "tools.hpp"
 
 #include "blockdevice.h"
+#include "RamBlockDevice.h"
+#include "SimulatedDevice.h"
+#include "StripedDevice.h"
+#include "MirroredDevice.h"
+#include "IoTracer.h"
+#include "IoStats.h"
 
 #define BD_PATH "/tmp/bd.bin"
+#define TRACE_PATH "/tmp/bd.trace"
 #define NUM_TESTBLOCKS 1024
 #define BLOCK_SIZE 512
 
 // Declarations of helper functions
-void bdWriteRead(BlockDevice *bd, int noBlocks= 1);
+void bdWriteRead(BlockStorage *bd, int noBlocks= 1);
 
 TEST_CASE( "BD_CREATE_WRITE_READ_NEW_FILE", "[blockdevice]" ) {
     
@@ -82,11 +91,586 @@ TEST_CASE( "BD_OPEN_NON-EXISTING_FILE", "[blockdevice]" ) {
     REQUIRE(bd.open(BD_PATH) < 0);
 }
 
+TEST_CASE( "BD_READ_BEHIND_END_OF_FILE", "[blockdevice]" ) {
+
+    remove(BD_PATH);
+
+    BlockDevice bd(BLOCK_SIZE);
+    REQUIRE(bd.create(BD_PATH) == 0);
+
+    // blocks that have never been written are read as zeros
+    char r[BLOCK_SIZE];
+    char z[BLOCK_SIZE];
+    memset(r, 'x', BLOCK_SIZE);
+    memset(z, 0, BLOCK_SIZE);
+    REQUIRE(bd.read(NUM_TESTBLOCKS, r) == 0);
+    REQUIRE(memcmp(r, z, BLOCK_SIZE) == 0);
+
+    // writing a block far behind the end leaves a gap that is read as zeros, too
+    bdWriteRead(&bd);
+    char w[BLOCK_SIZE];
+    gen_random(w, BLOCK_SIZE);
+    REQUIRE(bd.write(NUM_TESTBLOCKS, w) == 0);
+    memset(r, 'x', BLOCK_SIZE);
+    REQUIRE(bd.read(NUM_TESTBLOCKS / 2, r) == 0);
+    REQUIRE(memcmp(r, z, BLOCK_SIZE) == 0);
+    REQUIRE(bd.read(NUM_TESTBLOCKS, r) == 0);
+    REQUIRE(memcmp(r, w, BLOCK_SIZE) == 0);
+
+    REQUIRE(bd.close() == 0);
+    remove(BD_PATH);
+}
+
+TEST_CASE( "BD_VECTORED_WRITE_READ", "[blockdevice]" ) {
+
+    remove(BD_PATH);
+
+    BlockDevice bd(BLOCK_SIZE);
+    REQUIRE(bd.create(BD_PATH) == 0);
+
+    // contiguous runs, a gap and a block that goes backwards
+    uint32_t blockNos[]= {3, 4, 5, 6, 10, 11, 2, 100, 101};
+    const int n= sizeof(blockNos) / sizeof(blockNos[0]);
+
+    char* w= new char[BLOCK_SIZE * n];
+    gen_random(w, BLOCK_SIZE * n);
+    char* r= new char[BLOCK_SIZE * n];
+    memset(r, 0, BLOCK_SIZE * n);
+
+    BlockRequest wr[n];
+    BlockRequest rr[n];
+    for(int i= 0; i < n; i++) {
+        wr[i].blockNo= blockNos[i];
+        wr[i].buffer= w + i*BLOCK_SIZE;
+        rr[i].blockNo= blockNos[i];
+        rr[i].buffer= r + i*BLOCK_SIZE;
+    }
+
+    REQUIRE(bd.writeBlocks(wr, n) == 0);
+    REQUIRE(bd.readBlocks(rr, n) == 0);
+    REQUIRE(memcmp(w, r, BLOCK_SIZE * n) == 0);
+
+    // single block access sees the same data
+    char b[BLOCK_SIZE];
+    REQUIRE(bd.read(10, b) == 0);
+    REQUIRE(memcmp(b, w + 4*BLOCK_SIZE, BLOCK_SIZE) == 0);
+
+    delete [] r;
+    delete [] w;
+
+    REQUIRE(bd.close() == 0);
+    remove(BD_PATH);
+}
+
+TEST_CASE( "BD_ASYNC_SUBMIT_COMPLETE", "[blockdevice]" ) {
+
+    remove(BD_PATH);
+
+    BlockDevice bd(BLOCK_SIZE);
+    REQUIRE(bd.create(BD_PATH) == 0);
+
+    // without io_uring the device must keep working synchronously
+    if (bd.enableAsync(8) < 0) {
+        REQUIRE_FALSE(bd.isAsync());
+    }
+
+    char* w= new char[BLOCK_SIZE * NUM_TESTBLOCKS];
+    gen_random(w, BLOCK_SIZE * NUM_TESTBLOCKS);
+    char* r= new char[BLOCK_SIZE * NUM_TESTBLOCKS];
+    memset(r, 0, BLOCK_SIZE * NUM_TESTBLOCKS);
+
+    // every other block, so more requests than the queue depth are in flight
+    BlockRequest* wr= new BlockRequest[NUM_TESTBLOCKS / 2];
+    BlockRequest* rr= new BlockRequest[NUM_TESTBLOCKS / 2];
+    for(int i= 0; i < NUM_TESTBLOCKS / 2; i++) {
+        wr[i].blockNo= 2*i;
+        wr[i].buffer= w + i*BLOCK_SIZE;
+        rr[i].blockNo= 2*i;
+        rr[i].buffer= r + i*BLOCK_SIZE;
+    }
+
+    REQUIRE(bd.submitWrite(wr, NUM_TESTBLOCKS / 2) == 0);
+    REQUIRE(bd.complete() == 0);
+    REQUIRE(bd.submitRead(rr, NUM_TESTBLOCKS / 4) == 0);
+    REQUIRE(bd.submitRead(rr + NUM_TESTBLOCKS / 4, NUM_TESTBLOCKS / 4) == 0);
+    REQUIRE(bd.complete() == 0);
+    REQUIRE(memcmp(w, r, BLOCK_SIZE * NUM_TESTBLOCKS / 2) == 0);
+
+    // vectored and single block access use the same backend
+    bdWriteRead(&bd, 16);
+
+    delete [] rr;
+    delete [] wr;
+    delete [] r;
+    delete [] w;
+
+    REQUIRE(bd.close() == 0);
+    remove(BD_PATH);
+}
+
+TEST_CASE( "BD_MMAP_ZERO_COPY", "[blockdevice]" ) {
+
+    remove(BD_PATH);
+
+    BlockDevice bd(BLOCK_SIZE);
+    REQUIRE(bd.create(BD_PATH) == 0);
+    REQUIRE(bd.enableMmap(NUM_TESTBLOCKS) == 0);
+    REQUIRE(bd.isMapped());
+
+    char w[BLOCK_SIZE];
+    gen_random(w, BLOCK_SIZE);
+    REQUIRE(bd.write(7, w) == 0);
+
+    // the block is visible through the mapping without a copy
+    const char* p= bd.getBlock(7);
+    REQUIRE(p != nullptr);
+    REQUIRE(memcmp(p, w, BLOCK_SIZE) == 0);
+    REQUIRE(bd.getBlock(NUM_TESTBLOCKS) == nullptr);
+
+    bd.adviseWillNeed(0, 16);
+    bd.adviseSequential(16, NUM_TESTBLOCKS);
+
+    // vectored access and blocks behind the mapping keep working
+    bdWriteRead(&bd, NUM_TESTBLOCKS + 16);
+    REQUIRE(bd.write(7, w) == 0);
+    REQUIRE(bd.close() == 0);
+
+    // data written through the mapping is in the container file
+    BlockDevice bd2(BLOCK_SIZE);
+    REQUIRE(bd2.open(BD_PATH) == 0);
+    char r[BLOCK_SIZE];
+    REQUIRE(bd2.read(7, r) == 0);
+    REQUIRE(memcmp(r, w, BLOCK_SIZE) == 0);
+    REQUIRE(bd2.close() == 0);
+
+    remove(BD_PATH);
+}
+
+TEST_CASE( "BD_DIRECT_IO", "[blockdevice]" ) {
+
+    remove(BD_PATH);
+
+    BlockDevice bd(BLOCK_SIZE);
+    REQUIRE(bd.create(BD_PATH) == 0);
+    REQUIRE(bd.enableDirect() == 0);
+    REQUIRE(bd.isDirect());
+    REQUIRE(bd.enableMmap(NUM_TESTBLOCKS) == -EINVAL);
+
+    // buffers of the pool are aligned to the block size
+    BlockBuffer aligned(bd.getBufferPool(), 4);
+    REQUIRE((uintptr_t) aligned.data() % BLOCK_SIZE == 0);
+
+    // unaligned buffers are bounced, for single and vectored requests
+    bdWriteRead(&bd, 64);
+    char* w= new char[BLOCK_SIZE * 4 + 1];
+    char* r= new char[BLOCK_SIZE * 4 + 1];
+    gen_random(w + 1, BLOCK_SIZE * 4);
+    BlockRequest wr[4], rr[4];
+    for(int i= 0; i < 4; i++) {
+        wr[i].blockNo= 100 + i;
+        wr[i].buffer= w + 1 + i*BLOCK_SIZE;
+        rr[i].blockNo= 100 + i;
+        rr[i].buffer= i % 2 ? aligned.data() + i*BLOCK_SIZE : r + 1 + i*BLOCK_SIZE;
+    }
+    REQUIRE(bd.writeBlocks(wr, 4) == 0);
+    REQUIRE(bd.readBlocks(rr, 4) == 0);
+    for(int i= 0; i < 4; i++) {
+        REQUIRE(memcmp(rr[i].buffer, wr[i].buffer, BLOCK_SIZE) == 0);
+    }
+    REQUIRE(bd.close() == 0);
+
+    delete [] w;
+    delete [] r;
+    remove(BD_PATH);
+}
+
+TEST_CASE( "BD_DISCARD_PREALLOCATE", "[blockdevice]" ) {
+
+    remove(BD_PATH);
+
+    BlockDevice bd(BLOCK_SIZE);
+    REQUIRE(bd.create(BD_PATH) == 0);
+    bdWriteRead(&bd, NUM_TESTBLOCKS);
+    struct stat before;
+    REQUIRE(stat(BD_PATH, &before) == 0);
+
+    // discarded blocks read as zeros and give their space back, the size stays
+    REQUIRE(bd.discard(16, NUM_TESTBLOCKS - 32) == 0);
+    struct stat after;
+    REQUIRE(stat(BD_PATH, &after) == 0);
+    REQUIRE(after.st_size == before.st_size);
+    REQUIRE(after.st_blocks < before.st_blocks);
+    char r[BLOCK_SIZE];
+    char z[BLOCK_SIZE];
+    memset(z, 0, BLOCK_SIZE);
+    REQUIRE(bd.read(100, r) == 0);
+    REQUIRE(memcmp(r, z, BLOCK_SIZE) == 0);
+    REQUIRE(bd.read(15, r) == 0);
+    REQUIRE(memcmp(r, z, BLOCK_SIZE) != 0);
+
+    // preallocated blocks behind the end grow the container and read as zeros, too
+    REQUIRE(bd.preallocate(2 * NUM_TESTBLOCKS, 16) == 0);
+    REQUIRE(stat(BD_PATH, &after) == 0);
+    REQUIRE(after.st_size == (off_t) (2 * NUM_TESTBLOCKS + 16) * BLOCK_SIZE);
+    REQUIRE(bd.read(2 * NUM_TESTBLOCKS + 1, r) == 0);
+    REQUIRE(memcmp(r, z, BLOCK_SIZE) == 0);
+    REQUIRE(bd.close() == 0);
+
+    // the RAM device zeroes discarded blocks
+    RamBlockDevice ram(BLOCK_SIZE);
+    REQUIRE(ram.create(BD_PATH) == 0);
+    REQUIRE(ram.preallocate(0, 8) == 0);
+    REQUIRE(ram.getSize() == 8 * BLOCK_SIZE);
+    bdWriteRead(&ram, 8);
+    REQUIRE(ram.discard(4, 100) == 0);
+    REQUIRE(ram.read(5, r) == 0);
+    REQUIRE(memcmp(r, z, BLOCK_SIZE) == 0);
+    REQUIRE(ram.getSize() == 8 * BLOCK_SIZE);
+
+    remove(BD_PATH);
+}
+
+TEST_CASE( "BD_RAM_WRITE_READ", "[blockdevice]" ) {
+
+    RamBlockDevice bd(BLOCK_SIZE);
+    // a RAM container never exists before it is created
+    REQUIRE(bd.open(BD_PATH) == -ENOENT);
+    REQUIRE(bd.create(BD_PATH) == 0);
+
+    // blocks that were never written read as zeros
+    char r[BLOCK_SIZE];
+    char z[BLOCK_SIZE];
+    memset(z, 0, BLOCK_SIZE);
+    REQUIRE(bd.read(NUM_TESTBLOCKS, r) == 0);
+    REQUIRE(memcmp(r, z, BLOCK_SIZE) == 0);
+    REQUIRE(bd.getSize() == 0);
+
+    bdWriteRead(&bd, NUM_TESTBLOCKS);
+    REQUIRE(bd.getSize() == NUM_TESTBLOCKS * BLOCK_SIZE);
+
+    // the backend is used through the interface, capabilities it lacks are reported
+    BlockStorage* storage= &bd;
+    REQUIRE(storage->enableMmap(NUM_TESTBLOCKS) == -ENOTSUP);
+    REQUIRE(storage->getBlock(0) == nullptr);
+    REQUIRE(storage->sync() == 0);
+
+    REQUIRE(bd.close() == 0);
+    REQUIRE(bd.read(0, r) == -EBADF);
+}
+
+TEST_CASE( "BD_SIMULATED_DEVICE", "[blockdevice]" ) {
+
+    SimulationParams params;
+    REQUIRE(SimulatedDevice::parseParams("hdd", &params));
+    REQUIRE(!SimulatedDevice::parseParams("floppy", &params));
+    // 10 us per request, 1 ns per block of seek (at most 1 us), 512 MB/s -> 1 us per block
+    REQUIRE(SimulatedDevice::parseParams("10:1:1:512", &params));
+    REQUIRE(params.latencyNs == 10000);
+    REQUIRE(params.maxSeekNs == 1000);
+
+    SimulatedDevice bd(new RamBlockDevice(BLOCK_SIZE), params);
+    REQUIRE(bd.create(BD_PATH) == 0);
+    bdWriteRead(&bd, 4);
+
+    // 8 single block requests from block 0 to 3 and back: no seeks
+    REQUIRE(bd.getRequests() == 8);
+    REQUIRE(bd.getSeekDistance() == 4);
+    bd.resetStats();
+
+    // two runs, the first one 4 blocks back from the last request, the second one 100 blocks away from its end
+    char* data= new char[BLOCK_SIZE * 8];
+    BlockRequest requests[8];
+    for(int i= 0; i < 8; i++) {
+        requests[i].blockNo= i < 4 ? i : 100 + i;
+        requests[i].buffer= data + i*BLOCK_SIZE;
+    }
+    REQUIRE(bd.readBlocks(requests, 8) == 0);
+    REQUIRE(bd.getRequests() == 2);
+    REQUIRE(bd.getBlocks() == 8);
+    REQUIRE(bd.getSeekDistance() == 104);
+    REQUIRE(bd.getDeviceTimeNs() == 2 * 10000 + 104 + 8 * 1000);
+
+    // sequential requests do not seek, long seeks are capped
+    bd.resetStats();
+    REQUIRE(bd.read(108, data) == 0);
+    REQUIRE(bd.read(5000, data) == 0);
+    REQUIRE(bd.getDeviceTimeNs() == 2 * 10000 + 1000 + 2 * 1000);
+
+    delete [] data;
+    REQUIRE(bd.close() == 0);
+}
+
+TEST_CASE( "BD_STRIPED_DEVICE", "[blockdevice]" ) {
+
+    // three members, stripe units of two blocks
+    std::vector<BlockStorage*> members;
+    for(int i= 0; i < 3; i++) {
+        members.push_back(new RamBlockDevice(BLOCK_SIZE));
+    }
+    StripedDevice bd(members, 2 * BLOCK_SIZE);
+    REQUIRE(bd.create("/tmp/bd0.bin:/tmp/bd1.bin") == -EINVAL);
+    REQUIRE(bd.open("/tmp/bd0.bin:/tmp/bd1.bin:/tmp/bd2.bin") == -ENOENT);
+    REQUIRE(bd.create("/tmp/bd0.bin:/tmp/bd1.bin:/tmp/bd2.bin") == 0);
+
+    bdWriteRead(&bd, 12);
+    REQUIRE(bd.getParallelRequests() == 0);
+    for(int i= 0; i < 3; i++) {
+        REQUIRE(bd.getMemberBlocks(i) == 8);
+        REQUIRE(((RamBlockDevice*) bd.getMember(i))->getSize() == 4 * BLOCK_SIZE);
+    }
+
+    // logical block 7 is the second block of unit 3, i.e. block 3 of member 0
+    char r[BLOCK_SIZE];
+    char w[BLOCK_SIZE];
+    REQUIRE(bd.read(7, w) == 0);
+    REQUIRE(bd.getMember(0)->read(3, r) == 0);
+    REQUIRE(memcmp(r, w, BLOCK_SIZE) == 0);
+
+    // one vectored request is spread over all members and read back in order
+    char* data= new char[BLOCK_SIZE * 12];
+    char* check= new char[BLOCK_SIZE * 12];
+    gen_random(data, BLOCK_SIZE * 12);
+    BlockRequest requests[12];
+    for(int i= 0; i < 12; i++) {
+        requests[i].blockNo= 20 + i;
+        requests[i].buffer= data + i*BLOCK_SIZE;
+    }
+    REQUIRE(bd.writeBlocks(requests, 12) == 0);
+    for(int i= 0; i < 12; i++) {
+        requests[i].buffer= check + i*BLOCK_SIZE;
+    }
+    REQUIRE(bd.readBlocks(requests, 12) == 0);
+    REQUIRE(memcmp(data, check, BLOCK_SIZE * 12) == 0);
+    REQUIRE(bd.getParallelRequests() == 2);
+    REQUIRE(bd.sync() == 0);
+
+    // a discarded range is cut into its parts on the members
+    REQUIRE(bd.discard(21, 4) == 0);
+    REQUIRE(bd.read(20, r) == 0);
+    REQUIRE(memcmp(r, data, BLOCK_SIZE) == 0);
+    memset(w, 0, BLOCK_SIZE);
+    for(int i= 21; i < 25; i++) {
+        REQUIRE(bd.read(i, r) == 0);
+        REQUIRE(memcmp(r, w, BLOCK_SIZE) == 0);
+    }
+    REQUIRE(bd.read(25, r) == 0);
+    REQUIRE(memcmp(r, data + 5*BLOCK_SIZE, BLOCK_SIZE) == 0);
+
+    // the block size is changed after the superblock has been read, the stripe unit stays the same in bytes
+    bd.setBlockSize(2 * BLOCK_SIZE);
+    REQUIRE(bd.getMember(2)->getBlockSize() == 2 * BLOCK_SIZE);
+
+    delete [] data;
+    delete [] check;
+    REQUIRE(bd.close() == 0);
+}
+
+TEST_CASE( "BD_MIRRORED_DEVICE", "[blockdevice]" ) {
+
+    MirrorPolicy policy;
+    REQUIRE(MirroredDevice::parsePolicy("locality", &policy));
+    REQUIRE(!MirroredDevice::parsePolicy("random", &policy));
+
+    std::vector<BlockStorage*> members;
+    members.push_back(new RamBlockDevice(BLOCK_SIZE));
+    members.push_back(new RamBlockDevice(BLOCK_SIZE));
+    MirroredDevice bd(members, MIRROR_READ_QUEUE);
+    REQUIRE(bd.create("/tmp/bd0.bin:/tmp/bd1.bin") == 0);
+
+    // both members hold all blocks, single block reads alternate between the idle members
+    bdWriteRead(&bd, 16);
+    char r[BLOCK_SIZE];
+    char w[BLOCK_SIZE];
+    for(int i= 0; i < 2; i++) {
+        REQUIRE(bd.getMemberWrittenBlocks(i) == 16);
+        REQUIRE(bd.getMemberReads(i) == 8);
+        REQUIRE(bd.getMember(i)->read(5, r) == 0);
+        REQUIRE(bd.read(5, w) == 0);
+        REQUIRE(memcmp(r, w, BLOCK_SIZE) == 0);
+    }
+
+    // a large read is split into one chunk per member
+    bd.resetStats();
+    char* data= new char[BLOCK_SIZE * 32];
+    BlockRequest requests[32];
+    for(int i= 0; i < 32; i++) {
+        requests[i].blockNo= i;
+        requests[i].buffer= data + i*BLOCK_SIZE;
+    }
+    REQUIRE(bd.readBlocks(requests, 32) == 0);
+    REQUIRE(bd.getMemberReadBlocks(0) == 16);
+    REQUIRE(bd.getMemberReadBlocks(1) == 16);
+    REQUIRE(memcmp(data + 5*BLOCK_SIZE, r, BLOCK_SIZE) == 0);
+
+    // reads a member fails are served by the other one, only when no member is left the read fails
+    bd.resetStats();
+    REQUIRE(bd.getMember(1)->close() == 0);
+    for(int i= 0; i < 4; i++) {
+        REQUIRE(bd.read(5, w) == 0);
+        REQUIRE(memcmp(r, w, BLOCK_SIZE) == 0);
+    }
+    memset(data, 0, BLOCK_SIZE * 32);
+    REQUIRE(bd.readBlocks(requests, 32) == 0);
+    REQUIRE(memcmp(data + 5*BLOCK_SIZE, r, BLOCK_SIZE) == 0);
+    REQUIRE(bd.getMemberFailedReads(0) == 0);
+    REQUIRE(bd.getMemberFailedReads(1) == 3);
+    REQUIRE(bd.getMemberReadBlocks(0) == 4 + 32);
+    REQUIRE(bd.getMember(0)->close() == 0);
+    REQUIRE(bd.read(5, w) == -EBADF);
+    REQUIRE(bd.getMemberFailedReads(0) == 1);
+    REQUIRE(bd.close() == 0);
+
+    // with the locality policy, two sequential streams stay on their own member
+    std::vector<BlockStorage*> localMembers;
+    localMembers.push_back(new RamBlockDevice(BLOCK_SIZE));
+    localMembers.push_back(new RamBlockDevice(BLOCK_SIZE));
+    MirroredDevice local(localMembers, MIRROR_READ_LOCALITY);
+    REQUIRE(local.create("/tmp/bd0.bin:/tmp/bd1.bin") == 0);
+    for(int i= 0; i < 8; i++) {
+        REQUIRE(local.read(i, data) == 0);
+        REQUIRE(local.read(5000 + i, data) == 0);
+    }
+    REQUIRE(local.readBlocks(requests, 4) == 0);
+    REQUIRE(local.getMemberReadBlocks(0) == 12);
+    REQUIRE(local.getMemberReadBlocks(1) == 8);
+
+    delete [] data;
+    REQUIRE(local.close() == 0);
+}
+
+TEST_CASE( "BD_TRACE", "[blockdevice]" ) {
+
+    remove(BD_PATH);
+    remove(TRACE_PATH);
+
+    IoTracer tracer;
+    REQUIRE(tracer.open(TRACE_PATH, BLOCK_SIZE) == 0);
+    BlockDevice bd(BLOCK_SIZE);
+    REQUIRE(bd.create(BD_PATH) == 0);
+    bd.setTracer(&tracer);
+
+    // single blocks, and one vectored call with two runs
+    bdWriteRead(&bd, 2);
+    char* data= new char[BLOCK_SIZE * 4];
+    BlockRequest requests[4];
+    for(int i= 0; i < 4; i++) {
+        requests[i].blockNo= i < 3 ? 10 + i : 50;
+        requests[i].buffer= data + i*BLOCK_SIZE;
+    }
+    REQUIRE(bd.readBlocks(requests, 4) == 0);
+    REQUIRE(bd.sync() == 0);
+    bd.setBlockSize(2 * BLOCK_SIZE);
+    bd.setTracer(nullptr);
+    REQUIRE(bd.read(0, data) == 0);
+    REQUIRE(bd.close() == 0);
+    REQUIRE(tracer.close() == 0);
+    delete [] data;
+
+    IoTraceHeader header;
+    std::vector<IoTraceRecord> records;
+    REQUIRE(IoTracer::load(TRACE_PATH, &header, &records) == 0);
+    REQUIRE(header.blockSize == BLOCK_SIZE);
+    REQUIRE(records.size() == 8);
+    REQUIRE(records[0].op == TRACE_WRITE);
+    REQUIRE(records[1].op == TRACE_WRITE);
+    REQUIRE(records[1].blockNo == 1);
+    REQUIRE(records[2].op == TRACE_READ);
+    REQUIRE(records[4].op == TRACE_READ);
+    REQUIRE(records[4].blockNo == 10);
+    REQUIRE(records[4].blocks == 3);
+    REQUIRE(records[5].op == (TRACE_READ | TRACE_CONTINUED));
+    REQUIRE(records[5].blockNo == 50);
+    REQUIRE(records[5].timestampNs == records[4].timestampNs);
+    REQUIRE(records[6].op == TRACE_SYNC);
+    REQUIRE(records[7].op == TRACE_BLOCK_SIZE);
+    REQUIRE(records[7].blockNo == 2 * BLOCK_SIZE);
+    for(size_t i= 1; i < records.size(); i++) {
+        REQUIRE(records[i].timestampNs >= records[i - 1].timestampNs);
+    }
+
+    remove(BD_PATH);
+    remove(TRACE_PATH);
+}
+
+TEST_CASE( "BD_IO_STATS", "[blockdevice]" ) {
+
+    remove(BD_PATH);
+
+    REQUIRE(IoStats::bucket(0) == 0);
+    REQUIRE(IoStats::bucket(2) == 1);
+    REQUIRE(IoStats::bucket(1023) == 9);
+    REQUIRE(IoStats::bucket(1024) == 10);
+    REQUIRE(IoStats::bucket(UINT64_MAX) == IO_STATS_BUCKETS - 1);
+
+    BlockDevice bd(BLOCK_SIZE);
+    REQUIRE(bd.create(BD_PATH) == 0);
+    IoStats *stats = bd.getStats();
+    REQUIRE(stats != nullptr);
+
+    // blocks 0 to 3 are written and read one by one, then a run close to them and one far away
+    bdWriteRead(&bd, 4);
+    char* data= new char[BLOCK_SIZE * 4];
+    BlockRequest requests[4];
+    for(int i= 0; i < 4; i++) {
+        requests[i].blockNo= i < 3 ? 10 + i : 500;
+        requests[i].buffer= data + i*BLOCK_SIZE;
+    }
+    REQUIRE(bd.readBlocks(requests, 4) == 0);
+    REQUIRE(bd.sync() == 0);
+    delete [] data;
+
+    IoOpStats writes = stats->get(STATS_WRITE);
+    REQUIRE(writes.calls == 4);
+    REQUIRE(writes.blocks == 4);
+    REQUIRE(writes.bytes == 4 * BLOCK_SIZE);
+    REQUIRE(writes.sequentialRuns == 4);
+    REQUIRE(writes.randomRuns == 0);
+
+    IoOpStats reads = stats->get(STATS_READ);
+    REQUIRE(reads.calls == 5);
+    REQUIRE(reads.blocks == 8);
+    REQUIRE(reads.sequentialRuns == 5);
+    REQUIRE(reads.randomRuns == 1);
+    REQUIRE(reads.seekDistance == 4 + 6 + 487);
+
+    // every call is in the histogram, whose buckets bound the latencies from above
+    uint64_t counted = 0;
+    for(int i= 0; i < IO_STATS_BUCKETS; i++) {
+        counted += reads.histogram[i];
+    }
+    REQUIRE(counted == reads.calls);
+    REQUIRE(reads.percentileNs(1.0) * reads.calls >= reads.totalNs);
+    REQUIRE(reads.percentileNs(0.5) <= reads.percentileNs(1.0));
+    REQUIRE(stats->get(STATS_SYNC).calls == 1);
+
+    FILE *dump = tmpfile();
+    REQUIRE(dump != nullptr);
+    stats->dump(dump, "test");
+    REQUIRE(ftell(dump) > 0);
+    fclose(dump);
+
+    stats->reset();
+    REQUIRE(stats->get(STATS_READ).calls == 0);
+    REQUIRE(stats->get(STATS_READ).histogram[IoStats::bucket(reads.totalNs / reads.calls)] == 0);
+
+    // a simulated device reports the statistics of the device it wraps, other backends keep none
+    SimulationParams params;
+    REQUIRE(SimulatedDevice::parseParams("ssd", &params));
+    BlockDevice *wrapped = new BlockDevice(BLOCK_SIZE);
+    SimulatedDevice simulated(wrapped, params);
+    REQUIRE(simulated.getStats() == wrapped->getStats());
+    RamBlockDevice ram(BLOCK_SIZE);
+    REQUIRE(ram.getStats() == nullptr);
+
+    REQUIRE(bd.close() == 0);
+    remove(BD_PATH);
+}
+
 // ***
 // *** Helper functions
 // ***
 
-void bdWriteRead(BlockDevice *bd, int noBlocks) {
+void bdWriteRead(BlockStorage *bd, int noBlocks) {
     char* r= new char[BD_BLOCK_SIZE * noBlocks];
     memset(r, 0, BD_BLOCK_SIZE * noBlocks);
 
@@ -0,0 +1,249 @@
+//
+// Created by user on 17.10.26.
+//
+
+#include "../catch/catch.hpp"
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "tools.hpp"
+
+#include "CMAP.h"
+#include "Compressor.h"
+#include "Lz4.h"
+#include "RamBlockDevice.h"
+#include "SimulatedDevice.h"
+#include "SuperBlock.h"
+
+#define CMP_BLOCK_SIZE 4096
+#define CMP_BENCH_BYTES (16 * 1024 * 1024)
+
+// log lines, CSV rows or JSON records like the files the compression is meant for
+static void genRecords(char *buf, size_t size, int kind) {
+    size_t done = 0;
+    unsigned long i = 0;
+    char line[256];
+    while (done < size) {
+        int len;
+        unsigned long r = (i * 2654435761u) >> 7;
+        if (kind == 0) {
+            len = snprintf(line, sizeof(line), "2026-10-17 12:%02lu:%02lu.%03lu INFO  [worker-%lu] request %lu "
+                           "served in %lu ms\n", i / 60 % 60, i % 60, r % 1000, r % 8, i, r % 250);
+        } else if (kind == 1) {
+            len = snprintf(line, sizeof(line), "%lu,sensor-%03lu,%lu.%02lu,%lu,ok\n", 1792224000 + i, r % 64,
+                           r % 40, r % 100, r % 1013);
+        } else {
+            len = snprintf(line, sizeof(line), "{\"id\": %lu, \"user\": \"user%lu\", \"score\": %lu, "
+                           "\"tags\": [\"a\", \"b\"]}\n", i, r % 500, r % 10000);
+        }
+        size_t n = std::min((size_t) len, size - done);
+        memcpy(buf + done, line, n);
+        done += n;
+        i++;
+    }
+}
+
+TEST_CASE( "CMP_LZ4_ROUND_TRIP", "[compression]" ) {
+
+    std::vector<char> data(65536);
+    std::vector<char> packed(Lz4::compressBound(data.size()));
+    std::vector<char> unpacked(data.size());
+
+    for (int kind = 0; kind < 4; kind++) {
+        if (kind < 3) {
+            genRecords(data.data(), data.size(), kind);
+        } else {
+            gen_random(data.data(), data.size());
+        }
+        int size = Lz4::compress(data.data(), data.size(), packed.data(), packed.size());
+        REQUIRE(size > 0);
+        if (kind < 3) {
+            REQUIRE(size < (int) data.size() / 2);
+        }
+        REQUIRE(Lz4::decompress(packed.data(), size, unpacked.data(), unpacked.size()) == (int) data.size());
+        REQUIRE(memcmp(data.data(), unpacked.data(), data.size()) == 0);
+
+        // too small buffers are reported, not overrun
+        REQUIRE(Lz4::decompress(packed.data(), size, unpacked.data(), unpacked.size() - 1) == -EINVAL);
+        REQUIRE(Lz4::decompress(packed.data(), size - 1, unpacked.data(), unpacked.size()) < (int) data.size());
+    }
+    REQUIRE(Lz4::compress(data.data(), data.size(), packed.data(), data.size() / 2) == -ENOSPC);
+
+    // short input is stored as literals
+    REQUIRE(Lz4::compress("abc", 3, packed.data(), packed.size()) == 4);
+    REQUIRE(Lz4::decompress(packed.data(), 4, unpacked.data(), 3) == 3);
+    REQUIRE(memcmp(unpacked.data(), "abc", 3) == 0);
+}
+
+TEST_CASE( "CMP_UNITS", "[compression]" ) {
+
+    RamBlockDevice bd(CMP_BLOCK_SIZE);
+    REQUIRE(bd.create(nullptr) == 0);
+    SuperBlock superBlock(&bd);
+    REQUIRE(superBlock.format(CMP_BLOCK_SIZE, NUMBER_DATA_BLOCKS) == 0);
+    CMAP cmap(&bd, &superBlock);
+    cmap.firstInit();
+    Compressor compressor(&bd, &superBlock, &cmap);
+    REQUIRE(compressor.setEnabled(true) == 0);
+
+    uint32_t unitBlocks = compressor.getUnitBlocks();
+    REQUIRE(unitBlocks == COMPRESSION_UNIT_SIZE / CMP_BLOCK_SIZE);
+    size_t unitSize = unitBlocks * CMP_BLOCK_SIZE;
+    std::vector<char> w(unitSize);
+    std::vector<char> r(unitSize);
+    std::vector<char> z(CMP_BLOCK_SIZE, 0);
+    std::vector<char> block(CMP_BLOCK_SIZE);
+
+    // a unit whose blocks are not contiguous on the device
+    std::vector<BlockRequest> blocks(unitBlocks);
+    for (uint32_t i = 0; i < unitBlocks; i++) {
+        blocks[i].blockNo = superBlock.getDataOffset() + 10 + 2 * i;
+    }
+    // stale data in the blocks that are not needed any more
+    gen_random(block.data(), CMP_BLOCK_SIZE);
+    for (uint32_t i = 0; i < unitBlocks; i++) {
+        REQUIRE(bd.write(blocks[i].blockNo, block.data()) == 0);
+    }
+
+    // compressible content uses the first blocks only, the others become holes
+    genRecords(w.data(), unitSize, 0);
+    REQUIRE(compressor.writeUnit(blocks.data(), unitBlocks, unitBlocks, w.data()) == 0);
+    uint8_t stored = cmap.get(10);
+    REQUIRE(stored > 0);
+    REQUIRE(stored < unitBlocks / 2);
+    REQUIRE(compressor.isCompressed(blocks[0].blockNo));
+    REQUIRE(cmap.getCompressedUnits() == 1);
+    REQUIRE(bd.read(blocks[stored].blockNo, block.data()) == 0);
+    REQUIRE(memcmp(block.data(), z.data(), CMP_BLOCK_SIZE) == 0);
+
+    // read back from the device, not from the last decompressed unit
+    Compressor other(&bd, &superBlock, &cmap);
+    REQUIRE(other.readUnit(blocks.data(), unitBlocks, unitBlocks, r.data()) == 0);
+    REQUIRE(memcmp(w.data(), r.data(), unitSize) == 0);
+    REQUIRE(other.getDecompressions() == 1);
+    REQUIRE(other.readUnit(blocks.data(), unitBlocks, unitBlocks, r.data()) == 0);
+    REQUIRE(other.getDecompressions() == 1);
+
+    // the map survives a remount
+    CMAP reread(&bd, &superBlock);
+    reread.init();
+    REQUIRE(reread.get(10) == stored);
+    REQUIRE(reread.getCompressedUnits() == 1);
+
+    // a unit that grew behind its compressed content reads zeros there
+    std::vector<BlockRequest> shorter(blocks.begin(), blocks.begin() + unitBlocks / 2);
+    genRecords(w.data(), unitSize / 2, 1);
+    REQUIRE(compressor.writeUnit(shorter.data(), unitBlocks / 2, unitBlocks, w.data()) == 0);
+    REQUIRE(compressor.readUnit(blocks.data(), unitBlocks, unitBlocks, r.data()) == 0);
+    REQUIRE(memcmp(w.data(), r.data(), unitSize / 2) == 0);
+    REQUIRE(memcmp(r.data() + unitSize / 2, std::vector<char>(unitSize / 2, 0).data(), unitSize / 2) == 0);
+
+    // incompressible content is stored as it is
+    gen_random(w.data(), unitSize);
+    REQUIRE(compressor.writeUnit(blocks.data(), unitBlocks, unitBlocks, w.data()) == 0);
+    REQUIRE(cmap.get(10) == 0);
+    REQUIRE(cmap.getCompressedUnits() == 0);
+    REQUIRE(bd.read(blocks[unitBlocks - 1].blockNo, block.data()) == 0);
+    REQUIRE(memcmp(block.data(), w.data() + unitSize - CMP_BLOCK_SIZE, CMP_BLOCK_SIZE) == 0);
+    REQUIRE(compressor.readUnit(blocks.data(), unitBlocks, unitBlocks, r.data()) == 0);
+    REQUIRE(memcmp(w.data(), r.data(), unitSize) == 0);
+
+    // blocks that did not hold data yet read as zeros
+    REQUIRE(compressor.readUnit(blocks.data(), unitBlocks, 2, r.data()) == 0);
+    REQUIRE(memcmp(w.data(), r.data(), 2 * CMP_BLOCK_SIZE) == 0);
+    REQUIRE(memcmp(r.data() + 2 * CMP_BLOCK_SIZE, z.data(), CMP_BLOCK_SIZE) == 0);
+
+    // compressed units stay readable when compression is switched off, they are stored uncompressed when written
+    genRecords(w.data(), unitSize, 2);
+    REQUIRE(compressor.writeUnit(blocks.data(), unitBlocks, unitBlocks, w.data()) == 0);
+    REQUIRE(cmap.get(10) > 0);
+    REQUIRE(compressor.setEnabled(false) == 0);
+    REQUIRE(compressor.readUnit(blocks.data(), unitBlocks, unitBlocks, r.data()) == 0);
+    REQUIRE(memcmp(w.data(), r.data(), unitSize) == 0);
+    REQUIRE(compressor.writeUnit(blocks.data(), unitBlocks, unitBlocks, w.data()) == 0);
+    REQUIRE(cmap.get(10) == 0);
+
+    // freed units are forgotten
+    REQUIRE(compressor.setEnabled(true) == 0);
+    REQUIRE(compressor.writeUnit(blocks.data(), unitBlocks, unitBlocks, w.data()) == 0);
+    REQUIRE(cmap.getCompressedUnits() == 1);
+    compressor.release(std::vector<int>(1, 10));
+    REQUIRE(cmap.getCompressedUnits() == 0);
+    REQUIRE_FALSE(compressor.hasCompressedUnits());
+
+    // a damaged unit is an I/O error, not a crash
+    REQUIRE(compressor.writeUnit(blocks.data(), unitBlocks, unitBlocks, w.data()) == 0);
+    gen_random(block.data(), CMP_BLOCK_SIZE);
+    REQUIRE(bd.write(blocks[0].blockNo, block.data()) == 0);
+    Compressor remounted(&bd, &superBlock, &cmap);
+    REQUIRE(remounted.readUnit(blocks.data(), unitBlocks, unitBlocks, r.data()) == -EIO);
+
+    REQUIRE(bd.close() == 0);
+}
+
+// hidden, run with: unittests "[benchmark]"
+TEST_CASE( "CMP_BENCHMARK", "[.][benchmark]" ) {
+
+    // a volume throttled to 100 MB/s with 50 us per request; the device time is simulated and added to the measured
+    // CPU time
+    SimulationParams params;
+    REQUIRE(SimulatedDevice::parseParams("50:0:0:100", &params));
+    RamBlockDevice *ram = new RamBlockDevice(CMP_BLOCK_SIZE);
+    REQUIRE(ram->create(nullptr) == 0);
+    SimulatedDevice device(ram, params);
+    SuperBlock superBlock(&device);
+    REQUIRE(superBlock.format(CMP_BLOCK_SIZE, NUMBER_DATA_BLOCKS) == 0);
+    // only file data is timed, the map is kept elsewhere; in the file system, its writes are batched by the cache
+    RamBlockDevice metadata(CMP_BLOCK_SIZE);
+    REQUIRE(metadata.create(nullptr) == 0);
+    CMAP cmap(&metadata, &superBlock);
+    cmap.firstInit();
+    Compressor compressor(&device, &superBlock, &cmap);
+
+    uint32_t unitBlocks = compressor.getUnitBlocks();
+    size_t unitSize = unitBlocks * CMP_BLOCK_SIZE;
+    size_t units = CMP_BENCH_BYTES / unitSize;
+    std::vector<char> data(CMP_BENCH_BYTES);
+    std::vector<char> r(unitSize);
+    std::vector<BlockRequest> blocks(unitBlocks);
+    const char *kinds[] = {"log", "csv", "json", "random"};
+
+    printf("%-8s %-12s %10s %10s %8s\n", "data", "compression", "write MB/s", "read MB/s", "ratio");
+    for (int kind = 0; kind < 4; kind++) {
+        if (kind < 3) {
+            genRecords(data.data(), data.size(), kind);
+        } else {
+            gen_random(data.data(), data.size());
+        }
+        for (int enabled = 0; enabled < 2; enabled++) {
+            REQUIRE(compressor.setEnabled(enabled) == 0);
+            compressor.resetStats();
+
+            double seconds[2];
+            for (int doRead = 0; doRead < 2; doRead++) {
+                device.resetStats();
+                auto start = std::chrono::steady_clock::now();
+                for (size_t u = 0; u < units; u++) {
+                    for (uint32_t i = 0; i < unitBlocks; i++) {
+                        blocks[i].blockNo = superBlock.getDataOffset() + u * unitBlocks + i;
+                    }
+                    if (doRead) {
+                        REQUIRE(compressor.readUnit(blocks.data(), unitBlocks, unitBlocks, r.data()) == 0);
+                        REQUIRE(memcmp(r.data(), data.data() + u * unitSize, unitSize) == 0);
+                    } else {
+                        REQUIRE(compressor.writeUnit(blocks.data(), unitBlocks, unitBlocks,
+                                                     data.data() + u * unitSize) == 0);
+                    }
+                }
+                std::chrono::duration<double> cpu = std::chrono::steady_clock::now() - start;
+                seconds[doRead] = cpu.count() + device.getDeviceTimeNs() / 1e9;
+            }
+            printf("%-8s %-12s %10.1f %10.1f %8.2f\n", kinds[kind], enabled ? "lz4" : "none",
+                   CMP_BENCH_BYTES / seconds[0] / 1e6, CMP_BENCH_BYTES / seconds[1] / 1e6,
+                   (double) compressor.getWrittenBlocks() / compressor.getStoredBlocks());
+        }
+    }
+}
@@ -0,0 +1,362 @@
+//
+// Created by user on 17.10.26.
+//
+
+#include "../catch/catch.hpp"
+
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+#include "tools.hpp"
+
+#include "DDT.h"
+#include "DMAP.h"
+#include "RamBlockDevice.h"
+#include "SuperBlock.h"
+
+#define DDT_BLOCK_SIZE 4096
+
+// reads the content of a data block the way the file system does
+static void readContent(RamBlockDevice &bd, SuperBlock &superBlock, DDT &ddt, int block, char *buf) {
+    REQUIRE(bd.read(superBlock.getDataOffset() + ddt.getStorage(block), buf) == 0);
+}
+
+TEST_CASE( "DDT_SHARING", "[dedup]" ) {
+
+    RamBlockDevice bd(DDT_BLOCK_SIZE);
+    REQUIRE(bd.create(nullptr) == 0);
+    SuperBlock superBlock(&bd);
+    REQUIRE(superBlock.format(DDT_BLOCK_SIZE, NUMBER_DATA_BLOCKS) == 0);
+    REQUIRE(superBlock.getDdtSize() > 0);
+    DMAP dmap(&bd, &superBlock);
+    dmap.firstInit();
+    DDT ddt(&bd, &superBlock, &dmap);
+    ddt.firstInit();
+    REQUIRE(ddt.setEnabled(true) == 0);
+
+    uint32_t dataOffset = superBlock.getDataOffset();
+    int *blocks = dmap.getCertainNumberOfFreeBlocks(6);
+    REQUIRE(blocks != nullptr);
+    std::vector<char> a(DDT_BLOCK_SIZE);
+    std::vector<char> b(DDT_BLOCK_SIZE);
+    std::vector<char> c(DDT_BLOCK_SIZE);
+    std::vector<char> r(DDT_BLOCK_SIZE);
+    gen_random(a.data(), DDT_BLOCK_SIZE);
+    gen_random(b.data(), DDT_BLOCK_SIZE);
+    gen_random(c.data(), DDT_BLOCK_SIZE);
+
+    // the same content is hashed the same, different content differently
+    REQUIRE(DDT::hash(a.data(), DDT_BLOCK_SIZE) == DDT::hash(a.data(), DDT_BLOCK_SIZE));
+    REQUIRE(DDT::hash(a.data(), DDT_BLOCK_SIZE) != DDT::hash(b.data(), DDT_BLOCK_SIZE));
+    REQUIRE(DDT::hash(a.data(), DDT_BLOCK_SIZE) != 0);
+
+    // the second and third copy of a are only references, even within one request
+    BlockRequest requests[4] = {{dataOffset + blocks[0], a.data()}, {dataOffset + blocks[1], b.data()},
+                                {dataOffset + blocks[2], a.data()}, {dataOffset + blocks[3], a.data()}};
+    REQUIRE(ddt.writeBlocks(requests, 4) == 0);
+    REQUIRE(ddt.getWrittenBlocks() == 4);
+    REQUIRE(ddt.getDedupedBlocks() == 2);
+    REQUIRE(ddt.getSharedBlocks() == 2);
+    REQUIRE(ddt.getStorage(blocks[2]) == blocks[0]);
+    REQUIRE(ddt.getStorage(blocks[3]) == blocks[0]);
+    readContent(bd, superBlock, ddt, blocks[3], r.data());
+    REQUIRE(memcmp(r.data(), a.data(), DDT_BLOCK_SIZE) == 0);
+
+    // writing the same content again writes nothing
+    REQUIRE(ddt.writeBlocks(&requests[1], 2) == 0);
+    REQUIRE(ddt.getDedupedBlocks() == 4);
+
+    // overwriting the shared block hands its content over to the blocks sharing it
+    BlockRequest overwrite = {dataOffset + blocks[0], c.data()};
+    REQUIRE(ddt.writeBlocks(&overwrite, 1) == 0);
+    REQUIRE(ddt.getCopiedBlocks() == 1);
+    REQUIRE(ddt.getSharedBlocks() == 1);
+    REQUIRE(ddt.getStorage(blocks[0]) == blocks[0]);
+    REQUIRE(ddt.getStorage(blocks[2]) == blocks[2]);
+    REQUIRE(ddt.getStorage(blocks[3]) == blocks[2]);
+    readContent(bd, superBlock, ddt, blocks[0], r.data());
+    REQUIRE(memcmp(r.data(), c.data(), DDT_BLOCK_SIZE) == 0);
+    readContent(bd, superBlock, ddt, blocks[3], r.data());
+    REQUIRE(memcmp(r.data(), a.data(), DDT_BLOCK_SIZE) == 0);
+
+    // a freed block is kept while it is shared, and freed with its last reference
+    dmap.freeBlocks(ddt.release(std::vector<int>(1, blocks[2])));
+    REQUIRE(dmap.getBlock(blocks[2]));
+    readContent(bd, superBlock, ddt, blocks[3], r.data());
+    REQUIRE(memcmp(r.data(), a.data(), DDT_BLOCK_SIZE) == 0);
+    std::vector<int> freed = ddt.release(std::vector<int>(1, blocks[3]));
+    REQUIRE(freed.size() == 1);
+    REQUIRE(freed[0] == blocks[3]);
+    dmap.freeBlocks(freed);
+    REQUIRE(!dmap.getBlock(blocks[2]));
+    REQUIRE(ddt.getSharedBlocks() == 0);
+
+    // the table and the index survive a remount
+    BlockRequest copies[2] = {{dataOffset + blocks[4], c.data()}, {dataOffset + blocks[5], b.data()}};
+    REQUIRE(ddt.writeBlocks(copies, 1) == 0);
+    DDT remounted(&bd, &superBlock, &dmap);
+    remounted.init();
+    REQUIRE(remounted.getSharedBlocks() == 1);
+    REQUIRE(remounted.getStorage(blocks[4]) == blocks[0]);
+    REQUIRE(remounted.setEnabled(true) == 0);
+    REQUIRE(remounted.writeBlocks(&copies[1], 1) == 0);
+    REQUIRE(remounted.getStorage(blocks[5]) == blocks[1]);
+
+    // without deduplication, shared blocks are still not overwritten
+    REQUIRE(remounted.setEnabled(false) == 0);
+    BlockRequest plain = {dataOffset + blocks[1], a.data()};
+    REQUIRE(remounted.writeBlocks(&plain, 1) == 0);
+    readContent(bd, superBlock, remounted, blocks[5], r.data());
+    REQUIRE(memcmp(r.data(), b.data(), DDT_BLOCK_SIZE) == 0);
+    readContent(bd, superBlock, remounted, blocks[1], r.data());
+    REQUIRE(memcmp(r.data(), a.data(), DDT_BLOCK_SIZE) == 0);
+
+    // a block written outside of the table gets its own storage first
+    REQUIRE(remounted.unshare(blocks[4]) == 0);
+    REQUIRE(remounted.getStorage(blocks[4]) == blocks[4]);
+    REQUIRE(!remounted.hasSharedBlocks());
+    delete[] blocks;
+}
+
+TEST_CASE( "DDT_ZERO_BLOCKS", "[dedup]" ) {
+
+    // every byte position is found, whatever the size and alignment
+    std::vector<char> z(DDT_BLOCK_SIZE + 64, 0);
+    REQUIRE(DDT::isZeroBlock(z.data(), DDT_BLOCK_SIZE));
+    REQUIRE(DDT::isZeroBlock(z.data() + 3, DDT_BLOCK_SIZE - 5));
+    for (size_t size: {(size_t) 1, (size_t) 7, (size_t) 63, (size_t) 200, (size_t) DDT_BLOCK_SIZE}) {
+        for (size_t pos = 0; pos < size; pos++) {
+            z[1 + pos] = 1;
+            REQUIRE(!DDT::isZeroBlock(z.data() + 1, size));
+            z[1 + pos] = 0;
+        }
+    }
+
+    RamBlockDevice bd(DDT_BLOCK_SIZE);
+    REQUIRE(bd.create(nullptr) == 0);
+    SuperBlock superBlock(&bd);
+    REQUIRE(superBlock.format(DDT_BLOCK_SIZE, NUMBER_DATA_BLOCKS) == 0);
+    DMAP dmap(&bd, &superBlock);
+    dmap.firstInit();
+    DDT ddt(&bd, &superBlock, &dmap);
+    ddt.firstInit();
+    REQUIRE(ddt.hasTable());
+
+    uint32_t dataOffset = superBlock.getDataOffset();
+    int *blocks = dmap.getCertainNumberOfFreeBlocks(4);
+    REQUIRE(blocks != nullptr);
+    std::vector<char> a(DDT_BLOCK_SIZE);
+    std::vector<char> r(DDT_BLOCK_SIZE);
+    gen_random(a.data(), DDT_BLOCK_SIZE);
+
+    // blocks of zeros become holes without deduplication, the others are written
+    BlockRequest requests[3] = {{dataOffset + blocks[0], a.data()}, {dataOffset + blocks[1], z.data()},
+                                {dataOffset + blocks[2], z.data()}};
+    REQUIRE(ddt.writeBlocks(requests, 3) == 0);
+    REQUIRE(ddt.getHoleBlocks() == 2);
+    REQUIRE(ddt.getZeroBlocks() == 2);
+    REQUIRE(!ddt.isZero(blocks[0]));
+    REQUIRE(ddt.isZero(blocks[1]));
+    REQUIRE(dmap.getBlock(blocks[1]));
+    readContent(bd, superBlock, ddt, blocks[1], r.data());
+    REQUIRE(DDT::isZeroBlock(r.data(), DDT_BLOCK_SIZE));
+
+    // content overwriting a hole is stored, zeros overwriting content leave a hole
+    BlockRequest overwrite[2] = {{dataOffset + blocks[0], z.data()}, {dataOffset + blocks[1], a.data()}};
+    REQUIRE(ddt.writeBlocks(overwrite, 2) == 0);
+    REQUIRE(ddt.isZero(blocks[0]));
+    REQUIRE(!ddt.isZero(blocks[1]));
+    readContent(bd, superBlock, ddt, blocks[0], r.data());
+    REQUIRE(DDT::isZeroBlock(r.data(), DDT_BLOCK_SIZE));
+    readContent(bd, superBlock, ddt, blocks[1], r.data());
+    REQUIRE(memcmp(r.data(), a.data(), DDT_BLOCK_SIZE) == 0);
+
+    // new blocks of a file extended by truncate are holes, too
+    bd.write(dataOffset + blocks[3], a.data());
+    REQUIRE(ddt.makeHoles(std::vector<int>(1, blocks[3])) == 0);
+    REQUIRE(ddt.isZero(blocks[3]));
+    readContent(bd, superBlock, ddt, blocks[3], r.data());
+    REQUIRE(DDT::isZeroBlock(r.data(), DDT_BLOCK_SIZE));
+
+    // the marks survive a remount and are dropped when the blocks get written or freed
+    DDT remounted(&bd, &superBlock, &dmap);
+    remounted.init();
+    REQUIRE(remounted.getZeroBlocks() == 3);
+    REQUIRE(remounted.isZero(blocks[2]));
+    REQUIRE(remounted.unshare(blocks[2]) == 0);
+    REQUIRE(!remounted.isZero(blocks[2]));
+    std::vector<int> freed = remounted.release(std::vector<int>(1, blocks[3]));
+    REQUIRE(freed.size() == 1);
+    REQUIRE(!remounted.isZero(blocks[3]));
+    REQUIRE(remounted.getZeroBlocks() == 1);
+    delete[] blocks;
+}
+
+TEST_CASE( "DDT_CLEARED_TAIL", "[dedup]" ) {
+
+    RamBlockDevice bd(DDT_BLOCK_SIZE);
+    REQUIRE(bd.create(nullptr) == 0);
+    SuperBlock superBlock(&bd);
+    REQUIRE(superBlock.format(DDT_BLOCK_SIZE, NUMBER_DATA_BLOCKS) == 0);
+    DMAP dmap(&bd, &superBlock);
+    dmap.firstInit();
+    DDT ddt(&bd, &superBlock, &dmap);
+    ddt.firstInit();
+    REQUIRE(ddt.setEnabled(true) == 0);
+
+    uint32_t dataOffset = superBlock.getDataOffset();
+    int *blocks = dmap.getCertainNumberOfFreeBlocks(2);
+    REQUIRE(blocks != nullptr);
+    std::vector<char> a(DDT_BLOCK_SIZE);
+    std::vector<char> r(DDT_BLOCK_SIZE);
+    gen_random(a.data(), DDT_BLOCK_SIZE);
+
+    // the last blocks of two files share their content
+    BlockRequest requests[2] = {{dataOffset + blocks[0], a.data()}, {dataOffset + blocks[1], a.data()}};
+    REQUIRE(ddt.writeBlocks(requests, 2) == 0);
+    REQUIRE(ddt.getStorage(blocks[1]) == blocks[0]);
+
+    // one file is cut to 100 bytes: its block is read from the shared block, cleared behind the new end and written
+    // back, so the bytes read as zeros when the file grows again, while the other file keeps its content
+    SECTION("cut the sharing file") {
+        readContent(bd, superBlock, ddt, blocks[1], r.data());
+        memset(r.data() + 100, 0, DDT_BLOCK_SIZE - 100);
+        BlockRequest cleared = {dataOffset + blocks[1], r.data()};
+        REQUIRE(ddt.writeBlocks(&cleared, 1) == 0);
+        REQUIRE(ddt.getStorage(blocks[1]) == blocks[1]);
+    }
+    SECTION("cut the shared file") {
+        readContent(bd, superBlock, ddt, blocks[0], r.data());
+        memset(r.data() + 100, 0, DDT_BLOCK_SIZE - 100);
+        BlockRequest cleared = {dataOffset + blocks[0], r.data()};
+        REQUIRE(ddt.writeBlocks(&cleared, 1) == 0);
+        std::swap(blocks[0], blocks[1]);
+    }
+    readContent(bd, superBlock, ddt, blocks[1], r.data());
+    REQUIRE(memcmp(r.data(), a.data(), 100) == 0);
+    REQUIRE(DDT::isZeroBlock(r.data() + 100, DDT_BLOCK_SIZE - 100));
+    readContent(bd, superBlock, ddt, blocks[0], r.data());
+    REQUIRE(memcmp(r.data(), a.data(), DDT_BLOCK_SIZE) == 0);
+    delete[] blocks;
+}
+
+TEST_CASE( "DDT_HAND_OVER", "[dedup]" ) {
+
+    RamBlockDevice bd(DDT_BLOCK_SIZE);
+    REQUIRE(bd.create(nullptr) == 0);
+    SuperBlock superBlock(&bd);
+    REQUIRE(superBlock.format(DDT_BLOCK_SIZE, NUMBER_DATA_BLOCKS) == 0);
+    DMAP dmap(&bd, &superBlock);
+    dmap.firstInit();
+    DDT ddt(&bd, &superBlock, &dmap);
+    ddt.firstInit();
+    REQUIRE(ddt.setEnabled(true) == 0);
+
+    uint32_t dataOffset = superBlock.getDataOffset();
+    int *blocks = dmap.getCertainNumberOfFreeBlocks(5);
+    REQUIRE(blocks != nullptr);
+    std::vector<char> a(DDT_BLOCK_SIZE);
+    std::vector<char> b(DDT_BLOCK_SIZE);
+    std::vector<char> r(DDT_BLOCK_SIZE);
+    gen_random(a.data(), DDT_BLOCK_SIZE);
+    gen_random(b.data(), DDT_BLOCK_SIZE);
+
+    // four blocks share the content of the first one
+    std::vector<BlockRequest> requests(5);
+    for (int i = 0; i < 5; i++) {
+        requests[i].blockNo = dataOffset + blocks[i];
+        requests[i].buffer = a.data();
+    }
+    REQUIRE(ddt.writeBlocks(requests.data(), 5) == 0);
+    REQUIRE(ddt.getSharedBlocks() == 4);
+
+    // the blocks sharing a block are known after a remount, too
+    DDT remounted(&bd, &superBlock, &dmap);
+    SECTION("in the table written the first time") {
+        remounted.init();
+    }
+    SECTION("after a block stopped sharing") {
+        BlockRequest own = {dataOffset + blocks[2], b.data()};
+        REQUIRE(ddt.writeBlocks(&own, 1) == 0);
+        remounted.init();
+        REQUIRE(remounted.getStorage(blocks[2]) == blocks[2]);
+        std::copy(blocks + 3, blocks + 5, blocks + 2);
+        blocks[4] = 0;
+    }
+    REQUIRE(remounted.setEnabled(true) == 0);
+
+    // overwriting the shared block copies it to the first block sharing it, the others follow that one
+    BlockRequest overwrite = {dataOffset + blocks[0], b.data()};
+    REQUIRE(remounted.writeBlocks(&overwrite, 1) == 0);
+    REQUIRE(remounted.getCopiedBlocks() == 1);
+    REQUIRE(remounted.getStorage(blocks[1]) == blocks[1]);
+    for (int i = 2; i < 5 && blocks[i] != 0; i++) {
+        REQUIRE(remounted.getStorage(blocks[i]) == blocks[1]);
+        readContent(bd, superBlock, remounted, blocks[i], r.data());
+        REQUIRE(memcmp(r.data(), a.data(), DDT_BLOCK_SIZE) == 0);
+    }
+
+    // the heir hands the content over in turn
+    BlockRequest again = {dataOffset + blocks[1], b.data()};
+    REQUIRE(remounted.writeBlocks(&again, 1) == 0);
+    REQUIRE(remounted.getCopiedBlocks() == 2);
+    REQUIRE(remounted.getStorage(blocks[2]) == blocks[2]);
+    readContent(bd, superBlock, remounted, blocks[2], r.data());
+    REQUIRE(memcmp(r.data(), a.data(), DDT_BLOCK_SIZE) == 0);
+    if (blocks[4] != 0) {
+        REQUIRE(remounted.getStorage(blocks[3]) == blocks[2]);
+        REQUIRE(remounted.getStorage(blocks[4]) == blocks[2]);
+    }
+    delete[] blocks;
+}
+
+TEST_CASE( "DDT_DEFERRED_WRITES", "[dedup]" ) {
+
+    RamBlockDevice bd(DDT_BLOCK_SIZE);
+    REQUIRE(bd.create(nullptr) == 0);
+    SuperBlock superBlock(&bd);
+    REQUIRE(superBlock.format(DDT_BLOCK_SIZE, NUMBER_DATA_BLOCKS) == 0);
+    DMAP dmap(&bd, &superBlock);
+    dmap.firstInit();
+    DDT ddt(&bd, &superBlock, &dmap);
+    ddt.firstInit();
+    REQUIRE(ddt.setEnabled(true) == 0);
+    ddt.setDeferred(true);
+
+    uint32_t dataOffset = superBlock.getDataOffset();
+    int entriesPerBlock = DDT_BLOCK_SIZE / DDT_ENTRY_SIZE;
+    int *blocks = dmap.getCertainNumberOfFreeBlocks(entriesPerBlock + 1);
+    REQUIRE(blocks != nullptr);
+    std::vector<char> a(DDT_BLOCK_SIZE);
+    gen_random(a.data(), DDT_BLOCK_SIZE);
+
+    // deferred changes stay in memory, every changed table block is written once by flush()
+    std::vector<BlockRequest> requests(entriesPerBlock + 1);
+    for (int i = 0; i <= entriesPerBlock; i++) {
+        requests[i].blockNo = dataOffset + blocks[i];
+        requests[i].buffer = a.data();
+    }
+    REQUIRE(ddt.writeBlocks(requests.data(), requests.size()) == 0);
+    REQUIRE(ddt.getSharedBlocks() == (size_t) entriesPerBlock);
+    REQUIRE(ddt.getDirtyBlocks() == 2);
+
+    DDT mounted(&bd, &superBlock, &dmap);
+    mounted.init();
+    REQUIRE(mounted.getSharedBlocks() == 0);
+
+    REQUIRE(ddt.flush() == 0);
+    REQUIRE(ddt.getDirtyBlocks() == 0);
+    mounted.init();
+    REQUIRE(mounted.getSharedBlocks() == (size_t) entriesPerBlock);
+    REQUIRE(mounted.getStorage(blocks[entriesPerBlock]) == blocks[0]);
+
+    // turning deferring off writes what is left
+    REQUIRE(ddt.unshare(blocks[entriesPerBlock]) == 0);
+    REQUIRE(ddt.getDirtyBlocks() > 0);
+    ddt.setDeferred(false);
+    REQUIRE(ddt.getDirtyBlocks() == 0);
+    mounted.init();
+    REQUIRE(mounted.getStorage(blocks[entriesPerBlock]) == blocks[entriesPerBlock]);
+    delete[] blocks;
+}
@@ -0,0 +1,132 @@
+//
+// Created by user on 17.10.26.
+//
+
+#include "../catch/catch.hpp"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tools.hpp"
+
+#include "IoScheduler.h"
+#include "RamBlockDevice.h"
+
+#define IS_BLOCK_SIZE 512
+
+TEST_CASE( "IS_BATCH_ABSORBS_AND_SORTS_WRITES", "[ioscheduler]" ) {
+
+    RamBlockDevice bd(IS_BLOCK_SIZE);
+    REQUIRE(bd.create(nullptr) == 0);
+    IoScheduler scheduler(&bd, 64);
+
+    char w[IS_BLOCK_SIZE];
+    char r[IS_BLOCK_SIZE];
+    char z[IS_BLOCK_SIZE];
+    memset(z, 0, IS_BLOCK_SIZE);
+
+    scheduler.begin();
+    // the same block written over and over, and blocks out of order
+    for(int i= 0; i < 10; i++) {
+        gen_random(w, IS_BLOCK_SIZE);
+        REQUIRE(scheduler.write(3, w) == 0);
+    }
+    REQUIRE(scheduler.write(9, w) == 0);
+    REQUIRE(scheduler.write(4, w) == 0);
+
+    // nothing reached the device yet, but reads see the queued blocks
+    REQUIRE(bd.read(3, r) == 0);
+    REQUIRE(memcmp(r, z, IS_BLOCK_SIZE) == 0);
+    REQUIRE(scheduler.read(3, r) == 0);
+    REQUIRE(memcmp(r, w, IS_BLOCK_SIZE) == 0);
+    REQUIRE(scheduler.getAbsorbedWrites() == 9);
+    REQUIRE(scheduler.getDeviceWrites() == 0);
+
+    REQUIRE(scheduler.end() == 0);
+    REQUIRE(scheduler.getDeviceWrites() == 3);
+    REQUIRE(scheduler.getDispatches() == 1);
+    for(int b : {3, 4, 9}) {
+        REQUIRE(bd.read(b, r) == 0);
+        REQUIRE(memcmp(r, w, IS_BLOCK_SIZE) == 0);
+    }
+
+    // outside of a batch, writes go to the device at once
+    gen_random(w, IS_BLOCK_SIZE);
+    REQUIRE(scheduler.write(5, w) == 0);
+    REQUIRE(bd.read(5, r) == 0);
+    REQUIRE(memcmp(r, w, IS_BLOCK_SIZE) == 0);
+
+    REQUIRE(bd.close() == 0);
+}
+
+TEST_CASE( "IS_FULL_QUEUE_AND_LARGE_WRITES", "[ioscheduler]" ) {
+
+    RamBlockDevice bd(IS_BLOCK_SIZE);
+    REQUIRE(bd.create(nullptr) == 0);
+    IoScheduler scheduler(&bd, 8);
+
+    char* data= new char[IS_BLOCK_SIZE * IO_SCHEDULER_DIRECT_BLOCKS];
+    char r[IS_BLOCK_SIZE];
+    gen_random(data, IS_BLOCK_SIZE * IO_SCHEDULER_DIRECT_BLOCKS);
+
+    IoBatch* batch= new IoBatch(&scheduler);
+    // the queue is dispatched when it is full
+    for(int b= 0; b < 8; b++) {
+        REQUIRE(scheduler.write(100 - b, data + b*IS_BLOCK_SIZE) == 0);
+    }
+    REQUIRE(scheduler.getDispatches() == 1);
+
+    // a queued block that is overwritten by a large write must not be dispatched later
+    REQUIRE(scheduler.write(200, data) == 0);
+    BlockRequest requests[IO_SCHEDULER_DIRECT_BLOCKS];
+    for(int b= 0; b < IO_SCHEDULER_DIRECT_BLOCKS; b++) {
+        requests[b].blockNo= 200 + b;
+        requests[b].buffer= data + b*IS_BLOCK_SIZE;
+    }
+    requests[0].buffer= data + IS_BLOCK_SIZE;
+    REQUIRE(scheduler.writeBlocks(requests, IO_SCHEDULER_DIRECT_BLOCKS) == 0);
+    delete batch;
+
+    for(int b= 0; b < IO_SCHEDULER_DIRECT_BLOCKS; b++) {
+        REQUIRE(bd.read(200 + b, r) == 0);
+        REQUIRE(memcmp(r, requests[b].buffer, IS_BLOCK_SIZE) == 0);
+    }
+    REQUIRE(scheduler.dispatch() == 0);
+
+    delete [] data;
+    REQUIRE(bd.close() == 0);
+}
+
+TEST_CASE( "IS_BATCH_END_REPORTS_ERRORS", "[ioscheduler]" ) {
+
+    RamBlockDevice bd(IS_BLOCK_SIZE);
+    REQUIRE(bd.create(nullptr) == 0);
+    IoScheduler scheduler(&bd, 64);
+
+    char w[IS_BLOCK_SIZE];
+    gen_random(w, IS_BLOCK_SIZE);
+
+    // a batch ended early is not ended again by its destructor, the outer batch stays open
+    IoBatch outer(&scheduler);
+    {
+        IoBatch batch(&scheduler);
+        REQUIRE(scheduler.write(3, w) == 0);
+        REQUIRE(batch.end(IS_BLOCK_SIZE) == IS_BLOCK_SIZE);
+    }
+    REQUIRE(scheduler.getDispatches() == 0);
+    REQUIRE(outer.end(0) == 0);
+    REQUIRE(scheduler.getDispatches() == 1);
+
+    // a failed dispatch replaces a result that is no error, an error of the operation itself is kept
+    REQUIRE(bd.close() == 0);
+    IoBatch failed(&scheduler);
+    REQUIRE(scheduler.write(4, w) == 0);
+    REQUIRE(failed.end(IS_BLOCK_SIZE) == -EBADF);
+    IoBatch failedOp(&scheduler);
+    REQUIRE(scheduler.write(5, w) == 0);
+    REQUIRE(failedOp.end(-EIO) == -EIO);
+
+    // the error stays for the next dispatch, fsync reports it as well
+    REQUIRE(scheduler.dispatch() == -EBADF);
+}
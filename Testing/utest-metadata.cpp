@@ -0,0 +1,618 @@
+//
+// Created by user on 17.10.26.
+//
+
+#include "../catch/catch.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "tools.hpp"
+
+#include "DMAP.h"
+#include "ExtentMap.h"
+#include "FAT.h"
+#include "RamBlockDevice.h"
+#include "Root.h"
+#include "SimulatedDevice.h"
+#include "SuperBlock.h"
+
+#define META_BLOCK_SIZE 512
+#define META_BENCH_BYTES (1024 * 1024)
+#define META_LOOKUP_BLOCKS 5120        // a 20 MiB file of 4 KiB blocks
+
+TEST_CASE( "META_DEFERRED_WRITES", "[metadata]" ) {
+
+    RamBlockDevice bd(META_BLOCK_SIZE);
+    REQUIRE(bd.create(nullptr) == 0);
+    SuperBlock superBlock(&bd);
+    REQUIRE(superBlock.format(META_BLOCK_SIZE, NUMBER_DATA_BLOCKS) == 0);
+    FAT fat(&bd, &superBlock);
+    fat.firstInit();
+    DMAP dmap(&bd, &superBlock);
+    dmap.firstInit();
+    int entriesPerBlock = META_BLOCK_SIZE / superBlock.getFatEntrySize();
+
+    // without deferring, every change writes its block
+    fat.setNext(50000, 50001);
+    fat.setNext(50001, FAT_END);
+    REQUIRE(fat.getWrittenBlocks() == 2);
+
+    // deferred changes stay in memory, every changed block is written once by flush()
+    fat.setDeferred(true);
+    dmap.setDeferred(true);
+    int *blocks = dmap.getCertainNumberOfFreeBlocks(3 * entriesPerBlock);
+    REQUIRE(blocks != nullptr);
+    for (int i = 0; i < 3 * entriesPerBlock; i++) {
+        fat.setNext(blocks[i], i + 1 < 3 * entriesPerBlock ? blocks[i + 1] : FAT_END);
+    }
+    REQUIRE(fat.getDirtyBlocks() == 4);
+    REQUIRE(dmap.getDirtyBlocks() == 2);
+    REQUIRE(fat.getWrittenBlocks() == 2);
+    REQUIRE(dmap.getWrittenBlocks() == 0);
+
+    FAT mounted(&bd, &superBlock);
+    mounted.init();
+    REQUIRE(mounted.getNext(blocks[0]) == FAT_END);
+    REQUIRE(mounted.getNext(50000) == 50001);
+
+    REQUIRE(fat.flush() == 0);
+    REQUIRE(dmap.flush() == 0);
+    REQUIRE(fat.getDirtyBlocks() == 0);
+    REQUIRE(fat.getWrittenBlocks() == 6);
+    REQUIRE(dmap.getWrittenBlocks() == 2);
+    mounted.init();
+    DMAP mountedDmap(&bd, &superBlock);
+    mountedDmap.init();
+    for (int i = 0; i < 3 * entriesPerBlock; i++) {
+        REQUIRE(mounted.getNext(blocks[i]) == (i + 1 < 3 * entriesPerBlock ? blocks[i + 1] : FAT_END));
+        REQUIRE(mountedDmap.getBlock(blocks[i]));
+    }
+
+    // turning deferring off writes what is left
+    fat.freeBlock(blocks[0]);
+    dmap.freeBlocks(std::vector<int>(1, blocks[0]));
+    fat.setDeferred(false);
+    dmap.setDeferred(false);
+    mounted.init();
+    mountedDmap.init();
+    REQUIRE(mounted.getNext(blocks[0]) == FAT_END);
+    REQUIRE(!mountedDmap.getBlock(blocks[0]));
+    delete[] blocks;
+}
+
+TEST_CASE( "META_DEFERRED_ROOT", "[metadata]" ) {
+
+    RamBlockDevice bd(META_BLOCK_SIZE);
+    REQUIRE(bd.create(nullptr) == 0);
+    SuperBlock superBlock(&bd);
+    REQUIRE(superBlock.format(META_BLOCK_SIZE, NUMBER_DATA_BLOCKS) == 0);
+    Root root(&bd, &superBlock);
+    root.init();
+
+    // a deferred entry is not on disk before flush(), which writes it as it is then
+    root.setDeferred(true);
+    rootFile *file = root.createNewFile("/a");
+    REQUIRE(file != nullptr);
+    REQUIRE(root.discWrite(file));
+    file->fileStats.st_size = 1000;
+    REQUIRE(root.discWrite(file));
+    REQUIRE(root.getDirtyEntries() == 1);
+    Root mounted(&bd, &superBlock);
+    mounted.initRootDir();
+    REQUIRE(mounted.getRootEntryFile("/a") == nullptr);
+
+    REQUIRE(root.flush() == 0);
+    REQUIRE(root.getDirtyEntries() == 0);
+    mounted.initRootDir();
+    REQUIRE(mounted.getRootEntryFile("/a") != nullptr);
+    REQUIRE(mounted.getRootEntryFile("/a")->fileStats.st_size == 1000);
+
+    // a file deleted before the flush leaves an empty entry, another file created in its place is written instead
+    REQUIRE(root.deleteFile("/a") == 0);
+    REQUIRE(root.flush() == 0);
+    mounted.initRootDir();
+    REQUIRE(mounted.getRootEntryFile("/a") == nullptr);
+    file = root.createNewFile("/b");
+    REQUIRE(root.discWrite(file));
+    REQUIRE(root.deleteFile("/b") == 0);
+    file = root.createNewFile("/c");
+    REQUIRE(root.discWrite(file));
+    REQUIRE(root.getDirtyEntries() == 1);
+
+    // turning deferring off writes what is left
+    root.setDeferred(false);
+    mounted.initRootDir();
+    REQUIRE(mounted.getRootEntryFile("/b") == nullptr);
+    REQUIRE(mounted.getRootEntryFile("/c") != nullptr);
+}
+
+TEST_CASE( "META_VOLUME_FULL", "[metadata]" ) {
+
+    // a container formatted with size=256K: 512 data blocks of 512 bytes, block 0 is never allocated
+    int numBlocks = 256 * 1024 / META_BLOCK_SIZE;
+    RamBlockDevice bd(META_BLOCK_SIZE);
+    REQUIRE(bd.create(nullptr) == 0);
+    SuperBlock superBlock(&bd);
+    REQUIRE(superBlock.format(META_BLOCK_SIZE, numBlocks) == 0);
+    DMAP dmap(&bd, &superBlock);
+    dmap.firstInit();
+    dmap.setPreallocate(false);
+
+    int *first = dmap.getCertainNumberOfFreeBlocks(numBlocks - 100);
+    REQUIRE(first != nullptr);
+
+    // a request that does not fit takes nothing
+    REQUIRE(dmap.getCertainNumberOfFreeBlocks(100) == nullptr);
+    int used = 0;
+    for (int i = 0; i < numBlocks; i++) {
+        used += dmap.getBlock(i);
+    }
+    REQUIRE(used == numBlocks - 100);
+    DMAP mounted(&bd, &superBlock);
+    mounted.init();
+    REQUIRE(!mounted.getBlock(numBlocks - 1));
+
+    // the rest of the volume can still be allocated, then it is full
+    int *rest = dmap.getCertainNumberOfFreeBlocks(99);
+    REQUIRE(rest != nullptr);
+    REQUIRE(rest[0] == numBlocks - 99);
+    REQUIRE(rest[98] == numBlocks - 1);
+    REQUIRE(dmap.getCertainNumberOfFreeBlocks(1) == nullptr);
+
+    // freed blocks are found again
+    dmap.freeBlocks(std::vector<int>(first + 10, first + 20));
+    int *again = dmap.getCertainNumberOfFreeBlocks(10);
+    REQUIRE(again != nullptr);
+    REQUIRE(again[0] == first[10]);
+    delete[] first;
+    delete[] rest;
+    delete[] again;
+}
+
+TEST_CASE( "META_FAT32", "[metadata]" ) {
+
+    RamBlockDevice bd(META_BLOCK_SIZE);
+    REQUIRE(bd.create(nullptr) == 0);
+    SuperBlock superBlock(&bd);
+
+    SECTION("entry size follows the volume size") {
+        REQUIRE(superBlock.format(META_BLOCK_SIZE, NUMBER_BLOCKS) == 0);
+        REQUIRE(superBlock.getFatEntrySize() == FAT16_ENTRY_SIZE);
+        REQUIRE(superBlock.format(META_BLOCK_SIZE, NUMBER_BLOCKS + 1) == 0);
+        REQUIRE(superBlock.getFatEntrySize() == FAT32_ENTRY_SIZE);
+        REQUIRE(superBlock.format(META_BLOCK_SIZE, NUMBER_BLOCKS + 1, FAT16_ENTRY_SIZE) < 0);
+        REQUIRE(superBlock.format(META_BLOCK_SIZE, MAX_DATA_BLOCKS + 1) < 0);
+        REQUIRE(superBlock.format(META_BLOCK_SIZE, 1000, 3) < 0);
+    }
+
+    SECTION("entries of a 16 bit FAT keep their full range") {
+        REQUIRE(superBlock.format(META_BLOCK_SIZE, NUMBER_BLOCKS) == 0);
+        FAT fat(&bd, &superBlock);
+        fat.firstInit();
+        fat.setDeferred(true);
+        for (int i = 1; i < NUMBER_BLOCKS; i++) {
+            fat.setNext(i, NUMBER_BLOCKS - i);
+        }
+        REQUIRE(fat.flush() == 0);
+        FAT mounted(&bd, &superBlock);
+        mounted.init();
+        for (int i = 1; i < NUMBER_BLOCKS; i++) {
+            REQUIRE(mounted.getNext(i) == NUMBER_BLOCKS - i);
+        }
+        REQUIRE(mounted.getNext(0) == FAT_END);
+    }
+
+    SECTION("a 32 bit FAT links blocks beyond 65535") {
+        int numBlocks = 3 * NUMBER_BLOCKS;
+        REQUIRE(superBlock.format(META_BLOCK_SIZE, numBlocks) == 0);
+        superBlock.discWrite();
+        FAT fat(&bd, &superBlock);
+        fat.firstInit();
+        DMAP dmap(&bd, &superBlock);
+        dmap.firstInit();
+        dmap.setPreallocate(false);
+        int *blocks = dmap.getCertainNumberOfFreeBlocks(numBlocks - 1);
+        REQUIRE(blocks != nullptr);
+        REQUIRE(blocks[numBlocks - 2] == numBlocks - 1);
+        REQUIRE(dmap.getCertainNumberOfFreeBlocks(1) == nullptr);
+        fat.setDeferred(true);
+        for (int i = 0; i < numBlocks - 1; i++) {
+            fat.setNext(blocks[i], i + 1 < numBlocks - 1 ? blocks[i + 1] : FAT_END);
+        }
+        REQUIRE(fat.flush() == 0);
+        delete[] blocks;
+
+        SuperBlock mountedSuperBlock(&bd);
+        REQUIRE(mountedSuperBlock.init() == 0);
+        REQUIRE(mountedSuperBlock.getNumDataBlocks() == (uint32_t) numBlocks);
+        REQUIRE(mountedSuperBlock.getFatEntrySize() == FAT32_ENTRY_SIZE);
+        FAT mounted(&bd, &mountedSuperBlock);
+        mounted.init();
+        int length = 1;
+        for (int block = 1; mounted.getNext(block) != FAT_END; block = mounted.getNext(block)) {
+            length++;
+        }
+        REQUIRE(length == numBlocks - 1);
+    }
+}
+
+TEST_CASE( "META_EXTENT_MAP", "[metadata]" ) {
+
+    ExtentMap map;
+    REQUIRE(map.isLoaded());
+    REQUIRE(map.getBlock(0) == FAT_END);
+    REQUIRE(map.getLastBlock() == FAT_END);
+
+    // neighbouring blocks extend the last extent
+    int blocks[] = {10, 11, 12, 40, 41, 7, 13};
+    map.append(blocks, 7);
+    REQUIRE(map.getBlocks() == 7);
+    REQUIRE(map.getExtents() == 4);
+    int run = 0;
+    for (int i = 0; i < 7; i++) {
+        REQUIRE(map.getBlock(i) == blocks[i]);
+    }
+    REQUIRE(map.getBlock(1, &run) == 11);
+    REQUIRE(run == 2);
+    REQUIRE(map.getBlock(7, &run) == FAT_END);
+    REQUIRE(run == 0);
+    REQUIRE(map.getLastBlock() == 13);
+
+    SECTION("truncate keeps the head of the file") {
+        map.truncate(4);
+        REQUIRE(map.getBlocks() == 4);
+        REQUIRE(map.getExtents() == 2);
+        REQUIRE(map.getLastBlock() == 40);
+        int more[] = {41, 42};
+        map.append(more, 2);
+        REQUIRE(map.getExtents() == 2);
+        REQUIRE(map.getBlock(5) == 42);
+        map.truncate(0);
+        REQUIRE(map.getExtents() == 0);
+        REQUIRE(map.getBlock(0) == FAT_END);
+    }
+
+    SECTION("a stored table is read back if it matches the file") {
+        char buffer[128] = {};
+        size_t size = map.serialize(buffer, sizeof(buffer));
+        REQUIRE(size > 0);
+        ExtentMap stored;
+        REQUIRE(stored.deserialize(buffer, sizeof(buffer), 10, 7, 100));
+        REQUIRE(stored.getExtents() == 4);
+        for (int i = 0; i < 7; i++) {
+            REQUIRE(stored.getBlock(i) == blocks[i]);
+        }
+        REQUIRE(!stored.deserialize(buffer, sizeof(buffer), 11, 7, 100));
+        REQUIRE(!stored.isLoaded());
+        REQUIRE(!stored.deserialize(buffer, sizeof(buffer), 10, 8, 100));
+        REQUIRE(!stored.deserialize(buffer, sizeof(buffer), 10, 7, 41));
+        REQUIRE(!stored.deserialize(buffer, size - 1, 10, 7, 100));
+
+        // a table that does not fit is marked as missing
+        REQUIRE(map.serialize(buffer, size - 1) == 0);
+        REQUIRE(!stored.deserialize(buffer, sizeof(buffer), 10, 7, 100));
+    }
+
+    SECTION("an open file is looked up in its block array") {
+        map.open();
+        map.open();
+        REQUIRE(map.isMaterialized());
+        for (int i = 0; i < 7; i++) {
+            REQUIRE(map.getBlock(i, &run) == blocks[i]);
+            REQUIRE(run == 1);
+        }
+        // appends and truncates keep the array up to date
+        int more[] = {14, 3};
+        map.append(more, 2);
+        REQUIRE(map.getBlock(7) == 14);
+        REQUIRE(map.getBlock(8) == 3);
+        map.truncate(5);
+        REQUIRE(map.getBlock(4) == 41);
+        REQUIRE(map.getBlock(5) == FAT_END);
+        map.append(more, 1);
+        REQUIRE(map.getBlock(5) == 14);
+        map.close();
+        REQUIRE(map.isMaterialized());
+        map.close();
+        REQUIRE(!map.isMaterialized());
+        REQUIRE(map.getBlock(5, &run) == 14);
+        REQUIRE(map.getBlock(0, &run) == 10);
+        REQUIRE(run == 3);
+    }
+
+    SECTION("a FAT chain is mapped by walking it once") {
+        RamBlockDevice bd(META_BLOCK_SIZE);
+        REQUIRE(bd.create(nullptr) == 0);
+        SuperBlock superBlock(&bd);
+        REQUIRE(superBlock.format(META_BLOCK_SIZE, NUMBER_DATA_BLOCKS) == 0);
+        FAT fat(&bd, &superBlock);
+        fat.firstInit();
+        fat.setDeferred(true);
+        for (int i = 0; i < 6; i++) {
+            fat.setNext(blocks[i], blocks[i + 1]);
+        }
+        fat.setNext(blocks[6], FAT_END);
+        ExtentMap built;
+        REQUIRE(built.deserialize(nullptr, 0, 10, 7, NUMBER_DATA_BLOCKS) == false);
+        built.build(&fat, blocks[0]);
+        REQUIRE(built.isLoaded());
+        REQUIRE(built.getExtents() == 4);
+        for (int i = 0; i < 7; i++) {
+            REQUIRE(built.getBlock(i) == blocks[i]);
+        }
+    }
+}
+
+// writes an entry without an extent table, the way older containers store it
+static void writeEntry(RamBlockDevice &bd, SuperBlock &superBlock, rootFile &file, size_t size) {
+    std::vector<char> block(META_BLOCK_SIZE, 0);
+    memcpy(block.data(), &file, size);
+    REQUIRE(bd.write(superBlock.getRootOffset() + file.indexRootDirBlock, block.data()) == 0);
+}
+
+TEST_CASE( "META_TAIL_POINTER", "[metadata]" ) {
+
+    RamBlockDevice bd(META_BLOCK_SIZE);
+    REQUIRE(bd.create(nullptr) == 0);
+    SuperBlock superBlock(&bd);
+    REQUIRE(superBlock.format(META_BLOCK_SIZE, NUMBER_DATA_BLOCKS) == 0);
+    superBlock.discWrite();
+    Root root(&bd, &superBlock);
+    root.init();
+
+    // the tail pointer is part of the entry since version 6, the extent table follows it 8 byte aligned
+    REQUIRE(root.entrySize() == sizeof(rootFile));
+    REQUIRE(root.extentTableOffset() >= root.entrySize());
+    REQUIRE(root.extentTableOffset() % 8 == 0);
+    REQUIRE(root.extentTableOffset() < root.entrySize() + 8);
+
+    // a file of 7 blocks, the last one partly used
+    int blocks[] = {10, 11, 12, 40, 41, 7, 13};
+    rootFile *file = root.createNewFile("/a");
+    REQUIRE(file != nullptr);
+    REQUIRE(file->lastBlock == FAT_END);
+    REQUIRE(file->blockCount == 0);
+    root.getExtents(file)->append(blocks, 7);
+    file->firstBlock = blocks[0];
+    file->fileStats.st_size = 6 * META_BLOCK_SIZE + 100;
+    file->lastBlock = blocks[6];
+    file->blockCount = 7;
+    REQUIRE(root.discWrite(file));
+
+    SECTION("the tail pointer survives a remount") {
+        Root mounted(&bd, &superBlock);
+        mounted.initRootDir();
+        rootFile *read = mounted.getRootEntryFile("/a");
+        REQUIRE(read != nullptr);
+        REQUIRE(read->lastBlock == 13);
+        REQUIRE(read->blockCount == 7);
+        REQUIRE(mounted.getExtents(read)->getLastBlock() == 13);
+    }
+
+    SECTION("a stale tail pointer is taken from the extent table") {
+        file->lastBlock = 41;
+        REQUIRE(root.discWrite(file));
+        Root mounted(&bd, &superBlock);
+        mounted.initRootDir();
+        REQUIRE(mounted.getRootEntryFile("/a")->lastBlock == 13);
+        REQUIRE(mounted.getRootEntryFile("/a")->blockCount == 7);
+    }
+
+    SECTION("without an extent table, an invalid tail pointer is dropped") {
+        rootFile entry = *file;
+        writeEntry(bd, superBlock, entry, sizeof(rootFile));
+        Root mounted(&bd, &superBlock);
+        mounted.initRootDir();
+        REQUIRE(!mounted.getExtents(mounted.getRootEntryFile("/a"))->isLoaded());
+        REQUIRE(mounted.getRootEntryFile("/a")->lastBlock == 13);
+
+        // outside of the data region, the block of the FAT end or a count that does not match the size
+        int lastBlocks[] = {(int) NUMBER_DATA_BLOCKS, -5, FAT_END, 13};
+        int blockCounts[] = {7, 7, 7, 6};
+        for (int i = 0; i < 4; i++) {
+            entry.lastBlock = lastBlocks[i];
+            entry.blockCount = blockCounts[i];
+            writeEntry(bd, superBlock, entry, sizeof(rootFile));
+            mounted.initRootDir();
+            REQUIRE(mounted.getRootEntryFile("/a")->lastBlock == FAT_END);
+            REQUIRE(mounted.getRootEntryFile("/a")->blockCount == -1);
+        }
+    }
+
+    SECTION("entries of version 5 containers have no tail pointer") {
+        // the same layout, only the version differs
+        std::vector<char> block(META_BLOCK_SIZE);
+        REQUIRE(bd.read(0, block.data()) == 0);
+        uint32_t version = SUPERBLOCK_VERSION_NO_TAIL;
+        memcpy(block.data() + offsetof(superBlockData, version), &version, sizeof(version));
+        REQUIRE(bd.write(0, block.data()) == 0);
+        SuperBlock old(&bd);
+        REQUIRE(old.init() == 0);
+        REQUIRE(old.getVersion() == SUPERBLOCK_VERSION_NO_TAIL);
+        Root mounted(&bd, &old);
+        REQUIRE(mounted.entrySize() == offsetof(rootFile, lastBlock));
+        REQUIRE(mounted.extentTableOffset() == ((offsetof(rootFile, lastBlock) + 7) & ~(size_t) 7));
+
+        // whatever follows the entry is not taken for a tail pointer, without a table it is unknown
+        rootFile entry = *file;
+        writeEntry(bd, old, entry, sizeof(rootFile));
+        mounted.initRootDir();
+        REQUIRE(mounted.getRootEntryFile("/a")->lastBlock == FAT_END);
+        REQUIRE(mounted.getRootEntryFile("/a")->blockCount == -1);
+
+        // an entry written to the old container leaves the bytes behind it to the extent table, which is mapped from
+        // the FAT first
+        FAT fat(&bd, &old);
+        fat.firstInit();
+        for (int i = 0; i < 6; i++) {
+            fat.setNext(blocks[i], blocks[i + 1]);
+        }
+        mounted.getExtents(mounted.getRootEntryFile("/a"))->build(&fat, blocks[0]);
+        REQUIRE(mounted.discWrite(mounted.getRootEntryFile("/a")));
+        mounted.initRootDir();
+        REQUIRE(mounted.getExtents(mounted.getRootEntryFile("/a"))->isLoaded());
+        REQUIRE(mounted.getRootEntryFile("/a")->lastBlock == 13);
+        REQUIRE(mounted.getRootEntryFile("/a")->blockCount == 7);
+    }
+
+    SECTION("truncate moves the tail pointer to the new last block") {
+        root.getExtents(file)->truncate(4);
+        file->fileStats.st_size = 3 * META_BLOCK_SIZE + 1;
+        file->lastBlock = root.getExtents(file)->getLastBlock();
+        file->blockCount = 4;
+        REQUIRE(root.discWrite(file));
+        Root mounted(&bd, &superBlock);
+        mounted.initRootDir();
+        REQUIRE(mounted.getRootEntryFile("/a")->lastBlock == 40);
+        REQUIRE(mounted.getRootEntryFile("/a")->blockCount == 4);
+
+        // an entry still holding the tail of the longer file is corrected
+        file->lastBlock = 13;
+        file->blockCount = 7;
+        REQUIRE(root.discWrite(file));
+        mounted.initRootDir();
+        REQUIRE(mounted.getRootEntryFile("/a")->lastBlock == 40);
+        REQUIRE(mounted.getRootEntryFile("/a")->blockCount == 4);
+
+        // truncated to zero, the file has no last block
+        root.getExtents(file)->truncate(0);
+        file->firstBlock = FAT_END;
+        file->fileStats.st_size = 0;
+        file->lastBlock = FAT_END;
+        file->blockCount = 0;
+        REQUIRE(root.discWrite(file));
+        mounted.initRootDir();
+        REQUIRE(mounted.getRootEntryFile("/a")->lastBlock == FAT_END);
+        REQUIRE(mounted.getRootEntryFile("/a")->blockCount == 0);
+    }
+
+    SECTION("a file created in place of a deleted one starts without a tail") {
+        int index = file->indexRootDirBlock;
+        REQUIRE(root.deleteFile("/a") == 0);
+        rootFile *created = root.createNewFile("/b");
+        REQUIRE(created->indexRootDirBlock == index);
+        REQUIRE(created->lastBlock == FAT_END);
+        REQUIRE(created->blockCount == 0);
+        REQUIRE(root.getExtents(created)->getBlocks() == 0);
+        REQUIRE(root.discWrite(created));
+        Root mounted(&bd, &superBlock);
+        mounted.initRootDir();
+        REQUIRE(mounted.getRootEntryFile("/a") == nullptr);
+        REQUIRE(mounted.getRootEntryFile("/b")->lastBlock == FAT_END);
+        REQUIRE(mounted.getRootEntryFile("/b")->blockCount == 0);
+    }
+}
+
+// hidden, run with: unittests "[benchmark]"
+TEST_CASE( "META_LOOKUP_BENCHMARK", "[.][benchmark]" ) {
+
+    // reads a fragmented 20 MiB file block by block the way sequential 4 KiB requests do: every request looks up the
+    // data block of its offset by walking the FAT chain from the first block, in the extents or in the block array
+    RamBlockDevice bd(META_BLOCK_SIZE);
+    REQUIRE(bd.create(nullptr) == 0);
+    SuperBlock superBlock(&bd);
+    REQUIRE(superBlock.format(META_BLOCK_SIZE, 4 * META_LOOKUP_BLOCKS) == 0);
+    FAT fat(&bd, &superBlock);
+    fat.firstInit();
+    fat.setDeferred(true);
+    // runs of 1 to 8 blocks with gaps between them
+    std::vector<int> blocks;
+    for (int block = 1; (int) blocks.size() < META_LOOKUP_BLOCKS; block += 2) {
+        for (int i = 0; i < 1 + (int) blocks.size() % 8 && (int) blocks.size() < META_LOOKUP_BLOCKS; i++) {
+            blocks.push_back(block++);
+        }
+    }
+    for (int i = 0; i < META_LOOKUP_BLOCKS; i++) {
+        fat.setNext(blocks[i], i + 1 < META_LOOKUP_BLOCKS ? blocks[i + 1] : FAT_END);
+    }
+    ExtentMap map;
+    map.build(&fat, blocks[0]);
+
+    const char *modes[] = {"FAT chain", "extents", "block array"};
+    printf("%-12s %10s %14s\n", "lookup", "extents", "ms per file");
+    for (int mode = 0; mode < 3; mode++) {
+        if (mode == 2) {
+            map.open();
+        }
+        int wrong = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < META_LOOKUP_BLOCKS; i++) {
+            int block = blocks[0];
+            if (mode == 0) {
+                for (int j = 0; j < i; j++) block = fat.getNext(block);
+            } else {
+                block = map.getBlock(i);
+            }
+            wrong += block != blocks[i];
+        }
+        std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+        REQUIRE(wrong == 0);
+        printf("%-12s %10lu %14.3f\n", modes[mode], (unsigned long) map.getExtents(), time.count() * 1000);
+    }
+    map.close();
+}
+
+TEST_CASE( "META_BENCHMARK", "[.][benchmark]" ) {
+
+    // appends 1 MiB to a file the way fuseWrite does: allocate the blocks, link them into the FAT chain, write the
+    // data; every block reaching the device is counted, the device time is simulated for a slow disk
+    SimulationParams params;
+    REQUIRE(SimulatedDevice::parseParams("50:0:0:100", &params));
+    std::vector<char> data(META_BENCH_BYTES);
+    gen_random(data.data(), data.size());
+    const char *modes[] = {"write-through", "per operation", "every 16 ops"};
+    size_t opSizes[] = {4096, 131072};
+
+    printf("%-8s %-14s %12s %14s %10s\n", "op size", "metadata", "meta blocks", "amplification", "MB/s");
+    for (size_t opSize: opSizes) {
+        for (int mode = 0; mode < 3; mode++) {
+            RamBlockDevice *ram = new RamBlockDevice(META_BLOCK_SIZE);
+            REQUIRE(ram->create(nullptr) == 0);
+            SimulatedDevice device(ram, params);
+            SuperBlock superBlock(&device);
+            REQUIRE(superBlock.format(META_BLOCK_SIZE, NUMBER_DATA_BLOCKS) == 0);
+            FAT fat(&device, &superBlock);
+            fat.firstInit();
+            DMAP dmap(&device, &superBlock);
+            dmap.firstInit();
+            dmap.setPreallocate(false);
+            fat.setDeferred(mode > 0);
+            dmap.setDeferred(mode > 0);
+            device.resetStats();
+
+            int opBlocks = opSize / META_BLOCK_SIZE;
+            int last = FAT_END;
+            std::vector<BlockRequest> requests(opBlocks);
+            for (size_t done = 0, op = 1; done < META_BENCH_BYTES; done += opSize, op++) {
+                int *blocks = dmap.getCertainNumberOfFreeBlocks(opBlocks);
+                REQUIRE(blocks != nullptr);
+                for (int i = 0; i < opBlocks; i++) {
+                    if (last != FAT_END) {
+                        fat.setNext(last, blocks[i]);
+                    }
+                    fat.setNext(blocks[i], FAT_END);
+                    last = blocks[i];
+                    requests[i].blockNo = superBlock.getDataOffset() + blocks[i];
+                    requests[i].buffer = data.data() + done + (size_t) i * META_BLOCK_SIZE;
+                }
+                delete[] blocks;
+                REQUIRE(device.writeBlocks(requests.data(), opBlocks) == 0);
+                if (mode == 1 || (mode == 2 && op % 16 == 0)) {
+                    REQUIRE(dmap.flush() == 0);
+                    REQUIRE(fat.flush() == 0);
+                }
+            }
+            REQUIRE(dmap.flush() == 0);
+            REQUIRE(fat.flush() == 0);
+
+            uint64_t metaBlocks = fat.getWrittenBlocks() + dmap.getWrittenBlocks();
+            printf("%-8lu %-14s %12lu %14.3f %10.1f\n", (unsigned long) opSize, modes[mode],
+                   (unsigned long) metaBlocks, (double) device.getBlocks() * META_BLOCK_SIZE / META_BENCH_BYTES,
+                   META_BENCH_BYTES / (device.getDeviceTimeNs() / 1e9) / 1e6);
+        }
+    }
+}
@@ -0,0 +1,165 @@
+//
+// Created by user on 17.10.26.
+//
+
+#ifndef MYFS_BLOCKCACHE_H
+#define MYFS_BLOCKCACHE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include "BlockStorage.h"
+
+/// @brief Block buffer cache in front of a block storage backend.
+///
+/// Keeps recently used blocks (file data as well as FAT, DMAP and root directory blocks) in memory. Blocks are found
+/// by a hash lookup of their block number and replaced in LRU order. By default, writes go through to the device and
+/// update the cached copy. In write-back mode, written blocks only become dirty in memory and are written later by
+/// flush() or by a background flusher thread, so repeated writes to the same block reach the device only once. A block
+/// can be pinned, which hands out a pointer to the cached copy and keeps the block from being replaced until it is
+/// unpinned. A cache with capacity 0 passes all requests straight to the device.
+class BlockCache : public BlockStorage {
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry {
+        uint32_t blockNo;
+        char *data;
+        int refCount;
+        bool dirty;
+        Clock::time_point dirtySince;
+        std::list<Entry *>::iterator lruPos;
+    };
+
+    BlockStorage *device;
+    uint32_t blockSize;
+    size_t capacity;
+
+    std::unordered_map<uint32_t, Entry *> entries;
+    std::list<Entry *> lru;     // most recently used first
+    std::recursive_mutex lock;
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t prefetched;
+
+    // write-back state
+    bool writeBack;
+    size_t dirtyCount;
+    size_t dirtyLimit;
+    std::chrono::milliseconds maxDirtyAge;
+    uint64_t deviceWrites;
+
+    std::thread flusher;
+    std::condition_variable_any flusherWakeup;
+    bool flusherStop;
+
+    Entry *lookup(uint32_t blockNo);
+    Entry *insert(uint32_t blockNo, const char *data);
+    void evict(size_t limit);
+    void drop(Entry *entry);
+    int writeOut(std::vector<Entry *> &dirtyEntries);
+    int flushOlderThan(Clock::time_point limit);
+    void flusherLoop();
+
+public:
+    BlockCache(BlockStorage *device, uint32_t blockSize, size_t capacity);
+    virtual ~BlockCache();
+
+    /// @brief Change the number of cached blocks. Unpinned blocks are dropped if the cache shrinks.
+    void setCapacity(size_t capacity);
+    size_t getCapacity();
+
+    /// @brief Pool of aligned block buffers of the underlying device.
+    virtual BufferPool *getBufferPool();
+
+    /// @brief Change the block size of the cache and the device. All cached blocks are written and dropped.
+    virtual void setBlockSize(uint32_t blockSize);
+    virtual uint32_t getBlockSize();
+
+    /// @brief Attach a container to the device.
+    virtual int open(const char *path);
+    virtual int create(const char *path);
+
+    /// @brief Write all dirty blocks, drop the cached blocks and detach the container of the device.
+    virtual int close();
+
+    /// @brief Write all dirty blocks and flush the device to stable storage.
+    virtual int sync();
+
+    /// @brief Read a block, from memory if it is cached.
+    virtual int read(uint32_t blockNo, char *buffer);
+
+    /// @brief Write a block to the device and the cache.
+    virtual int write(uint32_t blockNo, char *buffer);
+
+    /// @brief Read several blocks. All misses are fetched from the device with one vectored request.
+    virtual int readBlocks(const BlockRequest *requests, size_t count);
+
+    /// @brief Write several blocks with one vectored request and update the cache.
+    virtual int writeBlocks(const BlockRequest *requests, size_t count);
+
+    /// @brief Drop the cached copies of the blocks, dirty or not, and discard them on the device.
+    ///
+    /// Pinned blocks stay in the cache, but are zeroed like the device blocks.
+    virtual int discard(uint32_t firstBlock, uint32_t count);
+
+    /// @brief Preallocate the blocks on the device.
+    virtual int preallocate(uint32_t firstBlock, uint32_t count);
+
+    /// @brief Load blocks into the cache ahead of their use.
+    ///
+    /// All blocks that are not cached yet are read with one vectored request.
+    /// \param [in] blockNos Numbers of the blocks to load.
+    /// \param [in] count Number of blocks.
+    /// \return 0 on success, -ERRNO on failure.
+    int prefetch(const uint32_t *blockNos, size_t count);
+
+    /// @brief Pin a block in the cache.
+    ///
+    /// The block is read from the device if it is not cached. Until unpin() is called, the block stays in the cache
+    /// and the returned pointer stays valid. Pins are counted, each pin() needs its own unpin().
+    /// \param [in] blockNo Number of the block.
+    /// \param [out] error -ERRNO if the block could not be read, 0 otherwise.
+    /// \return Pointer to the cached block, nullptr on failure or if the cache is disabled.
+    const char *pin(uint32_t blockNo, int *error);
+
+    /// @brief Release a block pinned by pin().
+    void unpin(uint32_t blockNo);
+
+    /// @brief Drop all unpinned blocks. Dirty blocks are written to the device first.
+    void clear();
+
+    /// @brief Switch write-back caching on or off.
+    ///
+    /// Switching it off flushes all dirty blocks.
+    /// \param [in] enabled true for write-back, false for write-through.
+    /// \param [in] dirtyLimit Number of dirty blocks that triggers a flush.
+    /// \param [in] maxDirtyAgeMs Dirty blocks older than this are written by the flusher thread.
+    void setWriteBack(bool enabled, size_t dirtyLimit, unsigned maxDirtyAgeMs);
+    bool isWriteBack();
+
+    /// @brief Write all dirty blocks to the device in ascending block order.
+    /// \return 0 on success, -ERRNO of the first failed write otherwise (the failed blocks stay dirty).
+    int flush();
+
+    /// @brief Start the background thread that writes dirty blocks after they reached their maximum age or when
+    /// there are more dirty blocks than the dirty limit.
+    void startFlusher();
+
+    /// @brief Stop the background flusher thread. Dirty blocks stay in the cache.
+    void stopFlusher();
+
+    size_t getDirtyCount();
+    uint64_t getDeviceWrites();
+
+    uint64_t getHits();
+    uint64_t getMisses();
+    uint64_t getPrefetched();
+};
+
+#endif //MYFS_BLOCKCACHE_H
@@ -0,0 +1,94 @@
+//
+// Created by user on 17.10.26.
+//
+
+#ifndef MYFS_BLOCKSTORAGE_H
+#define MYFS_BLOCKSTORAGE_H
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include "BufferPool.h"
+
+class IoStats;
+
+/// @brief A single block transfer of a vectored read or write.
+struct BlockRequest {
+    uint32_t blockNo;
+    char *buffer;
+};
+
+/// @brief Interface of a block storage backend.
+///
+/// The file system only talks to this interface. Implementations are the file backed BlockDevice, the RamBlockDevice
+/// and the layers stacked on top of a backend (IoScheduler, BlockCache). Capabilities that only some backends have
+/// (asynchronous I/O, memory mapping, direct I/O) have default implementations that report them as not supported.
+class BlockStorage {
+public:
+    virtual ~BlockStorage() {}
+
+    /// @brief Attach an existing container. \return 0 on success, -ERRNO on failure (-ENOENT if it does not exist).
+    virtual int open(const char *path) = 0;
+
+    /// @brief Create a new, empty container. \return 0 on success, -ERRNO on failure.
+    virtual int create(const char *path) = 0;
+
+    /// @brief Detach the container. \return 0 on success, -ERRNO on failure.
+    virtual int close() = 0;
+
+    /// @brief Flush all written blocks to stable storage. \return 0 on success, -ERRNO on failure.
+    virtual int sync() = 0;
+
+    /// @brief Read a block into a buffer of at least one block. Blocks never written are read as zeros.
+    /// \return 0 on success, -ERRNO on failure.
+    virtual int read(uint32_t blockNo, char *buffer) = 0;
+
+    /// @brief Write a block from a buffer of at least one block. \return 0 on success, -ERRNO on failure.
+    virtual int write(uint32_t blockNo, char *buffer) = 0;
+
+    /// @brief Read several blocks. \return 0 on success, -ERRNO on failure.
+    virtual int readBlocks(const BlockRequest *requests, size_t count) = 0;
+
+    /// @brief Write several blocks. \return 0 on success, -ERRNO on failure.
+    virtual int writeBlocks(const BlockRequest *requests, size_t count) = 0;
+
+    /// @brief Change the block size, used after the superblock has been read with the minimal block size.
+    virtual void setBlockSize(uint32_t blockSize) = 0;
+    virtual uint32_t getBlockSize() = 0;
+
+    /// @brief Pool of buffers suitable for transfers of this backend.
+    virtual BufferPool *getBufferPool() = 0;
+
+    /// @brief Submit requests to an asynchronous queue of the given depth. \return 0 on success, -ERRNO on failure.
+    virtual int enableAsync(unsigned queueDepth) { return -ENOTSUP; }
+
+    /// @brief Map the first numBlocks blocks into memory for getBlock(). \return 0 on success, -ERRNO on failure.
+    virtual int enableMmap(uint32_t numBlocks) { return -ENOTSUP; }
+
+    /// @brief Bypass the page cache of the host. \return 0 on success, -ERRNO on failure.
+    virtual int enableDirect() { return -ENOTSUP; }
+
+    /// @brief Check whether getBlock() hands out blocks.
+    virtual bool isMapped() { return false; }
+
+    /// @brief Zero-copy access to a block, nullptr if not available.
+    virtual const char *getBlock(uint32_t blockNo) { return nullptr; }
+
+    /// @brief Give the space of unused blocks back to the host. Afterwards the blocks read as zeros.
+    /// \return 0 on success, -ERRNO on failure (-ENOTSUP if the blocks keep their content).
+    virtual int discard(uint32_t firstBlock, uint32_t count) { return -ENOTSUP; }
+
+    /// @brief Reserve space for blocks that are about to be written. \return 0 on success, -ERRNO on failure.
+    virtual int preallocate(uint32_t firstBlock, uint32_t count) { return -ENOTSUP; }
+
+    /// @brief Tell the backend that the given blocks will be read sequentially.
+    virtual void adviseSequential(uint32_t firstBlock, uint32_t count) {}
+
+    /// @brief Tell the backend that the given blocks will be needed soon.
+    virtual void adviseWillNeed(uint32_t firstBlock, uint32_t count) {}
+
+    /// @brief Counters and latency histograms of the block I/O of the backend, nullptr if it keeps none.
+    virtual IoStats *getStats() { return nullptr; }
+};
+
+#endif //MYFS_BLOCKSTORAGE_H
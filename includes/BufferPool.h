@@ -0,0 +1,59 @@
+//
+// Created by user on 17.10.26.
+//
+
+#ifndef MYFS_BUFFERPOOL_H
+#define MYFS_BUFFERPOOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#define BUFFER_POOL_MAX_FREE 64
+
+/// @brief Pool of block buffers aligned to the block size.
+///
+/// Direct I/O needs buffers whose address is aligned to the block size of the device. All block buffers of the file
+/// system are taken from this pool, single block buffers are recycled instead of being freed.
+class BufferPool {
+private:
+    std::mutex lock;
+    uint32_t blockSize;
+    std::vector<char *> freeBuffers;
+
+    char *allocate(size_t blocks);
+
+public:
+    BufferPool(uint32_t blockSize);
+    ~BufferPool();
+
+    /// @brief Change the block size. Must not be called while buffers are in use.
+    void setBlockSize(uint32_t blockSize);
+    uint32_t getBlockSize();
+
+    /// @brief Get an aligned buffer of the given number of blocks.
+    /// \return The buffer, nullptr if no memory is left.
+    char *get(size_t blocks = 1);
+
+    /// @brief Give back a buffer taken with get().
+    void put(char *buffer, size_t blocks = 1);
+};
+
+/// @brief Buffer taken from a BufferPool, given back when it goes out of scope. The content is zeroed.
+class BlockBuffer {
+private:
+    BufferPool *pool;
+    size_t blocks;
+    char *buffer;
+
+public:
+    BlockBuffer(BufferPool *pool, size_t blocks = 1);
+    ~BlockBuffer();
+    BlockBuffer(const BlockBuffer &) = delete;
+    BlockBuffer &operator=(const BlockBuffer &) = delete;
+
+    char *data() { return buffer; }
+};
+
+#endif //MYFS_BUFFERPOOL_H
@@ -0,0 +1,45 @@
+//
+// Created by user on 17.10.26.
+//
+
+#ifndef MYFS_CMAP_H
+#define MYFS_CMAP_H
+
+#include <cstdint>
+#include <vector>
+#include "myfs-structs.h"
+#include "BlockStorage.h"
+#include "SuperBlock.h"
+
+/// @brief Compression map of the data blocks.
+///
+/// For the first block of every compression unit of a file, the map holds the number of blocks the compressed unit
+/// occupies, counted along the FAT chain. 0 means the unit is stored uncompressed, like all other data blocks. The
+/// entries are one byte each and stored like the DMAP, so a zeroed map (a hole in a new container) is valid.
+class CMAP {
+private:
+    BlockStorage *myDevice;
+    SuperBlock *superBlock;
+    std::vector<uint8_t> cmapArray;
+    size_t compressedUnits;
+
+public:
+    CMAP(BlockStorage *device, SuperBlock *superBlock);
+    ~CMAP();
+
+    /// @brief Number of blocks holding the compressed unit that starts at the data block, 0 if uncompressed.
+    uint8_t get(int blockNr);
+    void set(int blockNr, uint8_t storedBlocks);
+
+    /// @brief Mark freed data blocks as uncompressed.
+    void clear(const std::vector<int> &blocks);
+
+    /// @brief Number of compressed units in the file system.
+    size_t getCompressedUnits();
+
+    void discWrite(int blockNr);
+    void init();
+    void firstInit();
+};
+
+#endif //MYFS_CMAP_H
@@ -0,0 +1,98 @@
+//
+// Created by user on 17.10.26.
+//
+
+#ifndef MYFS_COMPRESSOR_H
+#define MYFS_COMPRESSOR_H
+
+#include <cstdint>
+#include <vector>
+#include "BlockStorage.h"
+#include "CMAP.h"
+#include "SuperBlock.h"
+
+/// Header in front of the LZ4 data of a compressed unit.
+struct compressedUnitHeader {
+    uint32_t compressedSize;
+    uint32_t rawSize;
+};
+
+/// @brief Transparent compression of file data in units of several blocks.
+///
+/// A file is cut into units of SuperBlock::getUnitBlocks() blocks. The FAT chain of a file keeps one block per
+/// logical block, but a compressed unit only uses the first blocks of its part of the chain; the others are discarded,
+/// so they are holes in the container and never read or cached. Units that do not save at least one block are stored
+/// uncompressed. The number of blocks of every compressed unit is kept in the CMAP.
+///
+/// The last decompressed unit is kept, so small sequential reads decompress every unit only once.
+class Compressor {
+private:
+    BlockStorage *device;
+    SuperBlock *superBlock;
+    CMAP *cmap;
+    bool enabled;
+    std::vector<char> stored;
+
+    // last decompressed unit
+    uint32_t cachedBlock;
+    std::vector<char> cachedData;
+
+    // statistics
+    uint64_t compressedUnits;
+    uint64_t rawUnits;
+    uint64_t writtenBlocks;
+    uint64_t storedBlocks;
+    uint64_t decompressions;
+
+    void discardRuns(const BlockRequest *blocks, size_t count);
+
+public:
+    Compressor(BlockStorage *device, SuperBlock *superBlock, CMAP *cmap);
+    ~Compressor();
+
+    /// @brief Compress units when they are written. Compressed units are read either way.
+    /// \return 0 on success, -ENOTSUP if the container has no compression map.
+    int setEnabled(bool enabled);
+    bool isEnabled();
+
+    uint32_t getUnitBlocks();
+
+    /// @brief Whether the unit starting at the device block is compressed.
+    bool isCompressed(uint32_t blockNo);
+
+    /// @brief Whether any unit in the file system is compressed.
+    bool hasCompressedUnits();
+
+    /// @brief Read the content of a unit.
+    ///
+    /// \param [in,out] blocks Device blocks of the unit along the FAT chain, their buffers are set by this method.
+    /// \param [in] numBlocks Number of blocks of the unit, less than a full unit at the end of a file.
+    /// \param [in] validBlocks Number of uncompressed blocks holding file data, the others read as zeros.
+    /// \param [out] data numBlocks blocks of content.
+    /// \return 0 on success, -EIO if the compressed unit is damaged, -ERRNO on other failures.
+    int readUnit(BlockRequest *blocks, size_t numBlocks, size_t validBlocks, char *data);
+
+    /// @brief Write the content of a unit, compressed if enabled and if it saves at least one block.
+    ///
+    /// \param [in,out] blocks See readUnit().
+    /// \param [in] validBlocks Number of blocks that held uncompressed data before, unused blocks among them are
+    /// discarded.
+    /// \return 0 on success, -ERRNO on failure.
+    int writeUnit(BlockRequest *blocks, size_t numBlocks, size_t validBlocks, const char *data);
+
+    /// @brief Forget the units of freed data blocks.
+    void release(const std::vector<int> &blocks);
+
+    uint64_t getCompressedUnits();
+    uint64_t getRawUnits();
+
+    /// @brief Blocks of file data written in units.
+    uint64_t getWrittenBlocks();
+
+    /// @brief Blocks written to the device for them.
+    uint64_t getStoredBlocks();
+    uint64_t getDecompressions();
+    void resetStats();
+};
+
+#endif //MYFS_COMPRESSOR_H
@@ -0,0 +1,150 @@
+//
+// Created by user on 17.10.26.
+//
+
+#ifndef MYFS_DDT_H
+#define MYFS_DDT_H
+
+#include <cstdint>
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include "myfs-structs.h"
+#include "BlockStorage.h"
+#include "DMAP.h"
+#include "SuperBlock.h"
+
+/// Entry of the dedup table for one data block.
+struct dedupEntry {
+    uint64_t hash;          // content hash of the block, 0 if it is not in the index
+    uint32_t ref;           // block holding the content of this block, 0 if it holds its own content
+    uint32_t refs : 30;     // number of blocks sharing the content of this block
+    uint32_t zero : 1;      // all zeros, stored as a hole in the container
+    uint32_t orphan : 1;    // freed from its file, but kept for the blocks sharing its content
+};
+
+static_assert(sizeof(dedupEntry) == DDT_ENTRY_SIZE, "dedup table entries must match the container layout");
+
+/// @brief Dedup table of the data blocks.
+///
+/// Every FAT chain keeps one block per file block, but a block whose content is already stored in another block only
+/// refers to that block and stays a hole in the container. The referenced block counts the blocks sharing its content.
+/// When it is freed while still shared, it is kept as an orphan until the last reference is gone; when it is
+/// overwritten, its content is first copied to one of the sharing blocks, which takes over the other references.
+///
+/// Blocks written while deduplication is enabled are hashed, an index from hash to block finds blocks with the same
+/// content. Candidates are always compared byte by byte, so a hash collision only costs a read. The table is stored
+/// like the DMAP, so a zeroed table (a hole in a new container) is valid; the index is rebuilt from it when mounting.
+///
+/// Blocks of zeros are never stored, whether deduplication is enabled or not: they are marked as zero and discarded,
+/// so the container reads them as zeros, and readers may fill them in without reading the device at all. The FAT
+/// chain still holds them, so they stay allocated in the DMAP.
+///
+/// In memory, every shared block also knows the blocks sharing its content, so handing it over touches only those.
+class DDT {
+private:
+    BlockStorage *myDevice;
+    SuperBlock *superBlock;
+    DMAP *dmap;
+    std::vector<dedupEntry> ddtArray;
+    std::unordered_map<uint64_t, int> index;
+    std::unordered_map<int, std::set<int>> sharers;    // blocks sharing the content of a block, by that block
+    bool enabled;
+    bool deferred;
+    std::set<int> dirtyBlocks;  // table blocks changed since the last flush(), counted from the start of the table
+    size_t sharedBlocks;
+    size_t zeroBlocks;
+
+    // statistics
+    uint64_t writtenBlocks;
+    uint64_t dedupedBlocks;
+    uint64_t copiedBlocks;
+    uint64_t holeBlocks;
+
+    bool sameContent(int blockNr, const char *data, const std::unordered_map<int, const char *> &pending);
+    void serialize(int ddtBlock, char *buffer);
+    void unindex(int blockNr);
+    void dropRef(int blockNr);
+    int handOver(int blockNr);
+    void clearZero(int blockNr);
+    int discardRuns(std::vector<int> blocks);
+
+public:
+    DDT(BlockStorage *device, SuperBlock *superBlock, DMAP *dmap);
+    ~DDT();
+
+    /// @brief 64 bit hash of a block, never 0.
+    static uint64_t hash(const char *data, size_t size);
+
+    /// @brief Whether a block holds only zeros, checked with AVX2 or SSE2 where the CPU has it.
+    static bool isZeroBlock(const char *data, size_t size);
+
+    /// @brief Whether the container has a dedup table, without it neither shared nor zero blocks are recorded.
+    bool hasTable();
+
+    /// @brief Look for blocks with the same content when blocks are written. Shared blocks are honoured either way.
+    /// \return 0 on success, -ENOTSUP if the container has no dedup table.
+    int setEnabled(bool enabled);
+    bool isEnabled();
+
+    /// @brief Data block holding the content of the data block.
+    int getStorage(int blockNr);
+
+    /// @brief Whether any block in the file system shares the content of another one.
+    bool hasSharedBlocks();
+
+    /// @brief Whether the data block holds only zeros and is a hole in the container.
+    bool isZero(int blockNr);
+    bool hasZeroBlocks();
+
+    /// @brief Write blocks of file data, sharing the content of other blocks where possible. Blocks of zeros become
+    /// holes.
+    ///
+    /// \param [in] requests Device blocks of the FAT chains to write and their content.
+    /// \return 0 on success, -ERRNO on failure.
+    int writeBlocks(const BlockRequest *requests, size_t count);
+
+    /// @brief Let a data block hold its own content again, before it is written without writeBlocks(). Its content is
+    /// lost, blocks sharing it keep theirs, and it is no longer taken for zeros.
+    /// \return 0 on success, -ERRNO on failure.
+    int unshare(int blockNr);
+
+    /// @brief Drop the references of data blocks freed from their files.
+    /// \return The blocks that can be freed in the DMAP; blocks still shared are kept as orphans.
+    std::vector<int> release(const std::vector<int> &blocks);
+
+    /// @brief Turn new data blocks of a file into holes of zeros, e.g. when a file is extended by truncate.
+    /// \return 0 on success, -ERRNO if the container could not discard them; they are not marked then.
+    int makeHoles(const std::vector<int> &blocks);
+
+    size_t getSharedBlocks();
+    size_t getZeroBlocks();
+
+    /// @brief Blocks of file data passed to writeBlocks().
+    uint64_t getWrittenBlocks();
+
+    /// @brief Blocks among them that were not written, because their content was stored already.
+    uint64_t getDedupedBlocks();
+
+    /// @brief Blocks copied to keep shared content that was overwritten.
+    uint64_t getCopiedBlocks();
+
+    /// @brief Written blocks that held only zeros and were stored as holes.
+    uint64_t getHoleBlocks();
+    void resetStats();
+
+    void discWrite(int blockNr);
+
+    /// @brief Keep changed table blocks in memory until flush(), instead of writing the block of every changed entry
+    /// at once. Turning it off writes them.
+    void setDeferred(bool deferred);
+
+    /// @brief Write every changed table block once, with one vectored request.
+    /// \return 0 on success, -ERRNO on failure.
+    int flush();
+    size_t getDirtyBlocks();
+    void init();
+    void firstInit();
+};
+
+#endif //MYFS_DDT_H
@@ -4,28 +4,44 @@
 
 #ifndef MYFS_DMAP_H
 #define MYFS_DMAP_H
+#include <set>
+#include <vector>
 #include "myfs-structs.h"
-#include "blockdevice.h"
+#include "BlockStorage.h"
+#include "SuperBlock.h"
 
 
 
 
 class DMAP{
 private:
-    BlockDevice *myDevice;
-    bool dmapArray[NUMBER_DATA_BLOCKS];
+    BlockStorage *myDevice;
+    SuperBlock *superBlock;
+    std::vector<uint8_t> dmapArray;    // one byte per data block, as on disk
+    int searchStart;                    // no block before this one is free
+    bool preallocate;
+    bool deferred;
+    std::set<int> dirtyBlocks;  // DMAP blocks changed since the last flush(), counted from the start of the DMAP
+    uint64_t writtenBlocks;
+    void manageRuns(std::vector<int> blocks, bool doDiscard);
 
 public:
-    DMAP(BlockDevice *device);
+    DMAP(BlockStorage *device, SuperBlock *superBlock);
     ~DMAP();
     bool getBlock(int);
     void setBlock(int, bool);
     //bool[] getFreeBlocksArray(int);
     int getNextFreeBlockFrom(int);
     int getFirstFreeBlock();
-    int* getCertainNumberOfFreeBlocks(int);
+    int* getCertainNumberOfFreeBlocks(int, bool reserve = true);
+    void freeBlocks(const std::vector<int> &blocks);
+    void setPreallocate(bool preallocate);
     int getNumberFreeBlocks();
     void discWrite(int);
+    void setDeferred(bool deferred);
+    int flush();
+    size_t getDirtyBlocks();
+    uint64_t getWrittenBlocks();
     void init();
     void firstInit();
 };
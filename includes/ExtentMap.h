@@ -0,0 +1,96 @@
+//
+// Created by user on 17.10.26.
+//
+
+#ifndef MYFS_EXTENTMAP_H
+#define MYFS_EXTENTMAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "myfs-structs.h"
+#include "FAT.h"
+
+#define EXTENT_MAGIC 0x31545845u    // "EXT1", marks an extent table behind a root directory entry
+
+/// @brief Run of contiguous data blocks of a file.
+struct extent {
+    uint32_t fileBlock;     // first file block of the run
+    uint32_t block;         // data block holding it
+    uint32_t length;        // number of blocks
+};
+
+/// @brief Maps the blocks of a file to data blocks as a sorted array of extents.
+///
+/// The map describes the same blocks as the FAT chain of the file, which stays the allocation record, but it finds
+/// the data block of any file block by binary search instead of walking the chain from the first block. Neighbouring
+/// blocks of the chain that are neighbours in the container as well form one extent, so a file allocated in one piece
+/// has a single extent and its requests are runs of contiguous blocks.
+///
+/// The root directory stores the table behind the entry of the file if it fits into the entry block. Files without a
+/// stored table, e.g. from older containers, are mapped by walking the FAT chain once with build().
+///
+/// While the file is open, the map also holds the data block of every file block in a flat array, so a lookup is a
+/// single index operation. The array is shared by all handles of the file and follows appends and truncates through
+/// any of them; it is freed when the last handle is closed.
+class ExtentMap {
+private:
+    std::vector<extent> extents;
+    int blocks;     // number of file blocks mapped
+    bool loaded;    // false until the map is built or read from the directory entry
+    int users;      // open handles of the file
+    std::vector<int> blockArray;    // data block of every file block while the file is open
+
+    void materialize();
+
+public:
+    ExtentMap();
+    ~ExtentMap();
+
+    /// @brief Whether the map describes the file, otherwise build() has to walk its FAT chain first.
+    bool isLoaded() const;
+
+    /// @brief Map the FAT chain starting at firstBlock.
+    void build(FAT *fat, int firstBlock);
+
+    /// @brief Number of file blocks mapped.
+    int getBlocks() const;
+
+    /// @brief Number of extents.
+    size_t getExtents() const;
+
+    /// @brief Data block holding a file block, FAT_END behind the end of the file.
+    /// \param run Set to a number of blocks that follow contiguously from there, at most to the end of the extent, if
+    /// not null. Lookups in the block array of an open file always set 1.
+    int getBlock(int fileBlock, int *run = nullptr) const;
+
+    /// @brief Data block holding the last file block, FAT_END for an empty file.
+    int getLastBlock() const;
+
+    /// @brief Add blocks to the end of the file.
+    void append(const int *newBlocks, int count);
+
+    /// @brief Cut the file to the given number of blocks.
+    void truncate(int fileBlocks);
+
+    /// @brief Count an open handle of the file, the first one fills the block array. The map must be loaded.
+    void open();
+
+    /// @brief Count a closed handle of the file, the last one frees the block array.
+    void close();
+
+    /// @brief Whether lookups use the block array.
+    bool isMaterialized() const;
+
+    /// @brief Write the table to a directory entry block.
+    /// \return Bytes written, 0 if the table does not fit into capacity or the map is not loaded; the header then marks
+    /// the table as missing.
+    size_t serialize(char *buffer, size_t capacity) const;
+
+    /// @brief Read the table written by serialize(). A table that does not match the first block and the number of
+    /// blocks of the file, or points outside the data region, is ignored.
+    /// \return true if the map is loaded.
+    bool deserialize(const char *buffer, size_t capacity, int firstBlock, int fileBlocks, uint32_t numDataBlocks);
+};
+
+#endif //MYFS_EXTENTMAP_H
@@ -7,20 +7,48 @@
 
 
 #include <myfs-structs.h>
+#include <set>
+#include <vector>
+#include "BlockStorage.h"
+#include "SuperBlock.h"
 
+/// @brief File allocation table, one entry per data block with the next block of its file.
+///
+/// The entries are 16 or 32 bits wide on disk, as the superblock says; in memory, the table holds one int for every
+/// data block of the container.
 class FAT {
 private:
-    BlockDevice *myDevice;
-    int fatArray[NUMBER_BLOCKS];
+    BlockStorage *myDevice;
+    SuperBlock *superBlock;
+    std::vector<int> fatArray;
+    bool deferred;
+    std::set<int> dirtyBlocks;  // FAT blocks changed since the last flush(), counted from the start of the FAT
+    uint64_t writtenBlocks;
+
+    void serialize(int fatBlock, char *buffer);
+    int entriesPerBlock();
 
 public:
-    FAT(BlockDevice *device);
+    FAT(BlockStorage *device, SuperBlock *superBlock);
     ~FAT();
 
     int setNext(int blockNr, int nextBlockNr);
     int getNext(int blockNr);
     void freeBlock(int blockNr);
     void init();
+    void firstInit();
     void discWrite(int blockNr);
+
+    /// @brief Keep changed FAT blocks in memory until flush(), instead of writing the block of every changed entry at
+    /// once. Turning it off writes them.
+    void setDeferred(bool deferred);
+
+    /// @brief Write every changed FAT block once, with one vectored request.
+    /// \return 0 on success, -ERRNO on failure.
+    int flush();
+    size_t getDirtyBlocks();
+
+    /// @brief FAT blocks written to the device, for the write amplification of metadata.
+    uint64_t getWrittenBlocks();
 };
 #endif //MYFS_FAT_H
\ No newline at end of file
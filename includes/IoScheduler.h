@@ -0,0 +1,128 @@
+//
+// Created by user on 17.10.26.
+//
+
+#ifndef MYFS_IOSCHEDULER_H
+#define MYFS_IOSCHEDULER_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include "BlockStorage.h"
+
+#define IO_SCHEDULER_DIRECT_BLOCKS 32    // larger writes are dispatched at once instead of being copied into the queue
+
+/// @brief Elevator style request queue in front of a block storage backend.
+///
+/// Inside a batch (begin() ... end()), written blocks are only queued. A second write to a queued block replaces the
+/// queued copy, so a block that is written several times during one file system operation reaches the device once.
+/// When the batch ends, or when too many blocks are queued, all pending writes are dispatched in ascending block order,
+/// runs of adjacent blocks are merged into single vectored writes by the device. Reads are served from the queue if the
+/// block is pending. Outside of a batch, and for large writes, blocks go to the device immediately (sorted and
+/// deduplicated as well).
+class IoScheduler : public BlockStorage {
+private:
+    BlockStorage *device;
+    std::recursive_mutex lock;
+
+    std::map<uint32_t, char *> pending;     // queued writes, sorted by block number
+    size_t maxPending;
+    int batchDepth;
+    int dispatchError;
+
+    // statistics
+    uint64_t queuedWrites;
+    uint64_t absorbedWrites;
+    uint64_t deviceWrites;
+    uint64_t dispatches;
+
+    int queue(uint32_t blockNo, const char *buffer);
+    int dispatchLocked();
+
+public:
+    IoScheduler(BlockStorage *device, size_t maxPending);
+    virtual ~IoScheduler();
+
+    /// @brief Start a batch. Batches nest, the outermost end() dispatches the queued writes.
+    void begin();
+
+    /// @brief End a batch.
+    /// \return 0 on success, -ERRNO if dispatching the queued writes failed.
+    int end();
+
+    /// @brief Write all queued blocks to the device.
+    ///
+    /// \return 0 on success, -ERRNO of the first failed dispatch since the last call (also of dispatches triggered by
+    /// end() or a full queue).
+    int dispatch();
+
+    /// @brief Attach a container to the backend.
+    virtual int open(const char *path);
+    virtual int create(const char *path);
+
+    /// @brief Dispatch all queued blocks and detach the container of the backend.
+    virtual int close();
+
+    /// @brief Dispatch all queued blocks and flush the backend to stable storage.
+    virtual int sync();
+
+    /// @brief Read a block, from the queue if a write to it is pending.
+    virtual int read(uint32_t blockNo, char *buffer);
+
+    /// @brief Queue a block write.
+    virtual int write(uint32_t blockNo, char *buffer);
+
+    /// @brief Read several blocks, pending blocks are copied out of the queue.
+    virtual int readBlocks(const BlockRequest *requests, size_t count);
+
+    /// @brief Queue several block writes.
+    virtual int writeBlocks(const BlockRequest *requests, size_t count);
+
+    /// @brief Drop queued writes of the blocks and discard them on the backend.
+    virtual int discard(uint32_t firstBlock, uint32_t count);
+
+    /// @brief Preallocate the blocks on the backend.
+    virtual int preallocate(uint32_t firstBlock, uint32_t count);
+
+    /// @brief Change the block size of the backend. The queue is dispatched first.
+    virtual void setBlockSize(uint32_t blockSize);
+    virtual uint32_t getBlockSize();
+
+    virtual BufferPool *getBufferPool();
+
+    uint64_t getQueuedWrites();
+    uint64_t getAbsorbedWrites();
+    uint64_t getDeviceWrites();
+    uint64_t getDispatches();
+};
+
+/// @brief Runs the enclosing scope as one batch of an IoScheduler.
+///
+/// A file system operation ends the batch with end() before it returns, to report a failed dispatch. The destructor
+/// only ends it for scopes left early.
+class IoBatch {
+private:
+    IoScheduler *scheduler;
+    bool ended;
+
+public:
+    IoBatch(IoScheduler *scheduler) : scheduler(scheduler), ended(false) { scheduler->begin(); }
+    ~IoBatch() {
+        if (!ended)
+            scheduler->end();
+    }
+
+    /// @brief End the batch now instead of when the scope is left.
+    /// \param [in] ret Result of the operation run in the batch.
+    /// \return ret, or -ERRNO of dispatching the queued writes if that failed and ret is no error.
+    int end(int ret) {
+        ended = true;
+        int err = scheduler->end();
+        return ret < 0 || err >= 0 ? ret : err;
+    }
+
+    IoBatch(const IoBatch &) = delete;
+    IoBatch &operator=(const IoBatch &) = delete;
+};
+
+#endif //MYFS_IOSCHEDULER_H
@@ -0,0 +1,94 @@
+//
+// Created by user on 17.10.26.
+//
+
+#ifndef MYFS_IOSTATS_H
+#define MYFS_IOSTATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include "BlockStorage.h"
+
+#define IO_STATS_BUCKETS 40             // bucket i counts latencies below 2^(i+1) ns, about 18 min for the last one
+#define IO_STATS_SEQUENTIAL_DISTANCE 8  // runs starting at most this many blocks away from the last one are sequential
+
+/// @brief Operations counted by IoStats.
+enum IoStatsOp {
+    STATS_READ = 0,
+    STATS_WRITE = 1,
+    STATS_SYNC = 2,
+    STATS_OPS = 3
+};
+
+/// @brief Snapshot of the counters of one operation.
+struct IoOpStats {
+    uint64_t calls;
+    uint64_t blocks;
+    uint64_t bytes;
+    uint64_t sequentialRuns;    // runs of contiguous blocks close to the run before
+    uint64_t randomRuns;
+    uint64_t seekDistance;      // sum of the distances in blocks between a run and the run before
+    uint64_t totalNs;
+    uint64_t histogram[IO_STATS_BUCKETS];
+
+    /// @brief Upper bound of the latency of the given fraction of all calls (e.g. 0.99), from the histogram.
+    uint64_t percentileNs(double fraction) const;
+};
+
+/// @brief Counters and latency histograms of the block I/O calls of a device.
+///
+/// Every call is counted with its blocks and bytes, its runs of contiguous blocks are classified as sequential or
+/// random by their distance to the run before, and its duration is added to a histogram with one bucket per power of
+/// two nanoseconds. All counters are relaxed atomics, so recording never takes a lock and the device can be used by
+/// several threads; a snapshot taken while calls are running may be off by those calls.
+class IoStats {
+private:
+    struct Counters {
+        std::atomic<uint64_t> calls;
+        std::atomic<uint64_t> blocks;
+        std::atomic<uint64_t> bytes;
+        std::atomic<uint64_t> sequentialRuns;
+        std::atomic<uint64_t> randomRuns;
+        std::atomic<uint64_t> seekDistance;
+        std::atomic<uint64_t> totalNs;
+        std::atomic<uint64_t> histogram[IO_STATS_BUCKETS];
+    };
+    Counters counters[STATS_OPS];
+    // block behind the last run of any call, where a sequential run would start
+    std::atomic<uint64_t> nextBlock;
+
+    void count(IoStatsOp op, uint64_t durationNs);
+
+public:
+    IoStats();
+    ~IoStats();
+
+    /// @brief Current time of the monotonic clock in nanoseconds, used as the start time of a call.
+    static uint64_t now();
+
+    /// @brief Histogram bucket of a duration.
+    static int bucket(uint64_t durationNs);
+
+    /// @brief Record a read or write call.
+    ///
+    /// \param op STATS_READ or STATS_WRITE.
+    /// \param requests Blocks of the call.
+    /// \param count Number of requests.
+    /// \param blockSize Block size of the device during the call.
+    /// \param startNs Value of now() before the call was issued.
+    void record(IoStatsOp op, const BlockRequest *requests, size_t count, uint32_t blockSize, uint64_t startNs);
+
+    /// @brief Record a call without blocks (STATS_SYNC).
+    void record(IoStatsOp op, uint64_t startNs);
+
+    IoOpStats get(IoStatsOp op);
+    void reset();
+
+    /// @brief Write a summary line and the non-empty histogram buckets of every operation that was called.
+    /// \param file Open file, e.g. the log file.
+    /// \param name Name of the device in the output.
+    void dump(FILE *file, const char *name);
+};
+
+#endif //MYFS_IOSTATS_H
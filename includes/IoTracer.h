@@ -0,0 +1,103 @@
+//
+// Created by user on 17.10.26.
+//
+
+#ifndef MYFS_IOTRACER_H
+#define MYFS_IOTRACER_H
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "BlockStorage.h"
+
+#define IO_TRACE_MAGIC "MYFSTRC"
+#define IO_TRACE_VERSION 1
+#define IO_TRACE_BUFFER_RECORDS 4096
+
+/// @brief Operations of a trace record.
+enum IoTraceOp : uint8_t {
+    TRACE_READ = 0,
+    TRACE_WRITE = 1,
+    TRACE_SYNC = 2,
+    TRACE_BLOCK_SIZE = 3,       // blockNo holds the new block size
+    TRACE_CONTINUED = 0x80      // flag: the record belongs to the same call as the previous one
+};
+
+/// @brief Header at the start of a trace file.
+struct IoTraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t blockSize;         // block size when tracing started
+};
+
+/// @brief One run of contiguous blocks of a traced call.
+///
+/// A call that transfers several runs is stored as one record per run, all with the start time and duration of the
+/// call. Records are written in the byte order of the host.
+struct IoTraceRecord {
+    uint64_t timestampNs;       // start of the call, relative to the start of tracing
+    uint32_t durationNs;        // duration of the call, saturated at about 4 s
+    uint32_t blockNo;
+    uint32_t blocks;
+    uint8_t op;
+    uint8_t reserved[3];
+};
+
+/// @brief Appends compact binary records of block I/O calls to a trace file.
+///
+/// Records are collected in a buffer and written in large chunks, so tracing only costs a clock read and a copy per
+/// call. May be shared by several threads.
+class IoTracer {
+private:
+    int traceFile;
+    std::mutex lock;
+    std::vector<IoTraceRecord> buffer;
+    uint64_t startNs;
+    uint64_t records;
+    int error;
+
+    int flushBuffer();
+
+public:
+    IoTracer();
+    ~IoTracer();
+
+    /// @brief Create (or truncate) a trace file and start tracing.
+    ///
+    /// \param path Path of the trace file.
+    /// \param blockSize Current block size of the traced device.
+    /// \return 0 on success, -ERRNO on failure.
+    int open(const char *path, uint32_t blockSize);
+
+    /// @brief Write all buffered records and close the trace file.
+    ///
+    /// \return 0 on success, -ERRNO of the first failed write.
+    int close();
+
+    /// @brief Current time of the monotonic clock in nanoseconds, used as the start time of a call.
+    static uint64_t now();
+
+    /// @brief Record a call, one record per run of contiguous blocks.
+    ///
+    /// \param op TRACE_READ or TRACE_WRITE.
+    /// \param requests Blocks of the call.
+    /// \param count Number of requests.
+    /// \param startNs Value of now() before the call was issued.
+    void record(IoTraceOp op, const BlockRequest *requests, size_t count, uint64_t startNs);
+
+    /// @brief Record a call without blocks (TRACE_SYNC, or TRACE_BLOCK_SIZE with the new block size as value).
+    void record(IoTraceOp op, uint32_t value, uint64_t startNs);
+
+    /// @brief Number of records written so far.
+    uint64_t getRecords();
+
+    /// @brief Read a whole trace file.
+    ///
+    /// \param [in] path Path of the trace file.
+    /// \param [out] header Header of the trace.
+    /// \param [out] records All records of the trace.
+    /// \return 0 on success, -EINVAL if the file is no trace, -ERRNO on other failures.
+    static int load(const char *path, IoTraceHeader *header, std::vector<IoTraceRecord> *records);
+};
+
+#endif //MYFS_IOTRACER_H
@@ -0,0 +1,71 @@
+//
+// Created by user on 17.10.26.
+//
+
+#ifndef MYFS_IOURING_H
+#define MYFS_IOURING_H
+
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/// @brief Minimal io_uring submission/completion ring.
+///
+/// Talks to the kernel directly via the io_uring_setup/io_uring_enter system calls, so no liburing is needed. Only
+/// the operations needed by BlockDevice (vectored read and write at an offset) are supported. The ring is not
+/// thread-safe.
+class IoUring {
+private:
+    int ringFd;
+    unsigned sqEntries;
+    unsigned cqEntries;
+
+    void *sqRing;
+    size_t sqRingSize;
+    void *cqRing;
+    size_t cqRingSize;
+    void *sqes;
+    size_t sqesSize;
+
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned *sqMask;
+    unsigned *sqArray;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned *cqMask;
+    void *cqes;
+
+    unsigned toSubmit;
+
+public:
+    IoUring();
+    ~IoUring();
+
+    /// @brief Set up the ring.
+    ///
+    /// \param [in] entries Number of submission queue entries.
+    /// \return 0 on success, -ERRNO on failure (e.g. -ENOSYS if the kernel does not support io_uring).
+    int init(unsigned entries);
+
+    /// @brief Tear down the ring. Requests still in flight are not waited for.
+    void close();
+
+    unsigned size() const { return sqEntries; }
+
+    /// @brief Queue a vectored read or write.
+    ///
+    /// The iovec array and the buffers must stay valid until the request is completed.
+    /// \return true if the request was queued, false if the submission queue is full.
+    bool prepare(bool doWrite, int fd, const struct iovec *iov, unsigned iovCount, off_t offset, uint64_t userData);
+
+    /// @brief Hand all queued requests to the kernel and wait for at least waitNr completions.
+    /// \return 0 on success, -ERRNO on failure.
+    int submit(unsigned waitNr);
+
+    /// @brief Fetch one completion, if there is one.
+    /// \return true if a completion was fetched.
+    bool popCompletion(uint64_t *userData, int *res);
+};
+
+#endif //MYFS_IOURING_H
@@ -0,0 +1,40 @@
+//
+// Created by user on 17.10.26.
+//
+
+#ifndef MYFS_LZ4_H
+#define MYFS_LZ4_H
+
+#include <cstddef>
+#include <cstdint>
+
+#define LZ4_HASH_BITS 12
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5     // a block always ends with this many literals
+#define LZ4_MATCH_LIMIT 12      // no match starts within this many bytes before the end of a block
+#define LZ4_MAX_OFFSET 65535
+
+/// @brief Compressor and decompressor for the LZ4 block format.
+///
+/// The compressor is the greedy single pass of the reference implementation: a hash table of the last position of
+/// every 4 byte sequence finds matches, and incompressible stretches are skipped with a growing step. Its output can
+/// be read by any LZ4 block decoder. The decompressor checks every length and offset, so a damaged block never reads
+/// or writes outside of the given buffers.
+class Lz4 {
+public:
+    /// @brief Largest compressed size of srcSize bytes.
+    static size_t compressBound(size_t srcSize);
+
+    /// @brief Compress a block.
+    ///
+    /// \return Size of the compressed data on success, -ENOSPC if it does not fit into dstCapacity bytes.
+    static int compress(const char *src, size_t srcSize, char *dst, size_t dstCapacity);
+
+    /// @brief Decompress a block.
+    ///
+    /// \return Size of the decompressed data on success, -EINVAL if the block is damaged or does not fit into
+    /// dstCapacity bytes.
+    static int decompress(const char *src, size_t srcSize, char *dst, size_t dstCapacity);
+};
+
+#endif //MYFS_LZ4_H
@@ -0,0 +1,79 @@
+//
+// Created by user on 17.10.26.
+//
+
+#ifndef MYFS_MIRROREDDEVICE_H
+#define MYFS_MIRROREDDEVICE_H
+
+#include <cstdint>
+#include <vector>
+#include "MultiDevice.h"
+
+#define MIRROR_SPLIT_BLOCKS 16      // with the queue policy, larger reads are split over all members
+#define MIRROR_NEAR_BLOCKS 256      // with the locality policy, a read this close to a member's position stays there
+
+/// @brief How the reads of a mirror are spread over its members.
+enum MirrorPolicy {
+    MIRROR_READ_QUEUE,      // least blocks in flight; large reads are split, so a single reader uses all members
+    MIRROR_READ_LOCALITY    // nearest position; sequential streams stay on one member, others go to the idlest one
+};
+
+/// @brief Block storage that keeps identical copies on several member devices.
+///
+/// Writes go to all members in parallel and succeed only if every member succeeds. Every read is served by one member
+/// per block, chosen by the read policy, so concurrent or large reads use the bandwidth of all members. If a member
+/// fails a read, its blocks are read from the other members, and the read only fails if none of them can serve it.
+/// Reads, failed reads and written blocks are counted per member.
+class MirroredDevice : public MultiDevice {
+private:
+    struct MemberState {
+        uint64_t pendingBlocks;     // blocks of reads in flight
+        uint32_t headPosition;      // block behind the last read
+        uint64_t lastUse;           // sequence number of the last read
+        uint64_t reads;
+        uint64_t readBlocks;
+        uint64_t failedReads;
+        uint64_t writtenBlocks;
+    };
+
+    MirrorPolicy policy;
+    std::vector<MemberState> state;
+    uint64_t sequence;
+
+    size_t leastLoaded(const std::vector<bool> &taken);
+    size_t nearest(uint32_t blockNo);
+    int transferRead(const BlockRequest *requests, size_t count);
+    int failOver(std::vector<Job> &jobs);
+    int transferWrite(const BlockRequest *requests, size_t count);
+
+public:
+    MirroredDevice(const std::vector<BlockStorage *> &members, MirrorPolicy policy);
+    virtual ~MirroredDevice();
+
+    /// @brief Parse a read policy: queue or locality.
+    /// \return true on success.
+    static bool parsePolicy(const char *spec, MirrorPolicy *policy);
+
+    virtual int read(uint32_t blockNo, char *buffer);
+    virtual int write(uint32_t blockNo, char *buffer);
+    virtual int readBlocks(const BlockRequest *requests, size_t count);
+    virtual int writeBlocks(const BlockRequest *requests, size_t count);
+
+    MirrorPolicy getPolicy();
+
+    /// @brief Number of read requests served by a member.
+    uint64_t getMemberReads(size_t member);
+
+    /// @brief Number of blocks read from a member.
+    uint64_t getMemberReadBlocks(size_t member);
+
+    /// @brief Number of read requests a member failed, they were retried on the other members.
+    uint64_t getMemberFailedReads(size_t member);
+
+    /// @brief Number of blocks written to a member.
+    uint64_t getMemberWrittenBlocks(size_t member);
+
+    void resetStats();
+};
+
+#endif //MYFS_MIRROREDDEVICE_H
@@ -0,0 +1,116 @@
+//
+// Created by user on 17.10.26.
+//
+
+#ifndef MYFS_MULTIDEVICE_H
+#define MYFS_MULTIDEVICE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BlockStorage.h"
+
+#define MEMBER_PATH_SEPARATOR ':'
+
+/// @brief Base of block storage built from several member devices.
+///
+/// Attaches, syncs and configures all members together and gives every member a worker thread, so derived devices
+/// can transfer blocks on all members in parallel. The members are deleted together with the device.
+class MultiDevice : public BlockStorage {
+protected:
+    enum MemberOp {
+        MEMBER_READ,
+        MEMBER_WRITE,
+        MEMBER_SYNC
+    };
+
+    /// @brief Work of one member within a request.
+    struct Job {
+        MemberOp op;
+        std::vector<BlockRequest> requests;
+        int result;
+        bool finished;
+
+        Job() : op(MEMBER_READ), result(0), finished(false) {}
+    };
+
+    struct Member {
+        BlockStorage *device;
+        std::mutex busy;            // the calling thread and the worker must not use the device at the same time
+        std::thread worker;
+        std::condition_variable wakeup;
+        std::deque<Job *> queue;
+    };
+
+    std::vector<Member *> members;
+
+    // protects the queues and the statistics of derived devices
+    std::mutex lock;
+
+    /// @brief Hand the job of every member to its worker and wait for all of them.
+    ///
+    /// \param jobs One job per member. Read and write jobs without requests are skipped.
+    /// \return 0 on success, -ERRNO of the first failed job otherwise.
+    int run(std::vector<Job> &jobs);
+
+    /// @brief Transfer the blocks of one member in the calling thread.
+    int execute(size_t member, MemberOp op, const std::vector<BlockRequest> &requests);
+
+    /// @brief Discard or preallocate blocks of one member in the calling thread.
+    int manageSpace(size_t member, bool doDiscard, uint32_t firstBlock, uint32_t count);
+
+private:
+    std::condition_variable jobsFinished;
+    bool stopWorkers;
+
+    void workerLoop(size_t index);
+    int attach(const char *path, bool doCreate);
+
+public:
+    /// @brief Create the device and start the workers.
+    ///
+    /// \param members Member devices, at least one. They must all use the same block size.
+    MultiDevice(const std::vector<BlockStorage *> &members);
+    virtual ~MultiDevice();
+
+    /// @brief Open the containers of all members.
+    ///
+    /// \param path Paths of the member containers, in member order and separated by MEMBER_PATH_SEPARATOR.
+    /// \return 0 on success, -ENOENT if no member container exists, -EINVAL if the number of paths does not match or
+    /// only some of the containers exist, -ERRNO on other failures.
+    virtual int open(const char *path);
+
+    /// @brief Create the containers of all members, see open().
+    virtual int create(const char *path);
+
+    virtual int close();
+
+    /// @brief Flush all members in parallel.
+    virtual int sync();
+
+    virtual void setBlockSize(uint32_t blockSize);
+    virtual uint32_t getBlockSize();
+    virtual BufferPool *getBufferPool();
+
+    // each member keeps its own queue or bypasses its own page cache, a mapping would have to span all members
+    virtual int enableAsync(unsigned queueDepth);
+    virtual int enableDirect();
+
+    /// @brief Discard the blocks on every member. Devices that spread blocks over the members map the range.
+    virtual int discard(uint32_t firstBlock, uint32_t count);
+
+    /// @brief Preallocate the blocks on every member, see discard().
+    virtual int preallocate(uint32_t firstBlock, uint32_t count);
+
+    size_t getNumMembers();
+    BlockStorage *getMember(size_t member);
+
+    /// @brief Split a list of paths separated by MEMBER_PATH_SEPARATOR.
+    static std::vector<std::string> splitPaths(const char *path);
+};
+
+#endif //MYFS_MULTIDEVICE_H
@@ -0,0 +1,55 @@
+//
+// Created by user on 17.10.26.
+//
+
+#ifndef MYFS_RAMBLOCKDEVICE_H
+#define MYFS_RAMBLOCKDEVICE_H
+
+#include <mutex>
+#include <vector>
+#include "BlockStorage.h"
+
+/// @brief Block storage in one contiguous buffer in memory.
+///
+/// The container lives only as long as the object, open() therefore never finds an existing container. The buffer
+/// grows with the highest block written, blocks behind it are read as zeros. Useful to measure the file system
+/// without any device cost and for fast unit tests.
+class RamBlockDevice : public BlockStorage {
+private:
+    std::mutex lock;
+    uint32_t blockSize;
+    std::vector<char> data;
+    bool attached;
+    BufferPool *bufferPool;
+
+    int grow(size_t end);
+
+public:
+    RamBlockDevice(uint32_t blockSize);
+    virtual ~RamBlockDevice();
+
+    virtual int open(const char *path);
+    virtual int create(const char *path);
+    virtual int close();
+    virtual int sync();
+
+    virtual int read(uint32_t blockNo, char *buffer);
+    virtual int write(uint32_t blockNo, char *buffer);
+    virtual int readBlocks(const BlockRequest *requests, size_t count);
+    virtual int writeBlocks(const BlockRequest *requests, size_t count);
+
+    /// @brief Zero the blocks, the buffer keeps its size.
+    virtual int discard(uint32_t firstBlock, uint32_t count);
+
+    /// @brief Grow the buffer to hold the blocks.
+    virtual int preallocate(uint32_t firstBlock, uint32_t count);
+
+    virtual void setBlockSize(uint32_t blockSize);
+    virtual uint32_t getBlockSize();
+    virtual BufferPool *getBufferPool();
+
+    /// @brief Size of the buffer in bytes.
+    size_t getSize();
+};
+
+#endif //MYFS_RAMBLOCKDEVICE_H
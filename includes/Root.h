@@ -3,7 +3,10 @@
 //
 
 #include <map>
-#include "blockdevice.h"
+#include <set>
+#include "BlockStorage.h"
+#include "SuperBlock.h"
+#include "ExtentMap.h"
 #include "myfs-structs.h"
 
 #ifndef MYFS_ROOT_H
@@ -14,20 +17,46 @@
 
 class Root {
 private:
-    BlockDevice *blockDevice;
+    BlockStorage *blockDevice;
+    SuperBlock *superBlock;
     rootFile* rootFiles[NUM_DIR_ENTRIES];
+    ExtentMap* extentMaps[NUM_DIR_ENTRIES];
+    bool deferred;
+    std::set<int> dirtyEntries; // entries changed since the last flush()
+
+    void serialize(rootFile* file, char* buffer);
+    void initTail(rootFile* file, int fileBlocks);
 
 public:
-    Root(BlockDevice *blockDevice);
+    Root(BlockStorage *blockDevice, SuperBlock *superBlock);
     ~Root();
 
     void initRootDir();
     void init();
+
+    /// @brief Bytes of an entry on disk, entries of containers before version 6 end in front of the tail pointer.
+    size_t entrySize();
+
+    /// @brief Position of the extent table in the block of an entry, the next multiple of 8 behind the entry.
+    size_t extentTableOffset();
+
     bool discWrite(rootFile* file);
 
+    /// @brief Keep changed entries in memory until flush(), instead of writing the entry block at once, so an entry is
+    /// not on disk before the FAT and DMAP changes it refers to. Turning it off writes them.
+    void setDeferred(bool deferred);
+
+    /// @brief Write every changed entry once, with one vectored request.
+    /// \return 0 on success, -ERRNO on failure.
+    int flush();
+    size_t getDirtyEntries();
+
     rootFile* getFileAtIndex(int index);
     rootFile* getRootEntryFile(const char* path);
 
+    /// @brief Extent map of a file, stored behind its entry by discWrite(). Not loaded if the entry has no table.
+    ExtentMap* getExtents(rootFile* file);
+
     rootFile* createNewFile(const char* path);
     int deleteFile(const char* path);
 };
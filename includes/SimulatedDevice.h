@@ -0,0 +1,93 @@
+//
+// Created by user on 17.10.26.
+//
+
+#ifndef MYFS_SIMULATEDDEVICE_H
+#define MYFS_SIMULATEDDEVICE_H
+
+#include <cstdint>
+#include <mutex>
+#include "BlockStorage.h"
+
+/// @brief Cost model of a simulated device.
+struct SimulationParams {
+    uint64_t latencyNs;         // fixed cost of every request (command overhead, network round trip)
+    uint64_t seekNsPerBlock;    // cost of moving the head by one block
+    uint64_t maxSeekNs;         // seek cost limit (full stroke), 0 for no limit
+    uint64_t bytesPerSecond;    // bandwidth cap, 0 for unlimited
+    bool delay;                 // really wait for the simulated time instead of only accounting for it
+};
+
+/// @brief Block storage wrapper that simulates a slow device.
+///
+/// Every run of contiguous blocks in a request costs the latency, a seek proportional to the distance between the
+/// previous position and the first block of the run, and its transfer time at the bandwidth cap. The costs are summed
+/// up in a simulated device clock, so benchmarks can report device time separately from CPU time. Optionally, the
+/// calling thread sleeps for the simulated time. Requests are serialized like on a device with a single head.
+/// The wrapped device is deleted together with the wrapper.
+class SimulatedDevice : public BlockStorage {
+private:
+    BlockStorage *device;
+    SimulationParams params;
+    std::mutex lock;
+    uint32_t headPosition;
+
+    // simulated clock and statistics
+    uint64_t deviceTimeNs;
+    uint64_t requests;
+    uint64_t blocks;
+    uint64_t seekDistance;
+
+    int simulate(bool doWrite, const BlockRequest *requests, size_t count);
+
+public:
+    SimulatedDevice(BlockStorage *device, const SimulationParams &params);
+    virtual ~SimulatedDevice();
+
+    /// @brief Parse a cost model.
+    ///
+    /// Either the name of a preset (hdd, ssd, net) or LATENCY_US:SEEK_NS_PER_BLOCK:MAX_SEEK_US:MB_PER_S.
+    /// \return true on success.
+    static bool parseParams(const char *spec, SimulationParams *params);
+
+    virtual int open(const char *path);
+    virtual int create(const char *path);
+    virtual int close();
+    virtual int sync();
+
+    virtual int read(uint32_t blockNo, char *buffer);
+    virtual int write(uint32_t blockNo, char *buffer);
+    virtual int readBlocks(const BlockRequest *requests, size_t count);
+    virtual int writeBlocks(const BlockRequest *requests, size_t count);
+
+    virtual void setBlockSize(uint32_t blockSize);
+    virtual uint32_t getBlockSize();
+    virtual BufferPool *getBufferPool();
+
+    // asynchronous and direct I/O of the wrapped device do not bypass the model, memory mapping would
+    virtual int enableAsync(unsigned queueDepth);
+    virtual int enableDirect();
+
+    // space management costs no device time
+    virtual int discard(uint32_t firstBlock, uint32_t count);
+    virtual int preallocate(uint32_t firstBlock, uint32_t count);
+
+    // the statistics of the wrapped device show the real time of its calls
+    virtual IoStats *getStats();
+
+    BlockStorage *getDevice();
+
+    /// @brief Simulated time the device has been busy.
+    uint64_t getDeviceTimeNs();
+
+    /// @brief Number of simulated requests (runs of contiguous blocks).
+    uint64_t getRequests();
+    uint64_t getBlocks();
+
+    /// @brief Sum of all seek distances in blocks.
+    uint64_t getSeekDistance();
+
+    void resetStats();
+};
+
+#endif //MYFS_SIMULATEDDEVICE_H
@@ -0,0 +1,65 @@
+//
+// Created by user on 17.10.26.
+//
+
+#ifndef MYFS_STRIPEDDEVICE_H
+#define MYFS_STRIPEDDEVICE_H
+
+#include <cstdint>
+#include <vector>
+#include "MultiDevice.h"
+
+#define STRIPE_DEFAULT_UNIT 65536
+
+/// @brief Block storage striped round-robin over several member devices.
+///
+/// The logical blocks are grouped into stripe units. Unit i lives on member i % n at unit i / n of that member, so a
+/// large sequential request keeps all members busy. A vectored request is split by member and all parts are
+/// transferred in parallel by the member workers. Requests that touch a single member are served by the calling
+/// thread.
+class StripedDevice : public MultiDevice {
+private:
+    uint32_t stripeUnit;
+    uint32_t stripeBlocks;
+
+    // statistics
+    uint64_t parallelRequests;
+    std::vector<uint64_t> memberBlocks;
+
+    int transfer(MemberOp op, const BlockRequest *requests, size_t count);
+    int manageRange(bool doDiscard, uint32_t firstBlock, uint32_t count);
+    BlockRequest map(uint32_t blockNo, char *buffer, size_t *member);
+
+public:
+    /// @brief Create a striped device.
+    ///
+    /// \param members Member devices, at least one. They must all use the same block size.
+    /// \param stripeUnit Size of a stripe unit in bytes. It is rounded down to a multiple of the block size, but is at
+    /// least one block.
+    StripedDevice(const std::vector<BlockStorage *> &members, uint32_t stripeUnit);
+    virtual ~StripedDevice();
+
+    virtual int read(uint32_t blockNo, char *buffer);
+    virtual int write(uint32_t blockNo, char *buffer);
+    virtual int readBlocks(const BlockRequest *requests, size_t count);
+    virtual int writeBlocks(const BlockRequest *requests, size_t count);
+
+    /// @brief Discard the parts of the range on each member.
+    virtual int discard(uint32_t firstBlock, uint32_t count);
+
+    /// @brief Preallocate the parts of the range on each member.
+    virtual int preallocate(uint32_t firstBlock, uint32_t count);
+
+    /// @brief Change the block size of all members. The stripe unit stays the same in bytes.
+    virtual void setBlockSize(uint32_t blockSize);
+
+    uint32_t getStripeUnit();
+
+    /// @brief Number of requests that were spread over more than one member.
+    uint64_t getParallelRequests();
+
+    /// @brief Number of blocks transferred by a member.
+    uint64_t getMemberBlocks(size_t member);
+};
+
+#endif //MYFS_STRIPEDDEVICE_H
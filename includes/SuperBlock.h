@@ -0,0 +1,88 @@
+//
+// Created by user on 17.10.26.
+//
+
+#ifndef MYFS_SUPERBLOCK_H
+#define MYFS_SUPERBLOCK_H
+
+#include <cstdint>
+#include "BlockStorage.h"
+
+#define SUPERBLOCK_MAGIC 0x4d794653     // "MyFS"
+#define SUPERBLOCK_VERSION 6
+#define SUPERBLOCK_VERSION_NO_CMAP 2  // containers without compression map can still be mounted, but not compressed
+#define SUPERBLOCK_VERSION_NO_DDT 3   // containers without dedup table can still be mounted, but not deduplicated
+#define SUPERBLOCK_VERSION_FAT16 4    // containers before version 5 always have 16 bit FAT entries
+#define SUPERBLOCK_VERSION_NO_TAIL 5  // root entries of containers before version 6 have no tail pointer
+
+/// On-disk content of the superblock (block 0 of the container). All offsets and sizes are counted in blocks.
+struct superBlockData {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t blockSize;
+    uint32_t numDataBlocks;
+    uint32_t fatOffset;
+    uint32_t fatSize;
+    uint32_t dmapOffset;
+    uint32_t dmapSize;
+    uint32_t rootOffset;
+    uint32_t rootSize;
+    uint32_t dataOffset;
+    // since version 3
+    uint32_t cmapOffset;
+    uint32_t cmapSize;
+    uint32_t unitBlocks;    // blocks of file data compressed together, 0 if the container has no compression map
+    // since version 4
+    uint32_t ddtOffset;
+    uint32_t ddtSize;
+    // since version 5
+    uint32_t fatEntrySize;  // FAT16_ENTRY_SIZE or FAT32_ENTRY_SIZE bytes per FAT entry
+};
+
+/// @brief Superblock of the file system.
+///
+/// The superblock stores the block size chosen when the container was created and the layout of FAT, DMAP,
+/// compression map, dedup table, root directory and data region derived from it. It always fits into the first BD_BLOCK_SIZE bytes of the container, so
+/// it can be read before the block size is known.
+class SuperBlock {
+private:
+    BlockStorage *blockDevice;
+    superBlockData data;
+
+    int layout(uint32_t version, uint32_t blockSize, uint32_t numDataBlocks, uint32_t fatEntrySize);
+
+public:
+    SuperBlock(BlockStorage *blockDevice);
+    ~SuperBlock();
+
+    /// @brief Compute the layout for a new file system.
+    /// \param fatEntrySize FAT16_ENTRY_SIZE, FAT32_ENTRY_SIZE or 0 for the smallest entries that can address all
+    /// data blocks.
+    /// \return 0 on success, -EINVAL if the block size or the number of data blocks is not supported.
+    int format(uint32_t blockSize, uint32_t numDataBlocks, uint32_t fatEntrySize = 0);
+
+    /// @brief Read and check the superblock of an existing container.
+    /// \return 0 on success, -EINVAL if the container does not hold a valid file system.
+    int init();
+
+    void discWrite();
+
+    uint32_t getVersion() { return data.version; }
+    uint32_t getBlockSize() { return data.blockSize; }
+    uint32_t getNumDataBlocks() { return data.numDataBlocks; }
+    uint32_t getFatOffset() { return data.fatOffset; }
+    uint32_t getFatSize() { return data.fatSize; }
+    uint32_t getFatEntrySize() { return data.fatEntrySize; }
+    uint32_t getDmapOffset() { return data.dmapOffset; }
+    uint32_t getDmapSize() { return data.dmapSize; }
+    uint32_t getCmapOffset() { return data.cmapOffset; }
+    uint32_t getCmapSize() { return data.cmapSize; }
+    uint32_t getUnitBlocks() { return data.unitBlocks; }
+    uint32_t getDdtOffset() { return data.ddtOffset; }
+    uint32_t getDdtSize() { return data.ddtSize; }
+    uint32_t getRootOffset() { return data.rootOffset; }
+    uint32_t getDataOffset() { return data.dataOffset; }
+    uint32_t getContainerBlocks() { return data.dataOffset + data.numDataBlocks; }
+};
+
+#endif //MYFS_SUPERBLOCK_H
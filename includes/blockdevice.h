@@ -13,18 +13,50 @@
 
 #include <stdio.h>
 #include <cstdint>
+#include <vector>
+#include <sys/uio.h>
+#include "BlockStorage.h"
+#include "IoStats.h"
+
+class IoUring;
+class IoTracer;
 
 #define BD_BLOCK_SIZE 512
 
 /// @brief Emulate a block device
 ///
 /// This class emulates access to a generic block device (e.g. a hard disc or USB drive partition) using the
-/// local file system.
-class BlockDevice {
+/// local file system. All block accesses use positional I/O (pread/pwrite), the file offset of the container is
+/// never touched. Thus, one object can safely be shared by several threads.
+class BlockDevice : public BlockStorage {
 private:
     uint32_t blockSize;
     int contFile;
     // uint32_t size;
+
+    // asynchronous backend, nullptr if all I/O is synchronous
+    struct AsyncOp {
+        bool doWrite;
+        std::vector<BlockRequest> requests;
+        std::vector<struct iovec> iov;
+    };
+    IoUring *ring;
+    unsigned inFlight;
+    int asyncError;
+
+    // memory mapping of the whole container, nullptr if not mapped
+    char *mapping;
+    size_t mappingBlocks;
+
+    // direct I/O bypasses the page cache, all transfers must use block aligned buffers
+    bool direct;
+    BufferPool *bufferPool;
+
+    // optional trace of all block I/O calls, nullptr if tracing is off
+    IoTracer *tracer;
+
+    // counters of all block I/O calls
+    IoStats stats;
     
 public:
     /// @brief Create a new block device.
@@ -32,13 +64,22 @@ public:
     /// Create a block device object with a given block size.
     /// \param blockSize Block size.
     BlockDevice(uint32_t blockSize);
+    virtual ~BlockDevice();
+
+    /// @brief Change the block size.
+    ///
+    /// Used after the superblock of a container has been read with the minimal block size. Must not be called while
+    /// asynchronous requests are pending or the container is mapped.
+    /// \param blockSize New block size, a multiple of 512.
+    virtual void setBlockSize(uint32_t blockSize);
+    virtual uint32_t getBlockSize();
 
     /// @brief Open an existing container file.
     ///
     /// This methods opens an existing container file and attaches it to the block device object.
     /// \param path Path of the container file.
     /// \return 0 on success, -ERRNO on failure.
-    int open(const char* path);
+    virtual int open(const char* path);
 
     /// @brief Create a new container file.
     ///
@@ -47,22 +88,28 @@ public:
     ///
     /// \param path Path of the container file.
     /// \return 0 on success, -ERRNO on failure.
-    int create(const char* path);
+    virtual int create(const char* path);
 
     /// @brief Close a container file.
     ///
     /// This method closes a container file.
     /// \return 0 on success, -ERRNO on failure.
-    int close();
+    virtual int close();
+
+    /// @brief Flush the container file to stable storage.
+    ///
+    /// \return 0 on success, -ERRNO on failure.
+    virtual int sync();
 
     /// @brief Read a block.
     ///
     /// This method reads the block with the number blockNo from the container file. The content of the block is
-    /// stored in the buffer. Note that the size of the buffer must be at least one block.
+    /// stored in the buffer. Note that the size of the buffer must be at least one block. Blocks behind the end of
+    /// the container file have never been written and are read as zeros.
     /// \param [in] blockNo Number of the block to read.
     /// \param [out] buffer Buffer for storing the content of the block.
     /// \return 0 on success, -ERRNO on failure.
-    int read(uint32_t blockNo, char *buffer);
+    virtual int read(uint32_t blockNo, char *buffer);
 
     /// @brief Write a block
     ///
@@ -71,7 +118,136 @@ public:
     /// \param [in] blockNo Number of the block to write.
     /// \param [out] buffer Buffer storing the content to write.
     /// \return 0 on success, -ERRNO on failure.
-    int write(uint32_t blockNo, char *buffer);
+    virtual int write(uint32_t blockNo, char *buffer);
+
+    /// @brief Read several blocks.
+    ///
+    /// This method reads all blocks given by the requests into their buffers. Requests for physically contiguous
+    /// blocks that follow each other in the list are merged and read by a single preadv() call.
+    /// \param [in] requests Array of block numbers and buffers (each at least one block in size).
+    /// \param [in] count Number of requests.
+    /// \return 0 on success, -ERRNO on failure.
+    virtual int readBlocks(const BlockRequest *requests, size_t count);
+
+    /// @brief Write several blocks.
+    ///
+    /// This method writes all blocks given by the requests from their buffers. Requests for physically contiguous
+    /// blocks that follow each other in the list are merged and written by a single pwritev() call.
+    /// \param [in] requests Array of block numbers and buffers (each at least one block in size).
+    /// \param [in] count Number of requests.
+    /// \return 0 on success, -ERRNO on failure.
+    virtual int writeBlocks(const BlockRequest *requests, size_t count);
+
+    /// @brief Switch to the asynchronous io_uring backend.
+    ///
+    /// After this call, submitRead() and submitWrite() hand requests to the kernel without waiting for them, and
+    /// readBlocks()/writeBlocks() send all their requests in a single submission. If io_uring is not available, the
+    /// device stays synchronous and keeps working as before.
+    /// \param [in] queueDepth Maximum number of requests in flight.
+    /// \return 0 on success, -ERRNO if io_uring is not available.
+    virtual int enableAsync(unsigned queueDepth);
+
+    /// @brief Check whether the io_uring backend is in use.
+    bool isAsync();
+
+    /// @brief Start reading several blocks.
+    ///
+    /// The requests are submitted asynchronously; the buffers must not be touched until complete() returns. Without
+    /// the io_uring backend, the blocks are read immediately. Contiguous runs are merged like in readBlocks().
+    /// \param [in] requests Array of block numbers and buffers (each at least one block in size).
+    /// \param [in] count Number of requests.
+    /// \return 0 on success, -ERRNO on failure.
+    int submitRead(const BlockRequest *requests, size_t count);
+
+    /// @brief Start writing several blocks.
+    ///
+    /// Same as submitRead() for writing. The buffers must not be modified until complete() returns.
+    /// \return 0 on success, -ERRNO on failure.
+    int submitWrite(const BlockRequest *requests, size_t count);
+
+    /// @brief Wait for all submitted requests.
+    ///
+    /// \return 0 if all requests since the last call succeeded, -ERRNO of the first failed request otherwise.
+    int complete();
+
+    /// @brief Map the whole container file into memory.
+    ///
+    /// The container is grown to the given number of blocks if it is smaller. Afterwards, getBlock() hands out
+    /// pointers into the mapping and read()/write() become plain memory copies without any system call.
+    /// \param [in] numBlocks Size of the container in blocks.
+    /// \return 0 on success, -ERRNO on failure (the device then keeps using read/write system calls).
+    virtual int enableMmap(uint32_t numBlocks);
+
+    /// @brief Check whether the container is memory mapped.
+    virtual bool isMapped();
+
+    /// @brief Zero-copy access to a block.
+    ///
+    /// \param [in] blockNo Number of the block.
+    /// \return Pointer to the content of the block inside the mapping, nullptr if the container is not mapped or the
+    /// block lies outside of the mapping. The pointer is valid until close() is called.
+    virtual const char *getBlock(uint32_t blockNo);
+
+    /// @brief Access the container with O_DIRECT, bypassing the page cache of the host.
+    ///
+    /// Buffers that are not aligned to the block size are bounced through buffers of the pool, so callers should take
+    /// their buffers from getBufferPool(). Direct I/O can not be combined with a memory mapped container.
+    /// \return 0 on success, -ERRNO on failure (the device then keeps using the page cache).
+    virtual int enableDirect();
+
+    /// @brief Check whether the container is accessed with direct I/O.
+    bool isDirect();
+
+    /// @brief Pool of buffers aligned to the block size of this device.
+    virtual BufferPool *getBufferPool();
+
+    /// @brief Record all block I/O calls in a trace.
+    ///
+    /// Every call to read(), write(), readBlocks(), writeBlocks(), submitRead(), submitWrite() and sync() is recorded
+    /// with its start time and duration. Blocks that only pass through internally (e.g. bounce buffers) are not
+    /// recorded twice. The tracer is not owned by the device.
+    /// \param tracer Opened tracer, nullptr to stop tracing.
+    void setTracer(IoTracer *tracer);
+
+    /// @brief Counters and latency histograms of all block I/O calls.
+    ///
+    /// The same calls as in a trace are counted. The duration of submitRead() and submitWrite() only covers the
+    /// submission, complete() is not counted.
+    virtual IoStats *getStats();
+
+    /// @brief Punch a hole for the given blocks into the container file.
+    ///
+    /// The host file system frees the space of the blocks, they read as zeros afterwards. The size of the container file
+    /// does not change.
+    /// \return 0 on success, -ERRNO on failure (-EOPNOTSUPP if the host file system can not punch holes).
+    virtual int discard(uint32_t firstBlock, uint32_t count);
+
+    /// @brief Allocate space for the given blocks in the container file.
+    ///
+    /// The blocks are allocated as one extent if the host file system can, later writes then neither fragment the
+    /// container nor fail for lack of space. The container file grows if the blocks lie behind its end.
+    /// \return 0 on success, -ERRNO on failure.
+    virtual int preallocate(uint32_t firstBlock, uint32_t count);
+
+    /// @brief Tell the kernel that the given blocks will be read sequentially (only in mapped mode).
+    virtual void adviseSequential(uint32_t firstBlock, uint32_t count);
+
+    /// @brief Tell the kernel that the given blocks will be needed soon (only in mapped mode).
+    virtual void adviseWillNeed(uint32_t firstBlock, uint32_t count);
+
+private:
+    void advise(uint32_t firstBlock, uint32_t count, int advice);
+    int syncFile();
+    void account(bool doWrite, const BlockRequest *requests, size_t count, uint64_t startNs);
+    int readBlock(uint32_t blockNo, char *buffer);
+    int writeBlock(uint32_t blockNo, char *buffer);
+    int access(bool doWrite, const BlockRequest *requests, size_t count);
+    int submit(bool doWrite, const BlockRequest *requests, size_t count);
+    int reap(unsigned waitNr);
+    int transfer(bool doWrite, const BlockRequest *requests, size_t count);
+    int transferRun(bool doWrite, const BlockRequest *requests, size_t count);
+    bool needsBounce(const BlockRequest *requests, size_t count);
+    int bounce(bool doWrite, const BlockRequest *requests, size_t count);
 };
 
 #endif /* blockdevice_h */
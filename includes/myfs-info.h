@@ -11,9 +11,27 @@
 #ifndef myfs_info_h
 #define myfs_info_h
 
+#define MAX_CONTAINER_FILES 16
+
 struct MyFsInfo {
     char *logFile;
-    char *contFile;
+    char *contFile;     // with several container files, their paths separated by ':'
+    int numContFiles;   // number of container files, the blocks are striped over more than one
+    int stripeUnit;     // stripe unit in bytes with several container files, 0 for the default
+    char *mirror;       // read policy if several container files are mirrored instead of striped, NULL for striping
+    char *backend;      // block device backend: "sync" (default), "uring", "mmap" or "ram"
+    int cacheBlocks;    // capacity of the block cache, -1 for the default, 0 disables the cache
+    int writeBack;      // keep written blocks dirty in the cache instead of writing them through
+    int flushOnRelease; // in write-back mode, write all dirty blocks when a file is closed
+    int blockSize;      // block size used when a new container is created, 0 for the default
+    int directIo;       // access the container with O_DIRECT
+    char *simulate;     // cost model of a simulated slow device, NULL for none
+    int simulateDelay;  // really wait for the simulated device time
+    char *traceFile;    // file for a trace of all container block I/O, NULL for none
+    int compress;       // compress file data written from now on
+    int dedup;          // share blocks whose content is stored already
+    int commit;         // write metadata changes after this many operations, 0 or 1 for every operation
+    char *size;         // bytes of file data a new container holds, with suffix K, M, G or T, NULL for the default
 };
 
 #endif /* myfs_info_h */
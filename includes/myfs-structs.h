@@ -14,24 +14,32 @@
 #define myfs_structs_h
 
 #define NAME_LENGTH 255
-#define BLOCK_SIZE 512
+#define DEFAULT_BLOCK_SIZE 4096
+#define MIN_BLOCK_SIZE 512
+#define MAX_BLOCK_SIZE 65536
 #define NUM_DIR_ENTRIES 64
 #define NUM_OPEN_FILES 64
+#define IO_QUEUE_DEPTH 64
+#define SEQUENTIAL_READ_BLOCKS 32
+#define DEFAULT_CACHE_BLOCKS 4096
+#define IO_SCHEDULER_MAX_PENDING 1024
+#define WRITEBACK_MAX_AGE_MS 5000
+#define READAHEAD_MIN_BLOCKS 8
+#define READAHEAD_MAX_BLOCKS 512
+#define COMPRESSION_UNIT_SIZE 65536u    // bytes of file data that are compressed together
 
 #define FILE_SMALL_SIZE 1024
 #define FILE_BIG_SIZE 2048
 
-#define NUMBER_BLOCKS 65536
-#define NUMBER_DATA_BLOCKS 55912
+// the layout of the container (FAT, DMAP, root directory and data offsets) depends on the block size and is stored
+// in the superblock, see SuperBlock.h
+#define NUMBER_BLOCKS 65536             // data blocks addressable with 16 bit FAT entries
+#define NUMBER_DATA_BLOCKS 55912        // data blocks of a new container, unless its size is given
+#define MAX_DATA_BLOCKS (1u << 30)      // data blocks addressable with 32 bit FAT entries, block numbers stay an int
+#define FAT16_ENTRY_SIZE 2
+#define FAT32_ENTRY_SIZE 4
+#define DDT_ENTRY_SIZE 16
 #define FAT_END 0
-#define FAT_SIZE 256
-#define DATA_ALL FAT_SIZE + FILE_BIG_SIZE + NUM_DIR_ENTRIES
-#define DATA_OFFSET ROOT_DIR_OFFSET + ROOT_SIZE
-
-#define DMAP_SIZE 128
-#define ROOT_SIZE 240
-#define ROOT_DIR_OFFSET FAT_SIZE+DMAP_SIZE
-#define DMAP_OFFSET_SIZE FAT_SIZE
 
 #include "blockdevice.h"
 #include <sys/stat.h>
@@ -71,10 +79,17 @@ struct rootFile {
     struct stat fileStats = {};
     int indexRootDirBlock;
     bool valid;
+    // since superblock version 6, appends link new blocks behind lastBlock without walking the FAT chain
+    int lastBlock;      // last block of the FAT chain, FAT_END for an empty file
+    int blockCount;     // blocks in the FAT chain, -1 while lastBlock is not known
 };
 
 struct openFile{
     rootFile *file;
+    // sequential read detection and readahead state
+    off_t nextReadOffset = 0;   // offset a sequential reader asks for next
+    int readAheadWindow = 0;    // number of blocks to prefetch, 0 while the access pattern is random
+    int readAheadEnd = 0;       // file blocks before this index have already been prefetched
 };
 
 #endif /* myfs_structs_h */
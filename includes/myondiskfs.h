@@ -11,9 +11,22 @@
 #include "myfs-structs.h"
 #include <ctime>
 #include <cstring>
+#include <vector>
 #include "Root.h"
 #include "FAT.h"
+#include "ExtentMap.h"
 #include "DMAP.h"
+#include "CMAP.h"
+#include "Compressor.h"
+#include "DDT.h"
+#include "BlockStorage.h"
+#include "IoScheduler.h"
+#include "SimulatedDevice.h"
+#include "StripedDevice.h"
+#include "MirroredDevice.h"
+#include "IoTracer.h"
+#include "BlockCache.h"
+#include "SuperBlock.h"
 #include <fuse_common.h>
 
 
@@ -22,14 +35,50 @@
 /// @brief On-disk implementation of a simple file system.
 class MyOnDiskFS : public MyFS {
 protected:
-    BlockDevice *blockDevice;
-    char* buffer;
+    BlockStorage *blockDevice;
+    SimulatedDevice *simulatedDevice;
+    StripedDevice *stripedDevice;
+    MirroredDevice *mirroredDevice;
+    IoTracer *tracer;
+    IoScheduler *scheduler;
+    BlockCache *cache;
+    SuperBlock *superBlock;
+    uint32_t blockSize;
     Root *root;
     FAT * fat;
     DMAP *dmap; //ToDo
-    openFile *openFiles[BLOCK_SIZE];
-    void setFATBlocks(size_t size, off_t offset, rootFile* file);
-    static int numBlocks(int size);
+    CMAP *cmap;
+    Compressor *compressor;
+    DDT *ddt;
+    openFile *openFiles[NUM_OPEN_FILES];
+    int setFATBlocks(size_t size, off_t offset, rootFile* file, bool holes = false);
+    int clearBlocks(const std::vector<int> &blocks);
+    int clearTail(rootFile* file);
+    void readAhead(openFile* openFile, off_t offset, size_t size, int lastFileBlock);
+    int readPartial(uint32_t blockNo, char* buf, int inBlock, size_t len);
+    void readMapped(std::vector<BlockRequest> &requests, char* buf, size_t size, int headOffset);
+    ExtentMap* getExtents(rootFile* file);
+    void collectBlocks(rootFile* file, int firstFileBlock, std::vector<BlockRequest> &requests, bool chain = false);
+    bool compressedRange(rootFile* file, off_t offset, size_t size);
+    int readUnits(rootFile* file, char* buf, size_t size, off_t offset);
+    int writeUnits(rootFile* file, const char* buf, size_t size, off_t offset, off_t oldSize);
+    int readTailUnit(rootFile* file, off_t newSize, std::vector<char> &tail);
+    int writeTailUnit(rootFile* file, std::vector<char> &tail);
+    int numBlocks(off_t size);
+    int formatContainer(uint32_t blockSize);
+    int openContainer();
+    void createStorage(const char* backend);
+    void enableBackend(const char* backend);
+    void enableWriteBack(bool flushOnRelease);
+    void enableCompression();
+    void enableDeduplication();
+    int commitMetadata(bool force);
+    int writeBarrier();
+    bool flushOnRelease = false;
+    int commitInterval = 1;     // operations whose metadata changes are written together
+    int uncommittedOps = 0;
+    uint64_t writtenBytes = 0;  // file data written by fuseWrite
+    friend class MetadataCommit;
 
 public:
     static MyOnDiskFS *Instance();
@@ -54,6 +103,7 @@ public:
     virtual int fuseRead(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fileInfo);
     virtual int fuseWrite(const char *path, const char *buf, size_t size, off_t offset, struct fuse_file_info *fileInfo);
     virtual int fuseRelease(const char *path, struct fuse_file_info *fileInfo);
+    virtual int fuseFsync(const char *path, int datasync, struct fuse_file_info *fileInfo);
     virtual void* fuseInit(struct fuse_conn_info *conn);
     virtual int fuseReaddir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fileInfo);
     virtual int fuseTruncate(const char *path, off_t offset, struct fuse_file_info *fileInfo);
@@ -62,6 +112,35 @@ public:
 
 
 
+};
+
+/// @brief Commits the FAT, DMAP and dedup table blocks and root entries changed by a file system operation when the
+/// enclosing scope is left.
+/// Declared after the IoBatch of the operation, so the metadata is written in its batch. An operation ends it with end()
+/// before it returns, to report a failed commit; the destructor only commits for scopes left early.
+class MetadataCommit {
+private:
+    MyOnDiskFS *fs;
+    bool ended;
+
+public:
+    MetadataCommit(MyOnDiskFS *fs) : fs(fs), ended(false) {}
+    ~MetadataCommit() {
+        if (!ended)
+            fs->commitMetadata(false);
+    }
+
+    /// @brief Commit now instead of when the scope is left.
+    /// \param [in] ret Result of the operation so far.
+    /// \return ret, or -ERRNO of the commit if it failed and ret is no error.
+    int end(int ret) {
+        ended = true;
+        int err = fs->commitMetadata(false);
+        return ret < 0 || err >= 0 ? ret : err;
+    }
+
+    MetadataCommit(const MetadataCommit &) = delete;
+    MetadataCommit &operator=(const MetadataCommit &) = delete;
 };
 
 #endif //MYFS_MYONDISKFS_H
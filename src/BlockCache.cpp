@@ -0,0 +1,450 @@
+//
+// Created by user on 17.10.26.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include "BlockCache.h"
+
+BlockCache::BlockCache(BlockStorage *device, uint32_t blockSize, size_t capacity) {
+    this->device = device;
+    this->blockSize = blockSize;
+    this->capacity = capacity;
+    this->hits = 0;
+    this->misses = 0;
+    this->prefetched = 0;
+    this->writeBack = false;
+    this->dirtyCount = 0;
+    this->dirtyLimit = capacity / 2;
+    this->maxDirtyAge = std::chrono::milliseconds(0);
+    this->deviceWrites = 0;
+    this->flusherStop = false;
+}
+
+BlockCache::~BlockCache() {
+    stopFlusher();
+    flush();
+    for (auto const &it: entries) {
+        device->getBufferPool()->put(it.second->data);
+        delete it.second;
+    }
+}
+
+void BlockCache::setCapacity(size_t capacity) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    this->capacity = capacity;
+    evict(capacity);
+}
+
+size_t BlockCache::getCapacity() {
+    return capacity;
+}
+
+BufferPool *BlockCache::getBufferPool() {
+    return device->getBufferPool();
+}
+
+uint32_t BlockCache::getBlockSize() {
+    return blockSize;
+}
+
+int BlockCache::open(const char *path) {
+    return device->open(path);
+}
+
+int BlockCache::create(const char *path) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    evict(0);
+    return device->create(path);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockCache::close() {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    int ret = flush();
+    evict(0);
+    int err = device->close();
+    return ret < 0 ? ret : err;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockCache::sync() {
+    int ret = flush();
+    int err = device->sync();
+    return ret < 0 ? ret : err;
+}
+
+void BlockCache::setBlockSize(uint32_t blockSize) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    flush();
+    evict(0);
+    this->blockSize = blockSize;
+    this->device->setBlockSize(blockSize);
+}
+
+// returns the entry of a cached block and marks it as most recently used
+BlockCache::Entry *BlockCache::lookup(uint32_t blockNo) {
+    auto it = entries.find(blockNo);
+    if (it == entries.end())
+        return nullptr;
+
+    Entry *entry = it->second;
+    lru.splice(lru.begin(), lru, entry->lruPos);
+    return entry;
+}
+
+// caches a copy of the block, replacing the least recently used unpinned block if the cache is full
+BlockCache::Entry *BlockCache::insert(uint32_t blockNo, const char *data) {
+    Entry *entry = lookup(blockNo);
+    if (entry == nullptr) {
+        if (capacity == 0)
+            return nullptr;
+        evict(capacity - 1);
+        entry = new Entry();
+        entry->blockNo = blockNo;
+        entry->data = device->getBufferPool()->get();
+        if (entry->data == nullptr) {
+            delete entry;
+            return nullptr;
+        }
+        entry->refCount = 0;
+        entry->dirty = false;
+        lru.push_front(entry);
+        entry->lruPos = lru.begin();
+        entries[blockNo] = entry;
+    }
+    memcpy(entry->data, data, blockSize);
+    return entry;
+}
+
+// drops least recently used blocks until at most limit blocks are cached, pinned blocks are skipped
+void BlockCache::evict(size_t limit) {
+    auto it = lru.end();
+    while (entries.size() > limit && it != lru.begin()) {
+        Entry *entry = *--it;
+        if (entry->refCount > 0 || entry->dirty)
+            continue;
+        // it must not point to the dropped entry
+        ++it;
+        drop(entry);
+    }
+
+    if (entries.size() > limit && dirtyCount > 0) {
+        // only dirty blocks are left to replace, write them all in one sorted batch
+        if (flush() == 0)
+            evict(limit);
+    }
+}
+
+void BlockCache::drop(Entry *entry) {
+    if (entry->dirty)
+        dirtyCount--;
+    lru.erase(entry->lruPos);
+    entries.erase(entry->blockNo);
+    device->getBufferPool()->put(entry->data);
+    delete entry;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockCache::read(uint32_t blockNo, char *buffer) {
+    BlockRequest request = {blockNo, buffer};
+    return readBlocks(&request, 1);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockCache::write(uint32_t blockNo, char *buffer) {
+    BlockRequest request = {blockNo, buffer};
+    return writeBlocks(&request, 1);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockCache::readBlocks(const BlockRequest *requests, size_t count) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    if (capacity == 0)
+        return device->readBlocks(requests, count);
+
+    std::vector<BlockRequest> missed;
+    for (size_t i = 0; i < count; i++) {
+        Entry *entry = lookup(requests[i].blockNo);
+        if (entry != nullptr) {
+            memcpy(requests[i].buffer, entry->data, blockSize);
+            hits++;
+        } else {
+            missed.push_back(requests[i]);
+            misses++;
+        }
+    }
+    if (missed.empty())
+        return 0;
+
+    int ret = device->readBlocks(missed.data(), missed.size());
+    if (ret < 0)
+        return ret;
+    for (size_t i = 0; i < missed.size(); i++)
+        insert(missed[i].blockNo, missed[i].buffer);
+    return 0;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockCache::writeBlocks(const BlockRequest *requests, size_t count) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    if (writeBack && capacity > 0) {
+        // keep the blocks in memory only, the flusher writes them later
+        Clock::time_point now = Clock::now();
+        for (size_t i = 0; i < count; i++) {
+            Entry *entry = insert(requests[i].blockNo, requests[i].buffer);
+            if (entry == nullptr) {
+                // out of memory, this block goes straight to the device
+                int ret = device->write(requests[i].blockNo, requests[i].buffer);
+                deviceWrites++;
+                if (ret < 0)
+                    return ret;
+                continue;
+            }
+            if (!entry->dirty) {
+                entry->dirty = true;
+                entry->dirtySince = now;
+                dirtyCount++;
+            }
+        }
+        if (dirtyCount > dirtyLimit) {
+            if (flusher.joinable())
+                flusherWakeup.notify_one();
+            else
+                return flush();
+        }
+        return 0;
+    }
+
+    int ret = device->writeBlocks(requests, count);
+    deviceWrites += count;
+    if (ret < 0) {
+        // the device content is unknown now, do not keep stale copies
+        for (size_t i = 0; i < count; i++) {
+            Entry *entry = lookup(requests[i].blockNo);
+            if (entry != nullptr && entry->refCount == 0)
+                drop(entry);
+        }
+        return ret;
+    }
+    for (size_t i = 0; i < count; i++) {
+        Entry *entry = insert(requests[i].blockNo, requests[i].buffer);
+        if (entry != nullptr && entry->dirty) {
+            // an older dirty copy has just been overwritten on the device
+            entry->dirty = false;
+            dirtyCount--;
+        }
+    }
+    return 0;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockCache::discard(uint32_t firstBlock, uint32_t count) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    for (uint64_t blockNo = firstBlock; blockNo < (uint64_t) firstBlock + count && !entries.empty(); blockNo++) {
+        auto it = entries.find((uint32_t) blockNo);
+        if (it == entries.end())
+            continue;
+        Entry *entry = it->second;
+        if (entry->refCount > 0) {
+            memset(entry->data, 0, blockSize);
+            if (entry->dirty) {
+                entry->dirty = false;
+                dirtyCount--;
+            }
+        } else {
+            drop(entry);
+        }
+    }
+    return device->discard(firstBlock, count);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockCache::preallocate(uint32_t firstBlock, uint32_t count) {
+    return device->preallocate(firstBlock, count);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockCache::prefetch(const uint32_t *blockNos, size_t count) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    if (capacity == 0)
+        return 0;
+
+    // never prefetch more than half of the cache, it would replace the blocks it is meant for
+    count = std::min(count, capacity / 2);
+    std::vector<BlockRequest> missed;
+    for (size_t i = 0; i < count; i++) {
+        if (entries.find(blockNos[i]) == entries.end())
+            missed.push_back({blockNos[i], nullptr});
+    }
+    if (missed.empty())
+        return 0;
+
+    BlockBuffer buffer(device->getBufferPool(), missed.size());
+    for (size_t i = 0; i < missed.size(); i++)
+        missed[i].buffer = buffer.data() + i * blockSize;
+    int ret = device->readBlocks(missed.data(), missed.size());
+    if (ret < 0)
+        return ret;
+    for (size_t i = 0; i < missed.size(); i++)
+        insert(missed[i].blockNo, missed[i].buffer);
+    prefetched += missed.size();
+    return 0;
+}
+
+const char *BlockCache::pin(uint32_t blockNo, int *error) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    *error = 0;
+    if (capacity == 0)
+        return nullptr;
+
+    Entry *entry = lookup(blockNo);
+    if (entry != nullptr) {
+        hits++;
+    } else {
+        misses++;
+        BlockBuffer buffer(device->getBufferPool());
+        int ret = device->read(blockNo, buffer.data());
+        if (ret < 0) {
+            *error = ret;
+            return nullptr;
+        }
+        entry = insert(blockNo, buffer.data());
+        if (entry == nullptr) {
+            *error = -ENOMEM;
+            return nullptr;
+        }
+    }
+    entry->refCount++;
+    return entry->data;
+}
+
+void BlockCache::unpin(uint32_t blockNo) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    auto it = entries.find(blockNo);
+    if (it != entries.end() && it->second->refCount > 0) {
+        it->second->refCount--;
+        evict(capacity);
+    }
+}
+
+void BlockCache::clear() {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    evict(0);
+}
+
+uint64_t BlockCache::getHits() {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    return hits;
+}
+
+uint64_t BlockCache::getMisses() {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    return misses;
+}
+
+void BlockCache::setWriteBack(bool enabled, size_t dirtyLimit, unsigned maxDirtyAgeMs) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    this->writeBack = enabled;
+    this->dirtyLimit = dirtyLimit;
+    this->maxDirtyAge = std::chrono::milliseconds(maxDirtyAgeMs);
+    if (!enabled)
+        flush();
+}
+
+bool BlockCache::isWriteBack() {
+    return writeBack;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockCache::flush() {
+    return flushOlderThan(Clock::time_point::max());
+}
+
+// writes all dirty blocks that became dirty before limit
+int BlockCache::flushOlderThan(Clock::time_point limit) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    if (dirtyCount == 0)
+        return 0;
+
+    std::vector<Entry *> dirtyEntries;
+    for (auto const &it: entries) {
+        if (it.second->dirty && it.second->dirtySince < limit)
+            dirtyEntries.push_back(it.second);
+    }
+    return writeOut(dirtyEntries);
+}
+
+// writes the given dirty blocks in ascending block order, so contiguous blocks are merged into one request
+int BlockCache::writeOut(std::vector<Entry *> &dirtyEntries) {
+    std::sort(dirtyEntries.begin(), dirtyEntries.end(),
+              [](const Entry *a, const Entry *b) { return a->blockNo < b->blockNo; });
+
+    std::vector<BlockRequest> requests(dirtyEntries.size());
+    for (size_t i = 0; i < dirtyEntries.size(); i++) {
+        requests[i].blockNo = dirtyEntries[i]->blockNo;
+        requests[i].buffer = dirtyEntries[i]->data;
+    }
+    int ret = device->writeBlocks(requests.data(), requests.size());
+    if (ret < 0)
+        return ret;
+
+    deviceWrites += requests.size();
+    for (size_t i = 0; i < dirtyEntries.size(); i++) {
+        dirtyEntries[i]->dirty = false;
+    }
+    dirtyCount -= dirtyEntries.size();
+    return 0;
+}
+
+void BlockCache::startFlusher() {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    if (flusher.joinable())
+        return;
+    flusherStop = false;
+    flusher = std::thread(&BlockCache::flusherLoop, this);
+}
+
+void BlockCache::stopFlusher() {
+    {
+        std::lock_guard<std::recursive_mutex> guard(lock);
+        if (!flusher.joinable())
+            return;
+        flusherStop = true;
+        flusherWakeup.notify_one();
+    }
+    flusher.join();
+}
+
+// body of the flusher thread: wakes up periodically and when the dirty limit is exceeded
+void BlockCache::flusherLoop() {
+    std::unique_lock<std::recursive_mutex> guard(lock);
+    while (!flusherStop) {
+        std::chrono::milliseconds interval = std::max(maxDirtyAge / 2, std::chrono::milliseconds(10));
+        flusherWakeup.wait_for(guard, interval);
+        if (flusherStop)
+            break;
+
+        if (dirtyCount > dirtyLimit)
+            flush();
+        else
+            flushOlderThan(Clock::now() - maxDirtyAge);
+    }
+}
+
+uint64_t BlockCache::getPrefetched() {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    return prefetched;
+}
+
+size_t BlockCache::getDirtyCount() {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    return dirtyCount;
+}
+
+uint64_t BlockCache::getDeviceWrites() {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    return deviceWrites;
+}
@@ -0,0 +1,74 @@
+//
+// Created by user on 17.10.26.
+//
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include "BufferPool.h"
+
+BufferPool::BufferPool(uint32_t blockSize) {
+    this->blockSize = blockSize;
+}
+
+BufferPool::~BufferPool() {
+    for (char *buffer: freeBuffers)
+        free(buffer);
+}
+
+void BufferPool::setBlockSize(uint32_t blockSize) {
+    std::lock_guard<std::mutex> guard(lock);
+    for (char *buffer: freeBuffers)
+        free(buffer);
+    freeBuffers.clear();
+    this->blockSize = blockSize;
+}
+
+uint32_t BufferPool::getBlockSize() {
+    return blockSize;
+}
+
+char *BufferPool::allocate(size_t blocks) {
+    void *buffer = nullptr;
+    if (posix_memalign(&buffer, blockSize, blocks * blockSize) != 0)
+        return nullptr;
+    return (char *) buffer;
+}
+
+char *BufferPool::get(size_t blocks) {
+    if (blocks == 1) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!freeBuffers.empty()) {
+            char *buffer = freeBuffers.back();
+            freeBuffers.pop_back();
+            return buffer;
+        }
+    }
+    return allocate(blocks);
+}
+
+void BufferPool::put(char *buffer, size_t blocks) {
+    if (buffer == nullptr)
+        return;
+    if (blocks == 1) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (freeBuffers.size() < BUFFER_POOL_MAX_FREE) {
+            freeBuffers.push_back(buffer);
+            return;
+        }
+    }
+    free(buffer);
+}
+
+BlockBuffer::BlockBuffer(BufferPool *pool, size_t blocks) {
+    this->pool = pool;
+    this->blocks = blocks;
+    this->buffer = pool->get(blocks);
+    if (this->buffer == nullptr)
+        throw std::bad_alloc();
+    memset(this->buffer, 0, blocks * pool->getBlockSize());
+}
+
+BlockBuffer::~BlockBuffer() {
+    pool->put(buffer, blocks);
+}
@@ -0,0 +1,98 @@
+//
+// Created by user on 17.10.26.
+//
+
+#include <cstring>
+#include "CMAP.h"
+
+CMAP::CMAP(BlockStorage *device, SuperBlock *superBlock) {
+    this->myDevice = device;
+    this->superBlock = superBlock;
+    this->compressedUnits = 0;
+}
+
+CMAP::~CMAP() {
+
+}
+
+uint8_t CMAP::get(int blockNr) {
+    return cmapArray[blockNr];
+}
+
+void CMAP::set(int blockNr, uint8_t storedBlocks) {
+    if (blockNr >= (int) superBlock->getNumDataBlocks() || superBlock->getCmapSize() == 0 ||
+        cmapArray[blockNr] == storedBlocks)
+        return;
+    if (cmapArray[blockNr] == 0)
+        compressedUnits++;
+    else if (storedBlocks == 0)
+        compressedUnits--;
+    cmapArray[blockNr] = storedBlocks;
+    discWrite(blockNr);
+}
+
+void CMAP::clear(const std::vector<int> &blocks) {
+    for (int block: blocks) {
+        if (block < (int) superBlock->getNumDataBlocks() && cmapArray[block] != 0)
+            set(block, 0);
+    }
+}
+
+size_t CMAP::getCompressedUnits() {
+    return compressedUnits;
+}
+
+// writes the map block holding the entry of the data block
+void CMAP::discWrite(int blockNr) {
+    int blockSize = superBlock->getBlockSize();
+    int numDataBlocks = superBlock->getNumDataBlocks();
+    BlockBuffer buffer(myDevice->getBufferPool());
+    int firstIndex = blockNr - blockNr % blockSize;
+    int count = numDataBlocks - firstIndex < blockSize ? numDataBlocks - firstIndex : blockSize;
+    memset(buffer.data(), 0, blockSize);
+    memcpy(buffer.data(), &cmapArray[firstIndex], count);
+    this->myDevice->write(superBlock->getCmapOffset() + blockNr / blockSize, buffer.data());
+}
+
+void CMAP::init() {
+    cmapArray.assign(superBlock->getNumDataBlocks(), 0);
+    compressedUnits = 0;
+    int blocks = superBlock->getCmapSize();
+    if (blocks == 0)
+        return;
+
+    // all map blocks are read with one vectored request
+    uint32_t blockSize = superBlock->getBlockSize();
+    BlockBuffer buffer(myDevice->getBufferPool(), blocks);
+    std::vector<BlockRequest> requests(blocks);
+    for (int i = 0; i < blocks; i++) {
+        requests[i].blockNo = superBlock->getCmapOffset() + i;
+        requests[i].buffer = buffer.data() + (size_t) i * blockSize;
+    }
+    this->myDevice->readBlocks(requests.data(), blocks);
+
+    memcpy(cmapArray.data(), buffer.data(), cmapArray.size());
+    for (uint32_t i = 0; i < superBlock->getNumDataBlocks(); i++) {
+        if (cmapArray[i] != 0)
+            compressedUnits++;
+    }
+}
+
+void CMAP::firstInit() {
+    cmapArray.assign(superBlock->getNumDataBlocks(), 0);
+    compressedUnits = 0;
+    int blocks = superBlock->getCmapSize();
+    // an empty map is all zeros, a hole in the container is enough
+    if (blocks == 0 || this->myDevice->discard(superBlock->getCmapOffset(), blocks) == 0)
+        return;
+
+    uint32_t blockSize = superBlock->getBlockSize();
+    BlockBuffer buffer(myDevice->getBufferPool(), blocks);
+    memset(buffer.data(), 0, (size_t) blocks * blockSize);
+    std::vector<BlockRequest> requests(blocks);
+    for (int i = 0; i < blocks; i++) {
+        requests[i].blockNo = superBlock->getCmapOffset() + i;
+        requests[i].buffer = buffer.data() + (size_t) i * blockSize;
+    }
+    this->myDevice->writeBlocks(requests.data(), blocks);
+}
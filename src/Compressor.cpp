@@ -0,0 +1,193 @@
+//
+// Created by user on 17.10.26.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include "Compressor.h"
+#include "Lz4.h"
+
+#define NO_CACHED_UNIT UINT32_MAX
+
+Compressor::Compressor(BlockStorage *device, SuperBlock *superBlock, CMAP *cmap) {
+    this->device = device;
+    this->superBlock = superBlock;
+    this->cmap = cmap;
+    this->enabled = false;
+    this->cachedBlock = NO_CACHED_UNIT;
+    resetStats();
+}
+
+Compressor::~Compressor() {
+
+}
+
+int Compressor::setEnabled(bool enabled) {
+    if (enabled && superBlock->getUnitBlocks() == 0)
+        return -ENOTSUP;
+    this->enabled = enabled;
+    return 0;
+}
+
+bool Compressor::isEnabled() {
+    return enabled;
+}
+
+uint32_t Compressor::getUnitBlocks() {
+    return superBlock->getUnitBlocks();
+}
+
+bool Compressor::isCompressed(uint32_t blockNo) {
+    return cmap->get(blockNo - superBlock->getDataOffset()) != 0;
+}
+
+bool Compressor::hasCompressedUnits() {
+    return cmap->getCompressedUnits() > 0;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int Compressor::readUnit(BlockRequest *blocks, size_t numBlocks, size_t validBlocks, char *data) {
+    uint32_t blockSize = superBlock->getBlockSize();
+    size_t size = numBlocks * blockSize;
+    size_t storedCount = cmap->get(blocks[0].blockNo - superBlock->getDataOffset());
+
+    if (storedCount == 0) {
+        validBlocks = std::min(validBlocks, numBlocks);
+        for (size_t i = 0; i < validBlocks; i++)
+            blocks[i].buffer = data + i * blockSize;
+        memset(data + validBlocks * blockSize, 0, size - validBlocks * blockSize);
+        return device->readBlocks(blocks, validBlocks);
+    }
+
+    if (cachedBlock != blocks[0].blockNo) {
+        if (storedCount > numBlocks)
+            return -EIO;
+        stored.resize(storedCount * blockSize);
+        for (size_t i = 0; i < storedCount; i++)
+            blocks[i].buffer = stored.data() + i * blockSize;
+        int ret = device->readBlocks(blocks, storedCount);
+        if (ret < 0)
+            return ret;
+
+        compressedUnitHeader header;
+        memcpy(&header, stored.data(), sizeof(header));
+        if (header.compressedSize > stored.size() - sizeof(header) || header.rawSize > size)
+            return -EIO;
+        cachedData.resize(header.rawSize);
+        ret = Lz4::decompress(stored.data() + sizeof(header), header.compressedSize, cachedData.data(),
+                              cachedData.size());
+        if (ret != (int) header.rawSize) {
+            cachedBlock = NO_CACHED_UNIT;
+            return -EIO;
+        }
+        cachedBlock = blocks[0].blockNo;
+        decompressions++;
+    }
+
+    // a unit that grew by a truncate has zeros behind its old content
+    size_t copied = std::min(cachedData.size(), size);
+    memcpy(data, cachedData.data(), copied);
+    memset(data + copied, 0, size - copied);
+    return 0;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int Compressor::writeUnit(BlockRequest *blocks, size_t numBlocks, size_t validBlocks, const char *data) {
+    uint32_t blockSize = superBlock->getBlockSize();
+    int first = blocks[0].blockNo - superBlock->getDataOffset();
+    size_t size = numBlocks * blockSize;
+    size_t oldStored = cmap->get(first) != 0 ? cmap->get(first) : validBlocks;
+    oldStored = std::min(oldStored, numBlocks);
+
+    size_t storedCount = numBlocks;
+    if (enabled && numBlocks > 1) {
+        // only worth it if at least one block is saved
+        size_t capacity = (numBlocks - 1) * blockSize;
+        stored.resize(capacity);
+        int compressed = Lz4::compress(data, size, stored.data() + sizeof(compressedUnitHeader),
+                                       capacity - sizeof(compressedUnitHeader));
+        if (compressed >= 0) {
+            compressedUnitHeader header = {(uint32_t) compressed, (uint32_t) size};
+            memcpy(stored.data(), &header, sizeof(header));
+            size_t used = sizeof(header) + compressed;
+            storedCount = (used + blockSize - 1) / blockSize;
+            memset(stored.data() + used, 0, storedCount * blockSize - used);
+        }
+    }
+
+    int ret;
+    if (storedCount < numBlocks) {
+        for (size_t i = 0; i < storedCount; i++)
+            blocks[i].buffer = stored.data() + i * blockSize;
+        ret = device->writeBlocks(blocks, storedCount);
+        if (ret < 0)
+            return ret;
+        if (oldStored > storedCount)
+            discardRuns(blocks + storedCount, oldStored - storedCount);
+        cmap->set(first, (uint8_t) storedCount);
+        cachedBlock = blocks[0].blockNo;
+        cachedData.assign(data, data + size);
+        compressedUnits++;
+    } else {
+        for (size_t i = 0; i < numBlocks; i++)
+            blocks[i].buffer = const_cast<char *>(data + i * blockSize);
+        ret = device->writeBlocks(blocks, numBlocks);
+        if (ret < 0)
+            return ret;
+        cmap->set(first, 0);
+        if (cachedBlock == blocks[0].blockNo)
+            cachedBlock = NO_CACHED_UNIT;
+        rawUnits++;
+    }
+    writtenBlocks += numBlocks;
+    storedBlocks += storedCount;
+    return 0;
+}
+
+// the blocks behind a compressed unit become holes; like all discards, this is only a hint
+void Compressor::discardRuns(const BlockRequest *blocks, size_t count) {
+    size_t start = 0;
+    for (size_t i = 1; i <= count; i++) {
+        if (i == count || blocks[i].blockNo != blocks[i - 1].blockNo + 1) {
+            device->discard(blocks[start].blockNo, i - start);
+            start = i;
+        }
+    }
+}
+
+void Compressor::release(const std::vector<int> &blocks) {
+    for (int block: blocks) {
+        if (block + superBlock->getDataOffset() == cachedBlock)
+            cachedBlock = NO_CACHED_UNIT;
+    }
+    cmap->clear(blocks);
+}
+
+uint64_t Compressor::getCompressedUnits() {
+    return compressedUnits;
+}
+
+uint64_t Compressor::getRawUnits() {
+    return rawUnits;
+}
+
+uint64_t Compressor::getWrittenBlocks() {
+    return writtenBlocks;
+}
+
+uint64_t Compressor::getStoredBlocks() {
+    return storedBlocks;
+}
+
+uint64_t Compressor::getDecompressions() {
+    return decompressions;
+}
+
+void Compressor::resetStats() {
+    compressedUnits = 0;
+    rawUnits = 0;
+    writtenBlocks = 0;
+    storedBlocks = 0;
+    decompressions = 0;
+}
@@ -0,0 +1,579 @@
+//
+// Created by user on 17.10.26.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include "DDT.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DDT_X86
+#endif
+
+#define HASH_PRIME1 11400714785074694791ull
+#define HASH_PRIME2 14029467366897019727ull
+#define HASH_PRIME3 1609587929392839161ull
+
+static inline uint64_t read64(const char *p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint64_t rotl(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t mixLane(uint64_t lane, uint64_t word) {
+    return rotl(lane + word * HASH_PRIME2, 31) * HASH_PRIME1;
+}
+
+// checks 8 bytes at a time, for CPUs without vector units and for the bytes behind the last vector
+static bool isZeroScalar(const char *data, size_t size) {
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        if (read64(data + i) != 0)
+            return false;
+    }
+    for (; i < size; i++) {
+        if (data[i] != 0)
+            return false;
+    }
+    return true;
+}
+
+#ifdef __SSE2__
+// ORs 64 bytes into one register per test, so data that is not zero usually stops the loop in the first round
+static bool isZeroSse2(const char *data, size_t size) {
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (data + i));
+        __m128i b = _mm_loadu_si128((const __m128i *) (data + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *) (data + i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i *) (data + i + 48));
+        __m128i any = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, _mm_setzero_si128())) != 0xFFFF)
+            return false;
+    }
+    return isZeroScalar(data + i, size - i);
+}
+#endif
+
+#ifdef DDT_X86
+// compiled for AVX2 whatever the build flags are, only called if the CPU has it
+__attribute__((target("avx2")))
+static bool isZeroAvx2(const char *data, size_t size) {
+    size_t i = 0;
+    for (; i + 128 <= size; i += 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) (data + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *) (data + i + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i *) (data + i + 64));
+        __m256i d = _mm256_loadu_si256((const __m256i *) (data + i + 96));
+        __m256i any = _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d));
+        if (!_mm256_testz_si256(any, any))
+            return false;
+    }
+    return isZeroScalar(data + i, size - i);
+}
+#endif
+
+typedef bool (*ZeroCheck)(const char *data, size_t size);
+
+static ZeroCheck selectZeroCheck() {
+#ifdef DDT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return isZeroAvx2;
+#endif
+#ifdef __SSE2__
+    return isZeroSse2;
+#else
+    return isZeroScalar;
+#endif
+}
+
+DDT::DDT(BlockStorage *device, SuperBlock *superBlock, DMAP *dmap) {
+    this->myDevice = device;
+    this->superBlock = superBlock;
+    this->dmap = dmap;
+    this->enabled = false;
+    this->deferred = false;
+    this->sharedBlocks = 0;
+    this->zeroBlocks = 0;
+    resetStats();
+}
+
+DDT::~DDT() {
+
+}
+
+// four independent lanes of 8 bytes each keep the multipliers of the CPU busy
+uint64_t DDT::hash(const char *data, size_t size) {
+    uint64_t lanes[4] = {HASH_PRIME1 + HASH_PRIME2, HASH_PRIME2, 0, 0 - HASH_PRIME1};
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        lanes[0] = mixLane(lanes[0], read64(data + i));
+        lanes[1] = mixLane(lanes[1], read64(data + i + 8));
+        lanes[2] = mixLane(lanes[2], read64(data + i + 16));
+        lanes[3] = mixLane(lanes[3], read64(data + i + 24));
+    }
+    uint64_t h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18) + size;
+    for (; i + 8 <= size; i += 8)
+        h = mixLane(h, read64(data + i));
+    for (; i < size; i++)
+        h = (h ^ (uint8_t) data[i]) * HASH_PRIME1;
+
+    h ^= h >> 33;
+    h *= HASH_PRIME2;
+    h ^= h >> 29;
+    h *= HASH_PRIME3;
+    h ^= h >> 32;
+    // 0 marks blocks that are not in the index
+    return h != 0 ? h : 1;
+}
+
+bool DDT::isZeroBlock(const char *data, size_t size) {
+    // the CPU is asked once, on the first call
+    static const ZeroCheck check = selectZeroCheck();
+    return check(data, size);
+}
+
+bool DDT::hasTable() {
+    return superBlock->getDdtSize() > 0;
+}
+
+int DDT::setEnabled(bool enabled) {
+    if (enabled && !hasTable())
+        return -ENOTSUP;
+    this->enabled = enabled;
+    return 0;
+}
+
+bool DDT::isEnabled() {
+    return enabled;
+}
+
+int DDT::getStorage(int blockNr) {
+    return ddtArray[blockNr].ref != 0 ? ddtArray[blockNr].ref : blockNr;
+}
+
+bool DDT::hasSharedBlocks() {
+    return sharedBlocks > 0;
+}
+
+bool DDT::isZero(int blockNr) {
+    return ddtArray[blockNr].zero;
+}
+
+bool DDT::hasZeroBlocks() {
+    return zeroBlocks > 0;
+}
+
+// compares the content of a block with data, blocks written by the current writeBlocks() call are not on the device yet
+bool DDT::sameContent(int blockNr, const char *data, const std::unordered_map<int, const char *> &pending) {
+    uint32_t blockSize = superBlock->getBlockSize();
+    std::unordered_map<int, const char *>::const_iterator it = pending.find(blockNr);
+    if (it != pending.end())
+        return memcmp(it->second, data, blockSize) == 0;
+
+    BlockBuffer buffer(myDevice->getBufferPool());
+    if (myDevice->read(superBlock->getDataOffset() + blockNr, buffer.data()) < 0)
+        return false;
+    return memcmp(buffer.data(), data, blockSize) == 0;
+}
+
+// removes a block from the index before its content changes or it is freed
+void DDT::unindex(int blockNr) {
+    dedupEntry &entry = ddtArray[blockNr];
+    if (entry.hash == 0)
+        return;
+    std::unordered_map<uint64_t, int>::iterator it = index.find(entry.hash);
+    if (it != index.end() && it->second == blockNr)
+        index.erase(it);
+    entry.hash = 0;
+    discWrite(blockNr);
+}
+
+// the block gets content of its own, or is freed
+void DDT::clearZero(int blockNr) {
+    if (!ddtArray[blockNr].zero)
+        return;
+    ddtArray[blockNr].zero = 0;
+    zeroBlocks--;
+    discWrite(blockNr);
+}
+
+// lets a block that shares the content of another one hold its own content again, an orphan losing its last
+// reference is freed
+void DDT::dropRef(int blockNr) {
+    int owner = ddtArray[blockNr].ref;
+    ddtArray[blockNr].ref = 0;
+    sharedBlocks--;
+    std::unordered_map<int, std::set<int>>::iterator shared = sharers.find(owner);
+    if (shared != sharers.end()) {
+        shared->second.erase(blockNr);
+        if (shared->second.empty())
+            sharers.erase(shared);
+    }
+    discWrite(blockNr);
+
+    dedupEntry &ownerEntry = ddtArray[owner];
+    ownerEntry.refs--;
+    if (ownerEntry.refs == 0 && ownerEntry.orphan) {
+        ownerEntry.orphan = 0;
+        unindex(owner);
+        discWrite(owner);
+        dmap->freeBlocks(std::vector<int>(1, owner));
+    } else {
+        discWrite(owner);
+    }
+}
+
+// copies the content of a shared block to the first block sharing it, which becomes the owner for all others
+int DDT::handOver(int blockNr) {
+    dedupEntry &entry = ddtArray[blockNr];
+    uint32_t dataOffset = superBlock->getDataOffset();
+    int heir = 0;
+    std::unordered_map<int, std::set<int>>::iterator shared = sharers.find(blockNr);
+    if (shared != sharers.end()) {
+        std::set<int> others;
+        others.swap(shared->second);
+        sharers.erase(shared);
+        heir = *others.begin();
+        others.erase(others.begin());
+
+        BlockBuffer buffer(myDevice->getBufferPool());
+        int ret = myDevice->read(dataOffset + blockNr, buffer.data());
+        if (ret >= 0)
+            ret = myDevice->write(dataOffset + heir, buffer.data());
+        if (ret < 0) {
+            others.insert(heir);
+            sharers[blockNr].swap(others);
+            return ret;
+        }
+        copiedBlocks++;
+        ddtArray[heir].ref = 0;
+        ddtArray[heir].refs = entry.refs - 1;
+        ddtArray[heir].hash = entry.hash;
+        sharedBlocks--;
+        discWrite(heir);
+        for (int block: others) {
+            ddtArray[block].ref = heir;
+            discWrite(block);
+        }
+        if (!others.empty())
+            sharers[heir].swap(others);
+    }
+
+    std::unordered_map<uint64_t, int>::iterator it = index.find(entry.hash);
+    if (it != index.end() && it->second == blockNr) {
+        if (heir != 0)
+            it->second = heir;
+        else
+            index.erase(it);
+    }
+    entry.hash = 0;
+    entry.refs = 0;
+    discWrite(blockNr);
+    return 0;
+}
+
+// blocks sharing the content of another one and blocks of zeros are holes in the container; contiguous blocks are
+// discarded together. Returns the error of the last run that could not be discarded.
+int DDT::discardRuns(std::vector<int> blocks) {
+    std::sort(blocks.begin(), blocks.end());
+    int ret = 0;
+    size_t start = 0;
+    for (size_t i = 1; i <= blocks.size(); i++) {
+        if (i == blocks.size() || blocks[i] != blocks[i - 1] + 1) {
+            int discarded = myDevice->discard(superBlock->getDataOffset() + blocks[start], i - start);
+            if (discarded < 0)
+                ret = discarded;
+            start = i;
+        }
+    }
+    return ret;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int DDT::writeBlocks(const BlockRequest *requests, size_t count) {
+    uint32_t blockSize = superBlock->getBlockSize();
+    uint32_t dataOffset = superBlock->getDataOffset();
+    bool table = hasTable();
+    std::vector<BlockRequest> writes;
+    std::vector<int> holes;
+    std::vector<BlockRequest> zeros;
+    std::vector<int> zeroHoles;
+    std::unordered_map<int, const char *> pending;
+
+    for (size_t i = 0; i < count; i++) {
+        int blockNr = requests[i].blockNo - dataOffset;
+        const char *data = requests[i].buffer;
+        dedupEntry &entry = ddtArray[blockNr];
+        bool zero = table && isZeroBlock(data, blockSize);
+        uint64_t h = enabled && !zero ? hash(data, blockSize) : 0;
+        writtenBlocks++;
+
+        // the block keeps its content if it does not change, otherwise it has to hold its own content
+        if (entry.zero) {
+            if (zero) {
+                holeBlocks++;
+                continue;
+            }
+            clearZero(blockNr);
+        } else if (entry.ref != 0) {
+            if (enabled && ddtArray[entry.ref].hash == h && sameContent(entry.ref, data, pending)) {
+                dedupedBlocks++;
+                continue;
+            }
+            dropRef(blockNr);
+        } else if (enabled && entry.hash == h && sameContent(blockNr, data, pending)) {
+            dedupedBlocks++;
+            continue;
+        } else if (entry.refs > 0) {
+            int ret = handOver(blockNr);
+            if (ret < 0)
+                return ret;
+        }
+        unindex(blockNr);
+
+        if (zero) {
+            entry.zero = 1;
+            zeroBlocks++;
+            discWrite(blockNr);
+            zeroHoles.push_back(blockNr);
+            zeros.push_back(requests[i]);
+            holeBlocks++;
+            continue;
+        }
+        if (enabled) {
+            std::unordered_map<uint64_t, int>::iterator it = index.find(h);
+            if (it != index.end() && sameContent(it->second, data, pending)) {
+                int owner = it->second;
+                entry.ref = owner;
+                ddtArray[owner].refs++;
+                sharers[owner].insert(blockNr);
+                sharedBlocks++;
+                discWrite(blockNr);
+                discWrite(owner);
+                holes.push_back(blockNr);
+                dedupedBlocks++;
+                continue;
+            }
+            entry.hash = h;
+            index[h] = blockNr;
+            discWrite(blockNr);
+        }
+        writes.push_back(requests[i]);
+        if (enabled)
+            pending[blockNr] = data;
+    }
+
+    int ret = myDevice->writeBlocks(writes.data(), writes.size());
+    // a container that cannot punch holes gets the zeros written, so the blocks read as zeros either way
+    if (!zeroHoles.empty() && discardRuns(zeroHoles) < 0 && ret >= 0)
+        ret = myDevice->writeBlocks(zeros.data(), zeros.size());
+    // a hole may have taken over the content of a block overwritten later in the request
+    std::vector<int> stillShared;
+    for (int block: holes) {
+        if (ddtArray[block].ref != 0)
+            stillShared.push_back(block);
+    }
+    if (!stillShared.empty())
+        discardRuns(stillShared);
+    return ret;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int DDT::unshare(int blockNr) {
+    clearZero(blockNr);
+    if (ddtArray[blockNr].ref != 0) {
+        dropRef(blockNr);
+    } else if (ddtArray[blockNr].refs > 0) {
+        int ret = handOver(blockNr);
+        if (ret < 0)
+            return ret;
+    }
+    unindex(blockNr);
+    return 0;
+}
+
+std::vector<int> DDT::release(const std::vector<int> &blocks) {
+    std::vector<int> freed;
+    for (int block: blocks) {
+        if (block >= (int) superBlock->getNumDataBlocks())
+            continue;
+        dedupEntry &entry = ddtArray[block];
+        if (entry.ref != 0) {
+            dropRef(block);
+            freed.push_back(block);
+        } else if (entry.refs > 0) {
+            // stays in the index, so new blocks can still share its content
+            entry.orphan = 1;
+            discWrite(block);
+        } else {
+            clearZero(block);
+            unindex(block);
+            freed.push_back(block);
+        }
+    }
+    return freed;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int DDT::makeHoles(const std::vector<int> &blocks) {
+    if (!hasTable() || blocks.empty())
+        return 0;
+    int ret = discardRuns(blocks);
+    if (ret < 0)
+        return ret;
+    for (int block: blocks) {
+        if (ddtArray[block].zero)
+            continue;
+        ddtArray[block].zero = 1;
+        zeroBlocks++;
+        discWrite(block);
+    }
+    return 0;
+}
+
+size_t DDT::getSharedBlocks() {
+    return sharedBlocks;
+}
+
+size_t DDT::getZeroBlocks() {
+    return zeroBlocks;
+}
+
+uint64_t DDT::getWrittenBlocks() {
+    return writtenBlocks;
+}
+
+uint64_t DDT::getDedupedBlocks() {
+    return dedupedBlocks;
+}
+
+uint64_t DDT::getCopiedBlocks() {
+    return copiedBlocks;
+}
+
+uint64_t DDT::getHoleBlocks() {
+    return holeBlocks;
+}
+
+void DDT::resetStats() {
+    writtenBlocks = 0;
+    dedupedBlocks = 0;
+    copiedBlocks = 0;
+    holeBlocks = 0;
+}
+
+// writes the table block holding the entry of the data block, or only marks it as changed until flush() is called
+void DDT::discWrite(int blockNr) {
+    if (superBlock->getDdtSize() == 0)
+        return;
+    int ddtBlock = blockNr / (superBlock->getBlockSize() / DDT_ENTRY_SIZE);
+    if (deferred) {
+        dirtyBlocks.insert(ddtBlock);
+        return;
+    }
+    BlockBuffer buffer(myDevice->getBufferPool());
+    serialize(ddtBlock, buffer.data());
+    this->myDevice->write(superBlock->getDdtOffset() + ddtBlock, buffer.data());
+}
+
+// copies the entries of a table block to buffer
+void DDT::serialize(int ddtBlock, char *buffer) {
+    int entriesPerBlock = superBlock->getBlockSize() / DDT_ENTRY_SIZE;
+    int firstIndex = ddtBlock * entriesPerBlock;
+    int count = std::min(entriesPerBlock, (int) superBlock->getNumDataBlocks() - firstIndex);
+    memset(buffer, 0, superBlock->getBlockSize());
+    memcpy(buffer, &ddtArray[firstIndex], (size_t) count * DDT_ENTRY_SIZE);
+}
+
+void DDT::setDeferred(bool deferred) {
+    this->deferred = deferred;
+    if (!deferred)
+        flush();
+}
+
+// this method returns 0 if successful, -errno otherwise
+int DDT::flush() {
+    if (dirtyBlocks.empty())
+        return 0;
+    uint32_t blockSize = superBlock->getBlockSize();
+    BlockBuffer buffer(myDevice->getBufferPool(), dirtyBlocks.size());
+    std::vector<BlockRequest> requests;
+    for (int ddtBlock: dirtyBlocks) {
+        BlockRequest request;
+        request.blockNo = superBlock->getDdtOffset() + ddtBlock;
+        request.buffer = buffer.data() + requests.size() * blockSize;
+        serialize(ddtBlock, request.buffer);
+        requests.push_back(request);
+    }
+    dirtyBlocks.clear();
+    return myDevice->writeBlocks(requests.data(), requests.size());
+}
+
+size_t DDT::getDirtyBlocks() {
+    return dirtyBlocks.size();
+}
+
+void DDT::init() {
+    ddtArray.assign(superBlock->getNumDataBlocks(), dedupEntry());
+    index.clear();
+    sharers.clear();
+    dirtyBlocks.clear();
+    sharedBlocks = 0;
+    zeroBlocks = 0;
+    int blocks = superBlock->getDdtSize();
+    if (blocks == 0)
+        return;
+
+    // all table blocks are read with one vectored request
+    uint32_t blockSize = superBlock->getBlockSize();
+    BlockBuffer buffer(myDevice->getBufferPool(), blocks);
+    std::vector<BlockRequest> requests(blocks);
+    for (int i = 0; i < blocks; i++) {
+        requests[i].blockNo = superBlock->getDdtOffset() + i;
+        requests[i].buffer = buffer.data() + (size_t) i * blockSize;
+    }
+    this->myDevice->readBlocks(requests.data(), blocks);
+
+    memcpy(ddtArray.data(), buffer.data(), ddtArray.size() * DDT_ENTRY_SIZE);
+    for (int i = 1; i < (int) superBlock->getNumDataBlocks(); i++) {
+        if (ddtArray[i].zero)
+            zeroBlocks++;
+        if (ddtArray[i].ref != 0) {
+            sharedBlocks++;
+            sharers[ddtArray[i].ref].insert(i);
+        } else if (ddtArray[i].hash != 0) {
+            index[ddtArray[i].hash] = i;
+        }
+    }
+}
+
+void DDT::firstInit() {
+    ddtArray.assign(superBlock->getNumDataBlocks(), dedupEntry());
+    index.clear();
+    sharers.clear();
+    dirtyBlocks.clear();
+    sharedBlocks = 0;
+    zeroBlocks = 0;
+    int blocks = superBlock->getDdtSize();
+    // an empty table is all zeros, a hole in the container is enough
+    if (blocks == 0 || this->myDevice->discard(superBlock->getDdtOffset(), blocks) == 0)
+        return;
+
+    uint32_t blockSize = superBlock->getBlockSize();
+    BlockBuffer buffer(myDevice->getBufferPool(), blocks);
+    memset(buffer.data(), 0, (size_t) blocks * blockSize);
+    std::vector<BlockRequest> requests(blocks);
+    for (int i = 0; i < blocks; i++) {
+        requests[i].blockNo = superBlock->getDdtOffset() + i;
+        requests[i].buffer = buffer.data() + (size_t) i * blockSize;
+    }
+    this->myDevice->writeBlocks(requests.data(), blocks);
+}
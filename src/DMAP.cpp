@@ -3,9 +3,16 @@
 //
 #include "DMAP.h"
 #include "myfs-structs.h"
+#include <algorithm>
+#include <vector>
 
-DMAP::DMAP(BlockDevice *device) {
+DMAP::DMAP(BlockStorage *device, SuperBlock *superBlock) {
     this->myDevice = device;
+    this->superBlock = superBlock;
+    this->searchStart = 1;
+    this->preallocate = true;
+    this->deferred = false;
+    this->writtenBlocks = 0;
 }
 
 DMAP::~DMAP() {
@@ -21,25 +28,41 @@ DMAP::~DMAP() {
  * @param entry
  */
 void DMAP::setBlock(int blocknumber, bool entry) {
-    if (blocknumber < NUMBER_BLOCKS) {
+    if (blocknumber < (int) superBlock->getNumDataBlocks()) {
         dmapArray[blocknumber] = entry;
+        if (!entry && blocknumber < searchStart)
+            searchStart = std::max(blocknumber, 1);
         discWrite(blocknumber);
     }
 }
 
+/**
+ * Gibt zurück, ob der Block an der übergebenen Blocknummer belegt ist
+ *
+ * @param blocknumber
+ * @return
+ */
+bool DMAP::getBlock(int blocknumber) {
+    return dmapArray[blocknumber] != 0;
+}
+
 /**
  * gibt den Index des ersten freien Blocks zurück
  *
  * @return
  */
 int DMAP::getFirstFreeBlock() {
-    int blocknumber = 1;
-    while (blocknumber < NUMBER_DATA_BLOCKS) {
+    // die Suche beginnt beim ersten Block, der frei sein kann, große Container werden nicht jedes Mal ganz durchsucht
+    int blocknumber = searchStart;
+    int numDataBlocks = superBlock->getNumDataBlocks();
+    while (blocknumber < numDataBlocks) {
         if (!dmapArray[blocknumber]) {
+            searchStart = blocknumber;
             return blocknumber;
         }
         blocknumber++;
     }
+    searchStart = numDataBlocks;
     return -EINVAL; //keine freien Blöcke
 }
 
@@ -47,25 +70,141 @@ int DMAP::getFirstFreeBlock() {
  * Gibt die Indexe der gewünschten Anzahl an freien Blöcken zurück
  *
  * @param number
- * @return
+ * @param reserve false, wenn die Blöcke nicht im Container reserviert werden sollen (z.B. weil sie Löcher bleiben)
+ * @return nullptr, wenn nicht genug Blöcke frei sind; die schon vergebenen Blöcke sind dann wieder frei
  */
-int *DMAP::getCertainNumberOfFreeBlocks(int number) {
+int *DMAP::getCertainNumberOfFreeBlocks(int number, bool reserve) {
     int *returnArray = new int[number];
     for (int i = 0; i < number; i++) {
         int blockNo = getFirstFreeBlock();
-        if (blockNo < 0) return nullptr;
+        if (blockNo < 0) {
+            for (int j = 0; j < i; j++) {
+                setBlock(returnArray[j], false);
+            }
+            delete[] returnArray;
+            return nullptr;
+        }
         returnArray[i] = blockNo;
         dmapArray[blockNo] = true;
         discWrite(blockNo);
     }
+    if (preallocate && reserve)
+        manageRuns(std::vector<int>(returnArray, returnArray + number), false);
     return returnArray;
 }
 
+/**
+ * Legt fest, ob neu vergebene Blöcke im Container reserviert werden
+ *
+ * @param preallocate
+ */
+void DMAP::setPreallocate(bool preallocate) {
+    this->preallocate = preallocate;
+}
 
+/**
+ * Gibt die übergebenen Blöcke frei und gibt ihren Platz im Container an das Host-Dateisystem zurück
+ *
+ * @param blocks
+ */
+void DMAP::freeBlocks(const std::vector<int> &blocks) {
+    for (int block: blocks) {
+        setBlock(block, false);
+    }
+    manageRuns(blocks, true);
+}
+
+/**
+ * Fasst die Blöcke zu zusammenhängenden Bereichen zusammen und gibt diese frei (discard) bzw. reserviert sie
+ * (preallocate). Beides ist nur ein Hinweis an das Backend, Fehler werden ignoriert.
+ */
+void DMAP::manageRuns(std::vector<int> blocks, bool doDiscard) {
+    std::sort(blocks.begin(), blocks.end());
+    size_t start = 0;
+    for (size_t i = 1; i <= blocks.size(); i++) {
+        if (i == blocks.size() || blocks[i] != blocks[i - 1] + 1) {
+            uint32_t first = superBlock->getDataOffset() + blocks[start];
+            uint32_t count = i - start;
+            if (doDiscard)
+                myDevice->discard(first, count);
+            else
+                myDevice->preallocate(first, count);
+            start = i;
+        }
+    }
+}
+
+
+/**
+ * Schreibt den Block der DMAP mit dem übergebenen Eintrag, oder markiert ihn nur als geändert, bis flush() aufgerufen
+ * wird
+ *
+ * @param dMapArrayIndex
+ */
 void DMAP::discWrite(int dMapArrayIndex) {
-    char buffer[BLOCK_SIZE];
-    memcpy(buffer, &dmapArray[dMapArrayIndex / BLOCK_SIZE], BLOCK_SIZE);
-    this->myDevice->write(DMAP_OFFSET_SIZE + dMapArrayIndex / BLOCK_SIZE, buffer);
+    int blockSize = superBlock->getBlockSize();
+    if (deferred) {
+        dirtyBlocks.insert(dMapArrayIndex / blockSize);
+        return;
+    }
+    int numDataBlocks = superBlock->getNumDataBlocks();
+    BlockBuffer buffer(myDevice->getBufferPool());
+    int firstIndex = dMapArrayIndex - dMapArrayIndex % blockSize;
+    int count = numDataBlocks - firstIndex < blockSize ? numDataBlocks - firstIndex : blockSize;
+    memcpy(buffer.data(), &dmapArray[firstIndex], count);
+    this->myDevice->write(superBlock->getDmapOffset() + dMapArrayIndex / blockSize, buffer.data());
+    writtenBlocks++;
+}
+
+/**
+ * Legt fest, ob geänderte Blöcke der DMAP bis flush() im Speicher bleiben, statt bei jeder Änderung geschrieben zu
+ * werden. Beim Abschalten werden sie geschrieben.
+ *
+ * @param deferred
+ */
+void DMAP::setDeferred(bool deferred) {
+    this->deferred = deferred;
+    if (!deferred)
+        flush();
+}
+
+/**
+ * Schreibt jeden geänderten Block der DMAP einmal, mit einem einzigen vektorisierten Request
+ *
+ * @return 0 bei Erfolg, sonst -errno
+ */
+int DMAP::flush() {
+    if (dirtyBlocks.empty())
+        return 0;
+    uint32_t blockSize = superBlock->getBlockSize();
+    uint32_t numDataBlocks = superBlock->getNumDataBlocks();
+    BlockBuffer buffer(myDevice->getBufferPool(), dirtyBlocks.size());
+    std::vector<BlockRequest> requests;
+    for (int dmapBlock: dirtyBlocks) {
+        BlockRequest request;
+        uint32_t firstIndex = dmapBlock * blockSize;
+        request.blockNo = superBlock->getDmapOffset() + dmapBlock;
+        request.buffer = buffer.data() + requests.size() * blockSize;
+        memset(request.buffer, 0, blockSize);
+        memcpy(request.buffer, &dmapArray[firstIndex], std::min(blockSize, numDataBlocks - firstIndex));
+        requests.push_back(request);
+    }
+    dirtyBlocks.clear();
+    writtenBlocks += requests.size();
+    return this->myDevice->writeBlocks(requests.data(), requests.size());
+}
+
+size_t DMAP::getDirtyBlocks() {
+    return dirtyBlocks.size();
+}
+
+/**
+ * Gibt die Anzahl der auf das Device geschriebenen Blöcke der DMAP zurück
+ *
+ * @return
+ */
+uint64_t DMAP::getWrittenBlocks() {
+    return writtenBlocks;
 }
 
 /**
@@ -73,16 +212,40 @@ void DMAP::discWrite(int dMapArrayIndex) {
  *
  */
 void DMAP::init() {
-    char buffer[BLOCK_SIZE];
+    // all DMAP blocks are read with one vectored request
+    uint32_t blockSize = superBlock->getBlockSize();
+    int blocks = superBlock->getDmapSize();
+    BlockBuffer buffer(myDevice->getBufferPool(), blocks);
+    std::vector<BlockRequest> requests(blocks);
+    for (int i = 0; i < blocks; i++) {
+        requests[i].blockNo = superBlock->getDmapOffset() + i;
+        requests[i].buffer = buffer.data() + (size_t) i * blockSize;
+    }
+    this->myDevice->readBlocks(requests.data(), blocks);
 
-    for (int i = 0; i < NUMBER_DATA_BLOCKS; i++) { //Iteriert über das ganze dmapArray
-        this->myDevice->read(DMAP_OFFSET_SIZE + i, buffer);
+    dmapArray.assign(buffer.data(), buffer.data() + superBlock->getNumDataBlocks());
+    dirtyBlocks.clear();
+    searchStart = 1;
+}
 
-        for (int j = 0; j < BLOCK_SIZE; j++) {
-            int index = j + BLOCK_SIZE * i;
-            if (index < NUMBER_DATA_BLOCKS) {
-                std::memcpy(&dmapArray[index], buffer + j, sizeof(bool));
-            }
-        }
+/**
+ * Legt eine neue, leere DMAP an
+ *
+ */
+void DMAP::firstInit() {
+    uint32_t blockSize = superBlock->getBlockSize();
+    int blocks = superBlock->getDmapSize();
+    dmapArray.assign(superBlock->getNumDataBlocks(), 0);
+    dirtyBlocks.clear();
+    searchStart = 1;
+    // an empty DMAP is all zeros, a hole in the container is enough
+    if (this->myDevice->discard(superBlock->getDmapOffset(), blocks) == 0)
+        return;
+    BlockBuffer buffer(myDevice->getBufferPool(), blocks);
+    std::vector<BlockRequest> requests(blocks);
+    for (int i = 0; i < blocks; i++) {
+        requests[i].blockNo = superBlock->getDmapOffset() + i;
+        requests[i].buffer = buffer.data() + (size_t) i * blockSize;
     }
-}
\ No newline at end of file
+    this->myDevice->writeBlocks(requests.data(), blocks);
+}
@@ -0,0 +1,171 @@
+//
+// Created by user on 17.10.26.
+//
+
+#include <algorithm>
+#include <cstring>
+#include "ExtentMap.h"
+
+// header of a stored table, followed by count extents
+struct extentHeader {
+    uint32_t magic;
+    uint32_t count;
+};
+
+ExtentMap::ExtentMap() {
+    this->blocks = 0;
+    this->loaded = true;
+    this->users = 0;
+}
+
+ExtentMap::~ExtentMap() {
+
+}
+
+bool ExtentMap::isLoaded() const {
+    return loaded;
+}
+
+void ExtentMap::build(FAT *fat, int firstBlock) {
+    extents.clear();
+    blocks = 0;
+    loaded = true;
+    for (int block = firstBlock; block != FAT_END; block = fat->getNext(block)) {
+        append(&block, 1);
+    }
+    if (users > 0)
+        materialize();
+}
+
+int ExtentMap::getBlocks() const {
+    return blocks;
+}
+
+size_t ExtentMap::getExtents() const {
+    return extents.size();
+}
+
+int ExtentMap::getBlock(int fileBlock, int *run) const {
+    if (fileBlock < 0 || fileBlock >= blocks) {
+        if (run != nullptr)
+            *run = 0;
+        return FAT_END;
+    }
+    if (isMaterialized()) {
+        if (run != nullptr)
+            *run = 1;
+        return blockArray[fileBlock];
+    }
+    // last extent starting at or before the file block
+    auto it = std::upper_bound(extents.begin(), extents.end(), (uint32_t) fileBlock,
+                               [](uint32_t value, const extent &e) { return value < e.fileBlock; }) - 1;
+    uint32_t inExtent = fileBlock - it->fileBlock;
+    if (run != nullptr)
+        *run = it->length - inExtent;
+    return it->block + inExtent;
+}
+
+int ExtentMap::getLastBlock() const {
+    if (extents.empty())
+        return FAT_END;
+    return extents.back().block + extents.back().length - 1;
+}
+
+void ExtentMap::append(const int *newBlocks, int count) {
+    for (int i = 0; i < count; i++) {
+        if (!extents.empty() && extents.back().block + extents.back().length == (uint32_t) newBlocks[i]) {
+            extents.back().length++;
+        } else {
+            extent e = {(uint32_t) blocks, (uint32_t) newBlocks[i], 1};
+            extents.push_back(e);
+        }
+        blocks++;
+    }
+    if (users > 0)
+        blockArray.insert(blockArray.end(), newBlocks, newBlocks + count);
+}
+
+void ExtentMap::truncate(int fileBlocks) {
+    if (fileBlocks >= blocks)
+        return;
+    while (!extents.empty() && extents.back().fileBlock >= (uint32_t) fileBlocks) {
+        extents.pop_back();
+    }
+    if (!extents.empty())
+        extents.back().length = fileBlocks - extents.back().fileBlock;
+    blocks = fileBlocks;
+    if (users > 0)
+        blockArray.resize(fileBlocks);
+}
+
+void ExtentMap::materialize() {
+    blockArray.clear();
+    blockArray.reserve(blocks);
+    for (const extent &e: extents) {
+        for (uint32_t i = 0; i < e.length; i++) {
+            blockArray.push_back(e.block + i);
+        }
+    }
+}
+
+void ExtentMap::open() {
+    if (users++ == 0)
+        materialize();
+}
+
+void ExtentMap::close() {
+    if (users > 0 && --users == 0) {
+        blockArray.clear();
+        blockArray.shrink_to_fit();
+    }
+}
+
+bool ExtentMap::isMaterialized() const {
+    return users > 0 && loaded;
+}
+
+size_t ExtentMap::serialize(char *buffer, size_t capacity) const {
+    extentHeader header = {0, 0};
+    size_t size = sizeof(header) + extents.size() * sizeof(extent);
+    if (capacity < sizeof(header))
+        return 0;
+    if (!loaded || size > capacity) {
+        memcpy(buffer, &header, sizeof(header));
+        return 0;
+    }
+    header.magic = EXTENT_MAGIC;
+    header.count = extents.size();
+    memcpy(buffer, &header, sizeof(header));
+    memcpy(buffer + sizeof(header), extents.data(), extents.size() * sizeof(extent));
+    return size;
+}
+
+bool ExtentMap::deserialize(const char *buffer, size_t capacity, int firstBlock, int fileBlocks,
+                            uint32_t numDataBlocks) {
+    extents.clear();
+    blocks = 0;
+    loaded = false;
+    extentHeader header;
+    if (capacity < sizeof(header))
+        return false;
+    memcpy(&header, buffer, sizeof(header));
+    if (header.magic != EXTENT_MAGIC || header.count > (capacity - sizeof(header)) / sizeof(extent))
+        return false;
+
+    std::vector<extent> table(header.count);
+    memcpy(table.data(), buffer + sizeof(header), header.count * sizeof(extent));
+    uint64_t next = 0;
+    for (const extent &e: table) {
+        // block 0 is never allocated, it ends the FAT chain
+        if (e.fileBlock != next || e.length == 0 || e.block == 0 || (uint64_t) e.block + e.length > numDataBlocks)
+            return false;
+        next += e.length;
+    }
+    if (next != (uint64_t) fileBlocks || (table.empty() ? firstBlock != FAT_END : (int) table[0].block != firstBlock))
+        return false;
+
+    extents.swap(table);
+    blocks = fileBlocks;
+    loaded = true;
+    return true;
+}
@@ -2,11 +2,57 @@
 // Created by user on 10.12.21.
 //
 #include <FAT.h>
+#include <algorithm>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// schreibt die Einträge einer 16-Bit-FAT als 2-Byte-Werte, acht auf einmal mit SSE2
+static void pack16(const int *entries, size_t count, char *out) {
+    size_t i = 0;
+#ifdef __SSE2__
+    // entries are below 65536, shifted into the signed range the saturating pack keeps them unchanged
+    const __m128i bias32 = _mm_set1_epi32(0x8000);
+    const __m128i bias16 = _mm_set1_epi16((short) 0x8000);
+    for (; i + 8 <= count; i += 8) {
+        __m128i low = _mm_sub_epi32(_mm_loadu_si128((const __m128i *) (entries + i)), bias32);
+        __m128i high = _mm_sub_epi32(_mm_loadu_si128((const __m128i *) (entries + i + 4)), bias32);
+        __m128i packed = _mm_xor_si128(_mm_packs_epi32(low, high), bias16);
+        _mm_storeu_si128((__m128i *) (out + i * FAT16_ENTRY_SIZE), packed);
+    }
+#endif
+    for (; i < count; i++) {
+        uint16_t entry = (uint16_t) entries[i];
+        memcpy(out + i * FAT16_ENTRY_SIZE, &entry, FAT16_ENTRY_SIZE);
+    }
+}
+
+// liest die 2-Byte-Werte einer 16-Bit-FAT in die Einträge, acht auf einmal mit SSE2
+static void unpack16(const char *in, size_t count, int *entries) {
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 8 <= count; i += 8) {
+        __m128i packed = _mm_loadu_si128((const __m128i *) (in + i * FAT16_ENTRY_SIZE));
+        _mm_storeu_si128((__m128i *) (entries + i), _mm_unpacklo_epi16(packed, _mm_setzero_si128()));
+        _mm_storeu_si128((__m128i *) (entries + i + 4), _mm_unpackhi_epi16(packed, _mm_setzero_si128()));
+    }
+#endif
+    for (; i < count; i++) {
+        uint16_t entry;
+        memcpy(&entry, in + i * FAT16_ENTRY_SIZE, FAT16_ENTRY_SIZE);
+        entries[i] = entry;
+    }
+}
 
 
 //Constructor FAT
-FAT::FAT(BlockDevice *device) {
+FAT::FAT(BlockStorage *device, SuperBlock *superBlock) {
     this->myDevice = device;
+    this->superBlock = superBlock;
+    this->deferred = false;
+    this->writtenBlocks = 0;
 }
 
 //Deconstructor FAT
@@ -23,6 +69,7 @@ int FAT::setNext(int blockNr, int nextBlockNr) {
 
     fatArray[blockNr] = nextBlockNr;
     discWrite(blockNr);
+    return 0;
 }
 
 void FAT::freeBlock(int blockNr) {
@@ -30,41 +77,106 @@ void FAT::freeBlock(int blockNr) {
     discWrite(blockNr);
 }
 
-// hier wird der Vänderte Eintrag im Array auch auf den Datenspeichr geschrieben
-void FAT::discWrite(int blockNr) {
-    char buffer[BLOCK_SIZE];
-    int blockOnDevice = blockNr / 256;
-    int NrInBlock = blockNr % 256;
-    int firstAddressInBlock = blockNr - NrInBlock;
-    char firstHalf;
-    char secondHalf;
-
-    for (int i = 0; i < 256; i++) {
-        int currentAddress = fatArray[firstAddressInBlock + i];
-        firstHalf = currentAddress & 0xFF;
-        secondHalf = ((currentAddress) >> 8) & 0xFF;
-        buffer[i * 2] = firstHalf;
-        buffer[i * 2 + 1] = secondHalf;
+int FAT::entriesPerBlock() {
+    return superBlock->getBlockSize() / superBlock->getFatEntrySize();
+}
 
+// hier wird der Vänderte Eintrag im Array auch auf den Datenspeichr geschrieben, oder sein Block nur als geändert
+// markiert, bis flush() aufgerufen wird
+void FAT::discWrite(int blockNr) {
+    int fatBlock = blockNr / entriesPerBlock();
+    if (deferred) {
+        dirtyBlocks.insert(fatBlock);
+        return;
     }
-    myDevice->write(blockOnDevice, buffer);
+    BlockBuffer block(myDevice->getBufferPool());
+    serialize(fatBlock, block.data());
+    myDevice->write(superBlock->getFatOffset() + fatBlock, block.data());
+    writtenBlocks++;
+}
 
+// schreibt die Einträge eines FAT-Blocks in buffer, der ganze Block auf einmal
+void FAT::serialize(int fatBlock, char *buffer) {
+    uint32_t blockSize = superBlock->getBlockSize();
+    uint32_t entrySize = superBlock->getFatEntrySize();
+    size_t first = (size_t) fatBlock * entriesPerBlock();
+    size_t count = first < fatArray.size() ? std::min<size_t>(entriesPerBlock(), fatArray.size() - first) : 0;
+    if (entrySize == FAT32_ENTRY_SIZE)
+        memcpy(buffer, fatArray.data() + first, count * FAT32_ENTRY_SIZE);
+    else
+        pack16(fatArray.data() + first, count, buffer);
+    memset(buffer + count * entrySize, 0, blockSize - count * entrySize);
 }
 
-// die FAT wird koplett aus dem Block Device gelesen und in das Array gepackt.
-void FAT::init() {
-    char buffer[BLOCK_SIZE];
-    for (int i = 0; i < FAT_SIZE; i++) {
-        myDevice->read(i, buffer);
-        for (int j = 0; j < 256; j++) {
-            int address = 0;
-            std::memcpy(&address, buffer + j * 2, 2);
-            fatArray[j + i * 256] = address;
-        }
+void FAT::setDeferred(bool deferred) {
+    this->deferred = deferred;
+    if (!deferred)
+        flush();
+}
 
+// this method returns 0 if successful, -errno otherwise
+int FAT::flush() {
+    if (dirtyBlocks.empty())
+        return 0;
+    uint32_t blockSize = superBlock->getBlockSize();
+    BlockBuffer buffer(myDevice->getBufferPool(), dirtyBlocks.size());
+    std::vector<BlockRequest> requests;
+    for (int fatBlock: dirtyBlocks) {
+        BlockRequest request;
+        request.blockNo = superBlock->getFatOffset() + fatBlock;
+        request.buffer = buffer.data() + requests.size() * blockSize;
+        serialize(fatBlock, request.buffer);
+        requests.push_back(request);
     }
+    dirtyBlocks.clear();
+    writtenBlocks += requests.size();
+    return myDevice->writeBlocks(requests.data(), requests.size());
 }
 
+size_t FAT::getDirtyBlocks() {
+    return dirtyBlocks.size();
+}
 
+uint64_t FAT::getWrittenBlocks() {
+    return writtenBlocks;
+}
 
+// die FAT wird koplett aus dem Block Device gelesen und in das Array gepackt.
+void FAT::init() {
+    // all FAT blocks are read with one vectored request
+    uint32_t blockSize = superBlock->getBlockSize();
+    int fatSize = superBlock->getFatSize();
+    BlockBuffer buffer(myDevice->getBufferPool(), fatSize);
+    std::vector<BlockRequest> requests(fatSize);
+    for (int i = 0; i < fatSize; i++) {
+        requests[i].blockNo = superBlock->getFatOffset() + i;
+        requests[i].buffer = buffer.data() + (size_t) i * blockSize;
+    }
+    myDevice->readBlocks(requests.data(), fatSize);
+
+    dirtyBlocks.clear();
+    fatArray.assign(superBlock->getNumDataBlocks(), FAT_END);
+    if (superBlock->getFatEntrySize() == FAT32_ENTRY_SIZE)
+        memcpy(fatArray.data(), buffer.data(), fatArray.size() * FAT32_ENTRY_SIZE);
+    else
+        unpack16(buffer.data(), fatArray.size(), fatArray.data());
+}
 
+// eine neue, leere FAT wird angelegt und geschrieben
+void FAT::firstInit() {
+    uint32_t blockSize = superBlock->getBlockSize();
+    int fatSize = superBlock->getFatSize();
+    fatArray.assign(superBlock->getNumDataBlocks(), FAT_END);
+    dirtyBlocks.clear();
+    // an empty FAT is all zeros (FAT_END), a hole in the container is enough
+    if (myDevice->discard(superBlock->getFatOffset(), fatSize) == 0)
+        return;
+    BlockBuffer buffer(myDevice->getBufferPool(), fatSize);
+    memset(buffer.data(), 0, (size_t) fatSize * blockSize);
+    std::vector<BlockRequest> requests(fatSize);
+    for (int i = 0; i < fatSize; i++) {
+        requests[i].blockNo = superBlock->getFatOffset() + i;
+        requests[i].buffer = buffer.data() + (size_t) i * blockSize;
+    }
+    myDevice->writeBlocks(requests.data(), fatSize);
+}
@@ -0,0 +1,224 @@
+//
+// Created by user on 17.10.26.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include "IoScheduler.h"
+
+IoScheduler::IoScheduler(BlockStorage *device, size_t maxPending) {
+    this->device = device;
+    this->maxPending = maxPending;
+    this->batchDepth = 0;
+    this->dispatchError = 0;
+    this->queuedWrites = 0;
+    this->absorbedWrites = 0;
+    this->deviceWrites = 0;
+    this->dispatches = 0;
+}
+
+IoScheduler::~IoScheduler() {
+    dispatch();
+}
+
+void IoScheduler::begin() {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    batchDepth++;
+}
+
+int IoScheduler::end() {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    if (batchDepth > 0 && --batchDepth == 0) {
+        int ret = dispatchLocked();
+        if (ret < 0 && dispatchError == 0)
+            dispatchError = ret;
+        return ret;
+    }
+    return 0;
+}
+
+int IoScheduler::dispatch() {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    int ret = dispatchLocked();
+    if (ret == 0)
+        ret = dispatchError;
+    dispatchError = 0;
+    return ret;
+}
+
+// one sweep over the queue in ascending block order, the device merges adjacent blocks into one request
+int IoScheduler::dispatchLocked() {
+    if (pending.empty())
+        return 0;
+
+    std::vector<BlockRequest> requests;
+    requests.reserve(pending.size());
+    for (auto const &it: pending)
+        requests.push_back({it.first, it.second});
+    int ret = device->writeBlocks(requests.data(), requests.size());
+    deviceWrites += requests.size();
+    dispatches++;
+
+    for (auto const &it: pending)
+        device->getBufferPool()->put(it.second);
+    pending.clear();
+    return ret;
+}
+
+int IoScheduler::open(const char *path) {
+    return device->open(path);
+}
+
+int IoScheduler::create(const char *path) {
+    return device->create(path);
+}
+
+int IoScheduler::close() {
+    int ret = dispatch();
+    int err = device->close();
+    return ret < 0 ? ret : err;
+}
+
+int IoScheduler::sync() {
+    int ret = dispatch();
+    int err = device->sync();
+    return ret < 0 ? ret : err;
+}
+
+// copies the block into the queue, replacing an older queued copy
+int IoScheduler::queue(uint32_t blockNo, const char *buffer) {
+    queuedWrites++;
+    auto it = pending.find(blockNo);
+    if (it != pending.end()) {
+        absorbedWrites++;
+        memcpy(it->second, buffer, device->getBlockSize());
+        return 0;
+    }
+
+    char *copy = device->getBufferPool()->get();
+    if (copy == nullptr)
+        return -ENOMEM;
+    memcpy(copy, buffer, device->getBlockSize());
+    pending[blockNo] = copy;
+    return 0;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int IoScheduler::read(uint32_t blockNo, char *buffer) {
+    BlockRequest request = {blockNo, buffer};
+    return readBlocks(&request, 1);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int IoScheduler::write(uint32_t blockNo, char *buffer) {
+    BlockRequest request = {blockNo, buffer};
+    return writeBlocks(&request, 1);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int IoScheduler::readBlocks(const BlockRequest *requests, size_t count) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    if (pending.empty())
+        return device->readBlocks(requests, count);
+
+    std::vector<BlockRequest> missed;
+    for (size_t i = 0; i < count; i++) {
+        auto it = pending.find(requests[i].blockNo);
+        if (it != pending.end())
+            memcpy(requests[i].buffer, it->second, device->getBlockSize());
+        else
+            missed.push_back(requests[i]);
+    }
+    return missed.empty() ? 0 : device->readBlocks(missed.data(), missed.size());
+}
+
+// this method returns 0 if successful, -errno otherwise
+int IoScheduler::writeBlocks(const BlockRequest *requests, size_t count) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    if (batchDepth > 0 && count < IO_SCHEDULER_DIRECT_BLOCKS) {
+        for (size_t i = 0; i < count; i++) {
+            int ret = queue(requests[i].blockNo, requests[i].buffer);
+            if (ret < 0)
+                return ret;
+        }
+        return pending.size() >= maxPending ? dispatchLocked() : 0;
+    }
+
+    // large requests and writes outside of a batch are not copied, queued older copies of their blocks are stale
+    std::vector<BlockRequest> sorted(requests, requests + count);
+    std::stable_sort(sorted.begin(), sorted.end(), [](const BlockRequest &a, const BlockRequest &b) {
+        return a.blockNo < b.blockNo;
+    });
+    size_t unique = 0;
+    for (size_t i = 0; i < sorted.size(); i++) {
+        auto it = pending.find(sorted[i].blockNo);
+        if (it != pending.end()) {
+            device->getBufferPool()->put(it->second);
+            pending.erase(it);
+        }
+        if (unique > 0 && sorted[unique - 1].blockNo == sorted[i].blockNo) {
+            // the later write of a block wins
+            absorbedWrites++;
+            sorted[unique - 1] = sorted[i];
+        } else {
+            sorted[unique++] = sorted[i];
+        }
+    }
+    queuedWrites += count;
+    deviceWrites += unique;
+    dispatches++;
+    return device->writeBlocks(sorted.data(), unique);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int IoScheduler::discard(uint32_t firstBlock, uint32_t count) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    // queued copies of discarded blocks must not reach the device afterwards
+    auto first = pending.lower_bound(firstBlock);
+    auto last = count > UINT32_MAX - firstBlock ? pending.end() : pending.lower_bound(firstBlock + count);
+    for (auto it = first; it != last; ++it)
+        device->getBufferPool()->put(it->second);
+    pending.erase(first, last);
+    return device->discard(firstBlock, count);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int IoScheduler::preallocate(uint32_t firstBlock, uint32_t count) {
+    return device->preallocate(firstBlock, count);
+}
+
+void IoScheduler::setBlockSize(uint32_t blockSize) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    dispatchLocked();
+    device->setBlockSize(blockSize);
+}
+
+BufferPool *IoScheduler::getBufferPool() {
+    return device->getBufferPool();
+}
+
+uint32_t IoScheduler::getBlockSize() {
+    return device->getBlockSize();
+}
+
+uint64_t IoScheduler::getQueuedWrites() {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    return queuedWrites;
+}
+
+uint64_t IoScheduler::getAbsorbedWrites() {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    return absorbedWrites;
+}
+
+uint64_t IoScheduler::getDeviceWrites() {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    return deviceWrites;
+}
+
+uint64_t IoScheduler::getDispatches() {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    return dispatches;
+}
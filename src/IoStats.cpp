@@ -0,0 +1,157 @@
+//
+// Created by user on 17.10.26.
+//
+
+#include <chrono>
+#include <cmath>
+#include "IoStats.h"
+
+static const char *opNames[STATS_OPS] = {"read", "write", "sync"};
+
+// writes a duration with a unit that keeps it short
+static const char *formatNs(uint64_t ns, char *text, size_t size) {
+    if (ns < 10000)
+        snprintf(text, size, "%lu ns", (unsigned long) ns);
+    else if (ns < 10000000)
+        snprintf(text, size, "%lu us", (unsigned long) (ns / 1000));
+    else
+        snprintf(text, size, "%lu ms", (unsigned long) (ns / 1000000));
+    return text;
+}
+
+uint64_t IoOpStats::percentileNs(double fraction) const {
+    uint64_t wanted = (uint64_t) std::ceil(fraction * calls);
+    uint64_t seen = 0;
+    for (int i = 0; i < IO_STATS_BUCKETS; i++) {
+        seen += histogram[i];
+        if (seen > 0 && seen >= wanted)
+            return (uint64_t) 2 << i;
+    }
+    return 0;
+}
+
+IoStats::IoStats() {
+    reset();
+}
+
+IoStats::~IoStats() {
+
+}
+
+uint64_t IoStats::now() {
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int IoStats::bucket(uint64_t durationNs) {
+    int i = 0;
+    while (durationNs > 1 && i < IO_STATS_BUCKETS - 1) {
+        durationNs >>= 1;
+        i++;
+    }
+    return i;
+}
+
+void IoStats::count(IoStatsOp op, uint64_t durationNs) {
+    Counters &c = counters[op];
+    c.calls.fetch_add(1, std::memory_order_relaxed);
+    c.totalNs.fetch_add(durationNs, std::memory_order_relaxed);
+    c.histogram[bucket(durationNs)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void IoStats::record(IoStatsOp op, const BlockRequest *requests, size_t count, uint32_t blockSize, uint64_t startNs) {
+    uint64_t durationNs = now() - startNs;
+    Counters &c = counters[op];
+    this->count(op, durationNs);
+    c.blocks.fetch_add(count, std::memory_order_relaxed);
+    c.bytes.fetch_add((uint64_t) count * blockSize, std::memory_order_relaxed);
+
+    // concurrent calls may see the same previous run, that only blurs the classification
+    uint64_t expected = nextBlock.load(std::memory_order_relaxed);
+    uint64_t sequentialRuns = 0;
+    uint64_t randomRuns = 0;
+    uint64_t seekDistance = 0;
+    size_t start = 0;
+    for (size_t i = 1; i <= count; i++) {
+        if (i == count || requests[i].blockNo != requests[i - 1].blockNo + 1) {
+            uint64_t first = requests[start].blockNo;
+            uint64_t distance = first > expected ? first - expected : expected - first;
+            if (distance <= IO_STATS_SEQUENTIAL_DISTANCE)
+                sequentialRuns++;
+            else
+                randomRuns++;
+            seekDistance += distance;
+            expected = (uint64_t) requests[i - 1].blockNo + 1;
+            start = i;
+        }
+    }
+    nextBlock.store(expected, std::memory_order_relaxed);
+    c.sequentialRuns.fetch_add(sequentialRuns, std::memory_order_relaxed);
+    c.randomRuns.fetch_add(randomRuns, std::memory_order_relaxed);
+    c.seekDistance.fetch_add(seekDistance, std::memory_order_relaxed);
+}
+
+void IoStats::record(IoStatsOp op, uint64_t startNs) {
+    count(op, now() - startNs);
+}
+
+IoOpStats IoStats::get(IoStatsOp op) {
+    Counters &c = counters[op];
+    IoOpStats stats;
+    stats.calls = c.calls.load(std::memory_order_relaxed);
+    stats.blocks = c.blocks.load(std::memory_order_relaxed);
+    stats.bytes = c.bytes.load(std::memory_order_relaxed);
+    stats.sequentialRuns = c.sequentialRuns.load(std::memory_order_relaxed);
+    stats.randomRuns = c.randomRuns.load(std::memory_order_relaxed);
+    stats.seekDistance = c.seekDistance.load(std::memory_order_relaxed);
+    stats.totalNs = c.totalNs.load(std::memory_order_relaxed);
+    for (int i = 0; i < IO_STATS_BUCKETS; i++)
+        stats.histogram[i] = c.histogram[i].load(std::memory_order_relaxed);
+    return stats;
+}
+
+void IoStats::reset() {
+    for (int op = 0; op < STATS_OPS; op++) {
+        Counters &c = counters[op];
+        c.calls.store(0, std::memory_order_relaxed);
+        c.blocks.store(0, std::memory_order_relaxed);
+        c.bytes.store(0, std::memory_order_relaxed);
+        c.sequentialRuns.store(0, std::memory_order_relaxed);
+        c.randomRuns.store(0, std::memory_order_relaxed);
+        c.seekDistance.store(0, std::memory_order_relaxed);
+        c.totalNs.store(0, std::memory_order_relaxed);
+        for (int i = 0; i < IO_STATS_BUCKETS; i++)
+            c.histogram[i].store(0, std::memory_order_relaxed);
+    }
+    nextBlock.store(0, std::memory_order_relaxed);
+}
+
+void IoStats::dump(FILE *file, const char *name) {
+    char p50[32];
+    char p99[32];
+    char bound[32];
+    for (int op = 0; op < STATS_OPS; op++) {
+        IoOpStats stats = get((IoStatsOp) op);
+        if (stats.calls == 0)
+            continue;
+        fprintf(file, "\t%s %s: %lu calls, %.3f ms, mean %.1f us, 50%% < %s, 99%% < %s", name, opNames[op],
+                (unsigned long) stats.calls, stats.totalNs / 1e6, stats.totalNs / 1e3 / stats.calls,
+                formatNs(stats.percentileNs(0.5), p50, sizeof(p50)),
+                formatNs(stats.percentileNs(0.99), p99, sizeof(p99)));
+        if (op != STATS_SYNC) {
+            fprintf(file, ", %lu blocks (%.1f MiB), %lu sequential and %lu random runs, seek distance %lu blocks",
+                    (unsigned long) stats.blocks, stats.bytes / 1048576.0, (unsigned long) stats.sequentialRuns,
+                    (unsigned long) stats.randomRuns, (unsigned long) stats.seekDistance);
+        }
+        fprintf(file, "\n\t%s %s latency:", name, opNames[op]);
+        const char *separator = " ";
+        for (int i = 0; i < IO_STATS_BUCKETS; i++) {
+            if (stats.histogram[i] > 0) {
+                fprintf(file, "%s< %s: %lu", separator, formatNs((uint64_t) 2 << i, bound, sizeof(bound)),
+                        (unsigned long) stats.histogram[i]);
+                separator = ", ";
+            }
+        }
+        fprintf(file, "\n");
+    }
+}
@@ -0,0 +1,171 @@
+//
+// Created by user on 17.10.26.
+//
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "IoTracer.h"
+
+IoTracer::IoTracer() {
+    this->traceFile = -1;
+    this->startNs = 0;
+    this->records = 0;
+    this->error = 0;
+}
+
+IoTracer::~IoTracer() {
+    close();
+}
+
+uint64_t IoTracer::now() {
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int IoTracer::open(const char *path, uint32_t blockSize) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (this->traceFile >= 0)
+        return -EBUSY;
+    int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0)
+        return -errno;
+
+    IoTraceHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, IO_TRACE_MAGIC, sizeof(IO_TRACE_MAGIC));
+    header.version = IO_TRACE_VERSION;
+    header.blockSize = blockSize;
+    if (::write(fd, &header, sizeof(header)) != (ssize_t) sizeof(header)) {
+        int ret = errno != 0 ? -errno : -EIO;
+        ::close(fd);
+        return ret;
+    }
+
+    this->traceFile = fd;
+    this->buffer.reserve(IO_TRACE_BUFFER_RECORDS);
+    this->startNs = now();
+    this->records = 0;
+    this->error = 0;
+    return 0;
+}
+
+int IoTracer::close() {
+    std::lock_guard<std::mutex> guard(lock);
+    if (this->traceFile < 0)
+        return 0;
+    flushBuffer();
+    if (::close(this->traceFile) < 0 && this->error == 0)
+        this->error = -errno;
+    this->traceFile = -1;
+    return this->error;
+}
+
+// writes the buffered records, the first error is kept and reported by close()
+int IoTracer::flushBuffer() {
+    const char *data = (const char *) buffer.data();
+    size_t size = buffer.size() * sizeof(IoTraceRecord);
+    while (size > 0 && this->error == 0) {
+        ssize_t n = ::write(this->traceFile, data, size);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            this->error = -errno;
+            break;
+        }
+        data += n;
+        size -= n;
+    }
+    buffer.clear();
+    return this->error;
+}
+
+void IoTracer::record(IoTraceOp op, const BlockRequest *requests, size_t count, uint64_t startNs) {
+    uint64_t endNs = now();
+    std::lock_guard<std::mutex> guard(lock);
+    if (this->traceFile < 0)
+        return;
+
+    IoTraceRecord record;
+    memset(&record, 0, sizeof(record));
+    record.timestampNs = startNs - this->startNs;
+    record.durationNs = endNs - startNs > UINT32_MAX ? UINT32_MAX : (uint32_t) (endNs - startNs);
+
+    size_t start = 0;
+    while (start < count) {
+        size_t end = start + 1;
+        while (end < count && requests[end].blockNo == requests[end - 1].blockNo + 1)
+            end++;
+
+        record.op = start == 0 ? op : op | TRACE_CONTINUED;
+        record.blockNo = requests[start].blockNo;
+        record.blocks = end - start;
+        buffer.push_back(record);
+        this->records++;
+        if (buffer.size() >= IO_TRACE_BUFFER_RECORDS)
+            flushBuffer();
+        start = end;
+    }
+}
+
+void IoTracer::record(IoTraceOp op, uint32_t value, uint64_t startNs) {
+    uint64_t endNs = now();
+    std::lock_guard<std::mutex> guard(lock);
+    if (this->traceFile < 0)
+        return;
+
+    IoTraceRecord record;
+    memset(&record, 0, sizeof(record));
+    record.timestampNs = startNs - this->startNs;
+    record.durationNs = endNs - startNs > UINT32_MAX ? UINT32_MAX : (uint32_t) (endNs - startNs);
+    record.op = op;
+    record.blockNo = value;
+    buffer.push_back(record);
+    this->records++;
+    if (buffer.size() >= IO_TRACE_BUFFER_RECORDS)
+        flushBuffer();
+}
+
+uint64_t IoTracer::getRecords() {
+    std::lock_guard<std::mutex> guard(lock);
+    return this->records;
+}
+
+int IoTracer::load(const char *path, IoTraceHeader *header, std::vector<IoTraceRecord> *records) {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return -errno;
+
+    int ret = 0;
+    if (::read(fd, header, sizeof(*header)) != (ssize_t) sizeof(*header) ||
+        memcmp(header->magic, IO_TRACE_MAGIC, sizeof(IO_TRACE_MAGIC)) != 0 || header->version != IO_TRACE_VERSION) {
+        ret = -EINVAL;
+    }
+
+    records->clear();
+    std::vector<IoTraceRecord> chunk(IO_TRACE_BUFFER_RECORDS);
+    size_t chunkSize = chunk.size() * sizeof(IoTraceRecord);
+    size_t partial = 0;
+    while (ret == 0) {
+        ssize_t n = ::read(fd, (char *) chunk.data() + partial, chunkSize - partial);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            ret = -errno;
+            break;
+        }
+        if (n == 0)
+            break;
+        partial += n;
+        size_t complete = partial / sizeof(IoTraceRecord);
+        records->insert(records->end(), chunk.begin(), chunk.begin() + complete);
+        partial -= complete * sizeof(IoTraceRecord);
+        memmove(chunk.data(), chunk.data() + complete, partial);
+    }
+    // a truncated last record (e.g. after a crash) is ignored
+
+    ::close(fd);
+    return ret;
+}
@@ -0,0 +1,178 @@
+//
+// Created by user on 17.10.26.
+//
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "IoUring.h"
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#endif
+
+IoUring::IoUring() {
+    ringFd = -1;
+    sqEntries = 0;
+    cqEntries = 0;
+    sqRing = cqRing = sqes = MAP_FAILED;
+    sqRingSize = cqRingSize = sqesSize = 0;
+    toSubmit = 0;
+}
+
+IoUring::~IoUring() {
+    close();
+}
+
+#ifdef __linux__
+
+int IoUring::init(unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    int fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0)
+        return -errno;
+    ringFd = fd;
+    sqEntries = params.sq_entries;
+    cqEntries = params.cq_entries;
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (cqRingSize > sqRingSize)
+            sqRingSize = cqRingSize;
+        cqRingSize = sqRingSize;
+    }
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        int ret = -errno;
+        close();
+        return ret;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cqRing = sqRing;
+    } else {
+        cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+                      IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) {
+            int ret = -errno;
+            close();
+            return ret;
+        }
+    }
+    sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        int ret = -errno;
+        close();
+        return ret;
+    }
+
+    char *sq = (char *) sqRing;
+    sqHead = (unsigned *) (sq + params.sq_off.head);
+    sqTail = (unsigned *) (sq + params.sq_off.tail);
+    sqMask = (unsigned *) (sq + params.sq_off.ring_mask);
+    sqArray = (unsigned *) (sq + params.sq_off.array);
+
+    char *cq = (char *) cqRing;
+    cqHead = (unsigned *) (cq + params.cq_off.head);
+    cqTail = (unsigned *) (cq + params.cq_off.tail);
+    cqMask = (unsigned *) (cq + params.cq_off.ring_mask);
+    cqes = cq + params.cq_off.cqes;
+
+    return 0;
+}
+
+void IoUring::close() {
+    if (sqes != MAP_FAILED)
+        munmap(sqes, sqesSize);
+    if (cqRing != MAP_FAILED && cqRing != sqRing)
+        munmap(cqRing, cqRingSize);
+    if (sqRing != MAP_FAILED)
+        munmap(sqRing, sqRingSize);
+    sqRing = cqRing = sqes = MAP_FAILED;
+
+    if (ringFd >= 0)
+        ::close(ringFd);
+    ringFd = -1;
+    sqEntries = 0;
+    toSubmit = 0;
+}
+
+bool IoUring::prepare(bool doWrite, int fd, const struct iovec *iov, unsigned iovCount, off_t offset,
+                      uint64_t userData) {
+    unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    unsigned tail = *sqTail;
+    if (tail - head >= sqEntries)
+        return false;
+
+    unsigned index = tail & *sqMask;
+    struct io_uring_sqe *sqe = ((struct io_uring_sqe *) sqes) + index;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = doWrite ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t) (uintptr_t) iov;
+    sqe->len = iovCount;
+    sqe->off = (uint64_t) offset;
+    sqe->user_data = userData;
+
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    toSubmit++;
+    return true;
+}
+
+int IoUring::submit(unsigned waitNr) {
+    while (true) {
+        int n = (int) syscall(__NR_io_uring_enter, ringFd, toSubmit, waitNr,
+                              waitNr > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        toSubmit -= (unsigned) n;
+        return 0;
+    }
+}
+
+bool IoUring::popCompletion(uint64_t *userData, int *res) {
+    unsigned head = *cqHead;
+    if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+        return false;
+
+    struct io_uring_cqe *cqe = ((struct io_uring_cqe *) cqes) + (head & *cqMask);
+    *userData = cqe->user_data;
+    *res = cqe->res;
+    __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+#else
+
+int IoUring::init(unsigned entries) {
+    return -ENOSYS;
+}
+
+void IoUring::close() {
+}
+
+bool IoUring::prepare(bool doWrite, int fd, const struct iovec *iov, unsigned iovCount, off_t offset,
+                      uint64_t userData) {
+    return false;
+}
+
+int IoUring::submit(unsigned waitNr) {
+    return -ENOSYS;
+}
+
+bool IoUring::popCompletion(uint64_t *userData, int *res) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,168 @@
+//
+// Created by user on 17.10.26.
+//
+
+#include <cerrno>
+#include <cstring>
+#include "Lz4.h"
+
+static inline uint32_t read32(const uint8_t *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+// writes the part of a length that does not fit into the 4 bit field of the token
+static inline uint8_t *writeLength(uint8_t *out, size_t length) {
+    while (length >= 255) {
+        *out++ = 255;
+        length -= 255;
+    }
+    *out++ = (uint8_t) length;
+    return out;
+}
+
+// reads the rest of a length whose 4 bit field is 15, returns false at the end of the input
+static inline bool readLength(const uint8_t *in, size_t srcSize, size_t *ip, size_t *length) {
+    uint8_t byte;
+    do {
+        if (*ip >= srcSize)
+            return false;
+        byte = in[(*ip)++];
+        *length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+size_t Lz4::compressBound(size_t srcSize) {
+    return srcSize + srcSize / 255 + 16;
+}
+
+// this method returns the compressed size if successful, -errno otherwise
+int Lz4::compress(const char *src, size_t srcSize, char *dst, size_t dstCapacity) {
+    const uint8_t *in = (const uint8_t *) src;
+    uint8_t *out = (uint8_t *) dst;
+    uint8_t *outEnd = out + dstCapacity;
+    size_t anchor = 0;
+
+    if (srcSize > LZ4_MATCH_LIMIT) {
+        uint32_t table[1 << LZ4_HASH_BITS];
+        memset(table, 0, sizeof(table));
+        size_t matchEnd = srcSize - LZ4_LAST_LITERALS;
+        size_t pos = 1;
+
+        while (pos + LZ4_MATCH_LIMIT <= srcSize) {
+            uint32_t sequence = read32(in + pos);
+            uint32_t h = hash(sequence);
+            size_t candidate = table[h];
+            table[h] = (uint32_t) pos;
+            if (pos - candidate > LZ4_MAX_OFFSET || read32(in + candidate) != sequence) {
+                // the longer no match is found, the larger the steps
+                pos += 1 + ((pos - anchor) >> 6);
+                continue;
+            }
+
+            while (pos > anchor && candidate > 0 && in[pos - 1] == in[candidate - 1]) {
+                pos--;
+                candidate--;
+            }
+            size_t length = LZ4_MIN_MATCH;
+            while (pos + length < matchEnd && in[candidate + length] == in[pos + length])
+                length++;
+
+            size_t literals = pos - anchor;
+            if ((size_t) (outEnd - out) < 1 + literals / 255 + 1 + literals + 2 + length / 255 + 1)
+                return -ENOSPC;
+            uint8_t *token = out++;
+            if (literals >= 15) {
+                *token = 15 << 4;
+                out = writeLength(out, literals - 15);
+            } else {
+                *token = (uint8_t) (literals << 4);
+            }
+            memcpy(out, in + anchor, literals);
+            out += literals;
+            uint16_t offset = (uint16_t) (pos - candidate);
+            *out++ = offset & 0xFF;
+            *out++ = offset >> 8;
+            if (length - LZ4_MIN_MATCH >= 15) {
+                *token |= 15;
+                out = writeLength(out, length - LZ4_MIN_MATCH - 15);
+            } else {
+                *token |= (uint8_t) (length - LZ4_MIN_MATCH);
+            }
+
+            pos += length;
+            anchor = pos;
+            if (pos + LZ4_MATCH_LIMIT <= srcSize)
+                table[hash(read32(in + pos - 2))] = (uint32_t) (pos - 2);
+        }
+    }
+
+    // the last sequence only has literals
+    size_t literals = srcSize - anchor;
+    if ((size_t) (outEnd - out) < 1 + literals / 255 + 1 + literals)
+        return -ENOSPC;
+    if (literals >= 15) {
+        *out++ = 15 << 4;
+        out = writeLength(out, literals - 15);
+    } else {
+        *out++ = (uint8_t) (literals << 4);
+    }
+    memcpy(out, in + anchor, literals);
+    out += literals;
+    return (int) (out - (uint8_t *) dst);
+}
+
+// this method returns the decompressed size if successful, -errno otherwise
+int Lz4::decompress(const char *src, size_t srcSize, char *dst, size_t dstCapacity) {
+    const uint8_t *in = (const uint8_t *) src;
+    uint8_t *out = (uint8_t *) dst;
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (true) {
+        if (ip >= srcSize)
+            return -EINVAL;
+        uint8_t token = in[ip++];
+
+        size_t literals = token >> 4;
+        if (literals == 15 && !readLength(in, srcSize, &ip, &literals))
+            return -EINVAL;
+        if (literals > srcSize - ip || literals > dstCapacity - op)
+            return -EINVAL;
+        memcpy(out + op, in + ip, literals);
+        ip += literals;
+        op += literals;
+        if (ip == srcSize)
+            break;
+
+        if (srcSize - ip < 2)
+            return -EINVAL;
+        size_t offset = in[ip] | (in[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op)
+            return -EINVAL;
+        size_t length = token & 15;
+        if (length == 15 && !readLength(in, srcSize, &ip, &length))
+            return -EINVAL;
+        length += LZ4_MIN_MATCH;
+        if (length > dstCapacity - op)
+            return -EINVAL;
+
+        // the match may overlap the bytes it produces
+        const uint8_t *match = out + op - offset;
+        if (offset >= length) {
+            memcpy(out + op, match, length);
+        } else {
+            for (size_t i = 0; i < length; i++)
+                out[op + i] = match[i];
+        }
+        op += length;
+    }
+    return (int) op;
+}
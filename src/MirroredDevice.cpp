@@ -0,0 +1,245 @@
+//
+// Created by user on 17.10.26.
+//
+
+#include <algorithm>
+#include <cstring>
+#include "MirroredDevice.h"
+
+MirroredDevice::MirroredDevice(const std::vector<BlockStorage *> &members, MirrorPolicy policy) : MultiDevice(members) {
+    this->policy = policy;
+    this->sequence = 0;
+    MemberState initial;
+    memset(&initial, 0, sizeof(initial));
+    this->state.assign(members.size(), initial);
+}
+
+MirroredDevice::~MirroredDevice() {
+
+}
+
+bool MirroredDevice::parsePolicy(const char *spec, MirrorPolicy *policy) {
+    if (spec == nullptr)
+        return false;
+    if (strcmp(spec, "queue") == 0) {
+        *policy = MIRROR_READ_QUEUE;
+    } else if (strcmp(spec, "locality") == 0) {
+        *policy = MIRROR_READ_LOCALITY;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int MirroredDevice::read(uint32_t blockNo, char *buffer) {
+    BlockRequest request = {blockNo, buffer};
+    return transferRead(&request, 1);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int MirroredDevice::write(uint32_t blockNo, char *buffer) {
+    BlockRequest request = {blockNo, buffer};
+    return transferWrite(&request, 1);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int MirroredDevice::readBlocks(const BlockRequest *requests, size_t count) {
+    return transferRead(requests, count);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int MirroredDevice::writeBlocks(const BlockRequest *requests, size_t count) {
+    return transferWrite(requests, count);
+}
+
+// the member with the fewest blocks in flight that is not taken yet, the one unused for the longest time on a tie
+size_t MirroredDevice::leastLoaded(const std::vector<bool> &taken) {
+    size_t best = members.size();
+    for (size_t i = 0; i < members.size(); i++) {
+        if (taken[i])
+            continue;
+        if (best == members.size() || state[i].pendingBlocks < state[best].pendingBlocks ||
+            (state[i].pendingBlocks == state[best].pendingBlocks && state[i].lastUse < state[best].lastUse))
+            best = i;
+    }
+    return best;
+}
+
+// the member whose position is closest to the block; reads far from all members go to the least loaded one
+size_t MirroredDevice::nearest(uint32_t blockNo) {
+    size_t best = 0;
+    uint32_t bestDistance = UINT32_MAX;
+    for (size_t i = 0; i < members.size(); i++) {
+        uint32_t head = state[i].headPosition;
+        uint32_t distance = blockNo > head ? blockNo - head : head - blockNo;
+        if (distance < bestDistance) {
+            best = i;
+            bestDistance = distance;
+        }
+    }
+    if (bestDistance <= MIRROR_NEAR_BLOCKS)
+        return best;
+    return leastLoaded(std::vector<bool>(members.size(), false));
+}
+
+// assigns the blocks to members by the read policy and reads all parts in parallel
+int MirroredDevice::transferRead(const BlockRequest *requests, size_t count) {
+    if (count == 0)
+        return 0;
+
+    std::vector<Job> jobs(members.size());
+    size_t involved = 0;
+    size_t last = 0;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (policy == MIRROR_READ_QUEUE) {
+            // large reads are cut into one contiguous chunk per member
+            size_t chunks = count >= MIRROR_SPLIT_BLOCKS ? members.size() : 1;
+            size_t chunkSize = (count + chunks - 1) / chunks;
+            std::vector<bool> taken(members.size(), false);
+            for (size_t start = 0; start < count; start += chunkSize) {
+                size_t member = leastLoaded(taken);
+                taken[member] = true;
+                size_t end = std::min(count, start + chunkSize);
+                jobs[member].requests.assign(requests + start, requests + end);
+            }
+        } else {
+            size_t start = 0;
+            while (start < count) {
+                size_t end = start + 1;
+                while (end < count && requests[end].blockNo == requests[end - 1].blockNo + 1)
+                    end++;
+                size_t member = nearest(requests[start].blockNo);
+                jobs[member].requests.insert(jobs[member].requests.end(), requests + start, requests + end);
+                state[member].headPosition = requests[end - 1].blockNo + 1;
+                state[member].lastUse = ++sequence;
+                start = end;
+            }
+        }
+
+        for (size_t i = 0; i < jobs.size(); i++) {
+            if (jobs[i].requests.empty())
+                continue;
+            involved++;
+            last = i;
+            state[i].pendingBlocks += jobs[i].requests.size();
+            state[i].reads++;
+            state[i].readBlocks += jobs[i].requests.size();
+            if (policy == MIRROR_READ_QUEUE) {
+                state[i].headPosition = jobs[i].requests.back().blockNo + 1;
+                state[i].lastUse = ++sequence;
+            }
+        }
+    }
+
+    int ret;
+    if (involved == 1) {
+        jobs[last].result = execute(last, MEMBER_READ, jobs[last].requests);
+        ret = jobs[last].result;
+    } else {
+        ret = run(jobs);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (size_t i = 0; i < jobs.size(); i++)
+            state[i].pendingBlocks -= jobs[i].requests.size();
+    }
+    if (ret < 0)
+        ret = failOver(jobs);
+    return ret;
+}
+
+// reads the blocks of every failed job from the other members, the least loaded first, until one of them succeeds
+int MirroredDevice::failOver(std::vector<Job> &jobs) {
+    int ret = 0;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (jobs[i].requests.empty() || jobs[i].result >= 0)
+            continue;
+        int result = jobs[i].result;
+        size_t blocks = jobs[i].requests.size();
+        std::vector<bool> tried(members.size(), false);
+        tried[i] = true;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            state[i].failedReads++;
+        }
+        while (result < 0) {
+            size_t member;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                member = leastLoaded(tried);
+                if (member == members.size())
+                    break;
+                tried[member] = true;
+                state[member].pendingBlocks += blocks;
+                state[member].reads++;
+                state[member].readBlocks += blocks;
+            }
+            result = execute(member, MEMBER_READ, jobs[i].requests);
+
+            std::lock_guard<std::mutex> guard(lock);
+            state[member].pendingBlocks -= blocks;
+            if (result < 0)
+                state[member].failedReads++;
+        }
+        if (result < 0 && ret == 0)
+            ret = result;
+    }
+    return ret;
+}
+
+// writes the same blocks to all members in parallel
+int MirroredDevice::transferWrite(const BlockRequest *requests, size_t count) {
+    if (count == 0)
+        return 0;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (size_t i = 0; i < state.size(); i++)
+            state[i].writtenBlocks += count;
+    }
+
+    std::vector<Job> jobs(members.size());
+    for (size_t i = 0; i < jobs.size(); i++) {
+        jobs[i].op = MEMBER_WRITE;
+        jobs[i].requests.assign(requests, requests + count);
+    }
+    if (members.size() == 1)
+        return execute(0, MEMBER_WRITE, jobs[0].requests);
+    return run(jobs);
+}
+
+MirrorPolicy MirroredDevice::getPolicy() {
+    return policy;
+}
+
+uint64_t MirroredDevice::getMemberReads(size_t member) {
+    std::lock_guard<std::mutex> guard(lock);
+    return state[member].reads;
+}
+
+uint64_t MirroredDevice::getMemberReadBlocks(size_t member) {
+    std::lock_guard<std::mutex> guard(lock);
+    return state[member].readBlocks;
+}
+
+uint64_t MirroredDevice::getMemberFailedReads(size_t member) {
+    std::lock_guard<std::mutex> guard(lock);
+    return state[member].failedReads;
+}
+
+uint64_t MirroredDevice::getMemberWrittenBlocks(size_t member) {
+    std::lock_guard<std::mutex> guard(lock);
+    return state[member].writtenBlocks;
+}
+
+void MirroredDevice::resetStats() {
+    std::lock_guard<std::mutex> guard(lock);
+    for (size_t i = 0; i < state.size(); i++) {
+        state[i].reads = 0;
+        state[i].readBlocks = 0;
+        state[i].failedReads = 0;
+        state[i].writtenBlocks = 0;
+    }
+}
@@ -0,0 +1,229 @@
+//
+// Created by user on 17.10.26.
+//
+
+#include <cassert>
+#include <cerrno>
+#include "MultiDevice.h"
+
+MultiDevice::MultiDevice(const std::vector<BlockStorage *> &members) {
+    assert(!members.empty());
+    this->stopWorkers = false;
+    for (size_t i = 0; i < members.size(); i++) {
+        Member *member = new Member();
+        member->device = members[i];
+        this->members.push_back(member);
+    }
+    for (size_t i = 0; i < this->members.size(); i++)
+        this->members[i]->worker = std::thread(&MultiDevice::workerLoop, this, i);
+}
+
+MultiDevice::~MultiDevice() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopWorkers = true;
+    }
+    for (size_t i = 0; i < members.size(); i++) {
+        members[i]->wakeup.notify_one();
+        members[i]->worker.join();
+    }
+    for (size_t i = 0; i < members.size(); i++) {
+        delete members[i]->device;
+        delete members[i];
+    }
+}
+
+std::vector<std::string> MultiDevice::splitPaths(const char *path) {
+    std::vector<std::string> paths;
+    std::string current;
+    for (const char *c = path; *c != '\0'; c++) {
+        if (*c == MEMBER_PATH_SEPARATOR) {
+            paths.push_back(current);
+            current.clear();
+        } else {
+            current += *c;
+        }
+    }
+    paths.push_back(current);
+    return paths;
+}
+
+// opens or creates the container of every member, on failure the members already attached are detached again
+int MultiDevice::attach(const char *path, bool doCreate) {
+    std::vector<std::string> paths = splitPaths(path);
+    if (paths.size() != members.size())
+        return -EINVAL;
+
+    size_t missing = 0;
+    int ret = 0;
+    std::vector<bool> attached(members.size(), false);
+    for (size_t i = 0; i < members.size(); i++) {
+        int memberRet = doCreate ? members[i]->device->create(paths[i].c_str())
+                                 : members[i]->device->open(paths[i].c_str());
+        if (memberRet == -ENOENT && !doCreate) {
+            missing++;
+        } else if (memberRet < 0) {
+            if (ret == 0)
+                ret = memberRet;
+        } else {
+            attached[i] = true;
+        }
+    }
+    if (ret == 0 && missing > 0)
+        ret = missing == members.size() ? -ENOENT : -EINVAL;
+    if (ret < 0) {
+        for (size_t i = 0; i < members.size(); i++) {
+            if (attached[i])
+                members[i]->device->close();
+        }
+    }
+    return ret;
+}
+
+int MultiDevice::open(const char *path) {
+    return attach(path, false);
+}
+
+int MultiDevice::create(const char *path) {
+    return attach(path, true);
+}
+
+int MultiDevice::close() {
+    int ret = 0;
+    for (size_t i = 0; i < members.size(); i++) {
+        int memberRet = members[i]->device->close();
+        if (memberRet < 0 && ret == 0)
+            ret = memberRet;
+    }
+    return ret;
+}
+
+int MultiDevice::sync() {
+    if (members.size() == 1)
+        return execute(0, MEMBER_SYNC, std::vector<BlockRequest>());
+    std::vector<Job> jobs(members.size());
+    for (size_t i = 0; i < jobs.size(); i++)
+        jobs[i].op = MEMBER_SYNC;
+    return run(jobs);
+}
+
+int MultiDevice::run(std::vector<Job> &jobs) {
+    std::unique_lock<std::mutex> guard(lock);
+    for (size_t i = 0; i < jobs.size(); i++) {
+        jobs[i].result = 0;
+        jobs[i].finished = jobs[i].op != MEMBER_SYNC && jobs[i].requests.empty();
+        if (!jobs[i].finished) {
+            members[i]->queue.push_back(&jobs[i]);
+            members[i]->wakeup.notify_one();
+        }
+    }
+
+    int ret = 0;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        jobsFinished.wait(guard, [&] { return jobs[i].finished; });
+        if (jobs[i].result < 0 && ret == 0)
+            ret = jobs[i].result;
+    }
+    return ret;
+}
+
+int MultiDevice::execute(size_t member, MemberOp op, const std::vector<BlockRequest> &requests) {
+    std::lock_guard<std::mutex> guard(members[member]->busy);
+    BlockStorage *device = members[member]->device;
+    if (op == MEMBER_SYNC)
+        return device->sync();
+    if (op == MEMBER_WRITE)
+        return device->writeBlocks(requests.data(), requests.size());
+    return device->readBlocks(requests.data(), requests.size());
+}
+
+// body of a member worker thread: serves the queue of its member until the device is deleted
+void MultiDevice::workerLoop(size_t index) {
+    Member *member = members[index];
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+        member->wakeup.wait(guard, [&] { return stopWorkers || !member->queue.empty(); });
+        if (member->queue.empty())
+            return;
+        Job *job = member->queue.front();
+        member->queue.pop_front();
+
+        guard.unlock();
+        int ret = execute(index, job->op, job->requests);
+        guard.lock();
+
+        job->result = ret;
+        job->finished = true;
+        jobsFinished.notify_all();
+    }
+}
+
+void MultiDevice::setBlockSize(uint32_t blockSize) {
+    for (size_t i = 0; i < members.size(); i++)
+        members[i]->device->setBlockSize(blockSize);
+}
+
+uint32_t MultiDevice::getBlockSize() {
+    return members[0]->device->getBlockSize();
+}
+
+// all members use the same block size, so buffers of the first one suit every member
+BufferPool *MultiDevice::getBufferPool() {
+    return members[0]->device->getBufferPool();
+}
+
+int MultiDevice::enableAsync(unsigned queueDepth) {
+    int ret = 0;
+    for (size_t i = 0; i < members.size(); i++) {
+        int memberRet = members[i]->device->enableAsync(queueDepth);
+        if (memberRet < 0 && ret == 0)
+            ret = memberRet;
+    }
+    return ret;
+}
+
+int MultiDevice::enableDirect() {
+    int ret = 0;
+    for (size_t i = 0; i < members.size(); i++) {
+        int memberRet = members[i]->device->enableDirect();
+        if (memberRet < 0 && ret == 0)
+            ret = memberRet;
+    }
+    return ret;
+}
+
+int MultiDevice::manageSpace(size_t member, bool doDiscard, uint32_t firstBlock, uint32_t count) {
+    std::lock_guard<std::mutex> guard(members[member]->busy);
+    BlockStorage *device = members[member]->device;
+    return doDiscard ? device->discard(firstBlock, count) : device->preallocate(firstBlock, count);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int MultiDevice::discard(uint32_t firstBlock, uint32_t count) {
+    int ret = 0;
+    for (size_t i = 0; i < members.size(); i++) {
+        int memberRet = manageSpace(i, true, firstBlock, count);
+        if (memberRet < 0 && ret == 0)
+            ret = memberRet;
+    }
+    return ret;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int MultiDevice::preallocate(uint32_t firstBlock, uint32_t count) {
+    int ret = 0;
+    for (size_t i = 0; i < members.size(); i++) {
+        int memberRet = manageSpace(i, false, firstBlock, count);
+        if (memberRet < 0 && ret == 0)
+            ret = memberRet;
+    }
+    return ret;
+}
+
+size_t MultiDevice::getNumMembers() {
+    return members.size();
+}
+
+BlockStorage *MultiDevice::getMember(size_t member) {
+    return members[member]->device;
+}
@@ -0,0 +1,140 @@
+//
+// Created by user on 17.10.26.
+//
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <new>
+#include "RamBlockDevice.h"
+
+RamBlockDevice::RamBlockDevice(uint32_t blockSize) {
+    assert(blockSize % 512 == 0);
+    this->blockSize = blockSize;
+    this->attached = false;
+    this->bufferPool = new BufferPool(blockSize);
+}
+
+RamBlockDevice::~RamBlockDevice() {
+    delete this->bufferPool;
+}
+
+// a RAM container never survives the object, so there is nothing to open
+int RamBlockDevice::open(const char *path) {
+    return -ENOENT;
+}
+
+int RamBlockDevice::create(const char *path) {
+    std::lock_guard<std::mutex> guard(lock);
+    data.clear();
+    attached = true;
+    return 0;
+}
+
+int RamBlockDevice::close() {
+    std::lock_guard<std::mutex> guard(lock);
+    std::vector<char>().swap(data);
+    attached = false;
+    return 0;
+}
+
+int RamBlockDevice::sync() {
+    return 0;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int RamBlockDevice::read(uint32_t blockNo, char *buffer) {
+    BlockRequest request = {blockNo, buffer};
+    return readBlocks(&request, 1);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int RamBlockDevice::write(uint32_t blockNo, char *buffer) {
+    BlockRequest request = {blockNo, buffer};
+    return writeBlocks(&request, 1);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int RamBlockDevice::readBlocks(const BlockRequest *requests, size_t count) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!attached)
+        return -EBADF;
+    for (size_t i = 0; i < count; i++) {
+        size_t pos = (size_t) requests[i].blockNo * blockSize;
+        if (pos + blockSize <= data.size())
+            memcpy(requests[i].buffer, data.data() + pos, blockSize);
+        else
+            memset(requests[i].buffer, 0, blockSize);
+    }
+    return 0;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int RamBlockDevice::writeBlocks(const BlockRequest *requests, size_t count) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!attached)
+        return -EBADF;
+    size_t end = 0;
+    for (size_t i = 0; i < count; i++)
+        end = std::max(end, ((size_t) requests[i].blockNo + 1) * blockSize);
+    int ret = grow(end);
+    if (ret < 0)
+        return ret;
+    for (size_t i = 0; i < count; i++)
+        memcpy(data.data() + (size_t) requests[i].blockNo * blockSize, requests[i].buffer, blockSize);
+    return 0;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int RamBlockDevice::discard(uint32_t firstBlock, uint32_t count) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!attached)
+        return -EBADF;
+    size_t start = std::min((size_t) firstBlock * blockSize, data.size());
+    size_t end = std::min(((size_t) firstBlock + count) * blockSize, data.size());
+    memset(data.data() + start, 0, end - start);
+    return 0;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int RamBlockDevice::preallocate(uint32_t firstBlock, uint32_t count) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!attached)
+        return -EBADF;
+    return grow(((size_t) firstBlock + count) * blockSize);
+}
+
+// makes the buffer at least end bytes large, new bytes are zero
+int RamBlockDevice::grow(size_t end) {
+    if (end <= data.size())
+        return 0;
+    try {
+        // grow geometrically, so a container written front to back is copied only a few times
+        if (end > data.capacity())
+            data.reserve(std::max(end, 2 * data.capacity()));
+        data.resize(end);
+    } catch (const std::bad_alloc &) {
+        return -ENOSPC;
+    }
+    return 0;
+}
+
+void RamBlockDevice::setBlockSize(uint32_t blockSize) {
+    assert(blockSize % 512 == 0);
+    std::lock_guard<std::mutex> guard(lock);
+    this->blockSize = blockSize;
+    this->bufferPool->setBlockSize(blockSize);
+}
+
+uint32_t RamBlockDevice::getBlockSize() {
+    return blockSize;
+}
+
+BufferPool *RamBlockDevice::getBufferPool() {
+    return bufferPool;
+}
+
+size_t RamBlockDevice::getSize() {
+    std::lock_guard<std::mutex> guard(lock);
+    return data.size();
+}
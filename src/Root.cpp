@@ -1,57 +1,169 @@
+#include <cstddef>
 #include <cstring>
 #include <fuse.h>
 #include <unistd.h>
+#include <vector>
 #include "Root.h"
 #include "myfs-structs.h"
 
-Root::Root(BlockDevice *blockDevice) {
+Root::Root(BlockStorage *blockDevice, SuperBlock *superBlock) {
     this->blockDevice = blockDevice;
+    this->superBlock = superBlock;
+    this->deferred = false;
     for (int i = 0; i < NUM_DIR_ENTRIES; i++) {
         rootFiles[i] = nullptr;
+        extentMaps[i] = nullptr;
     }
 }
 
-Root::~Root() {
+// entries of containers before version 6 end in front of the tail pointer
+size_t Root::entrySize() {
+    return superBlock->getVersion() <= SUPERBLOCK_VERSION_NO_TAIL ? offsetof(rootFile, lastBlock) : sizeof(rootFile);
+}
 
+// the extent table of a file follows its entry in the same block
+size_t Root::extentTableOffset() {
+    return (entrySize() + 7) & ~(size_t) 7;
+}
+
+Root::~Root() {
+    for (int i = 0; i < NUM_DIR_ENTRIES; i++) {
+        delete extentMaps[i];
+    }
 }
 
 void Root::init() {
+    // a zeroed entry is not valid, so a hole in the container is an empty root directory
+    if (this->blockDevice->discard(superBlock->getRootOffset(), NUM_DIR_ENTRIES) == 0)
+        return;
+
+    // all empty entries are written with one vectored request
+    uint32_t blockSize = superBlock->getBlockSize();
+    BlockBuffer buffer(blockDevice->getBufferPool(), NUM_DIR_ENTRIES);
+    char *buff = buffer.data();
+    BlockRequest requests[NUM_DIR_ENTRIES];
     for (int i = 0; i < NUM_DIR_ENTRIES; i++) {
         rootFile r = rootFile();
         r.valid = false;
         r.indexRootDirBlock = i;
-        this->discWrite(&r);
+        std::memcpy(buff + i * blockSize, &r, entrySize());
+        requests[i].blockNo = superBlock->getRootOffset() + i;
+        requests[i].buffer = buff + i * blockSize;
     }
-
+    this->blockDevice->writeBlocks(requests, NUM_DIR_ENTRIES);
 }
 
 
 void Root::initRootDir() {
-    char buff[BLOCK_SIZE] = {};
+    uint32_t blockSize = superBlock->getBlockSize();
+    BlockBuffer buffer(blockDevice->getBufferPool(), NUM_DIR_ENTRIES);
+    char *buff = buffer.data();
+    BlockRequest requests[NUM_DIR_ENTRIES];
+    for (int i = 0; i < NUM_DIR_ENTRIES; i++) {
+        requests[i].blockNo = superBlock->getRootOffset() + i;
+        requests[i].buffer = buff + i * blockSize;
+    }
+    this->blockDevice->readBlocks(requests, NUM_DIR_ENTRIES);
+    dirtyEntries.clear();
+
     for (int i = 0; i < NUM_DIR_ENTRIES; i++) {
         auto *file = new rootFile();
-        this->blockDevice->read(ROOT_DIR_OFFSET + i, buff);
-        (void) std::memcpy(file, buff, sizeof(rootFile));
+        (void) std::memcpy(file, buff + i * blockSize, entrySize());
         if (file->valid) {
             rootFiles[i] = file;
+            // entries written before extent tables existed are mapped from the FAT chain when first used
+            int fileBlocks = (file->fileStats.st_size + blockSize - 1) / blockSize;
+            extentMaps[i] = new ExtentMap();
+            extentMaps[i]->deserialize(buff + i * blockSize + extentTableOffset(), blockSize - extentTableOffset(),
+                                       file->firstBlock, fileBlocks, superBlock->getNumDataBlocks());
+            initTail(file, fileBlocks);
         } else {
             rootFiles[i] = nullptr;
-            free(file);
+            delete file;
         }
     }
 }
 
-bool Root::discWrite(rootFile *file) {
-    char buff[BLOCK_SIZE] = {};
+// checks the tail pointer read with an entry; without a valid one it is taken from the extent map if that is loaded,
+// otherwise the first append looks the last block up
+void Root::initTail(rootFile *file, int fileBlocks) {
+    ExtentMap *extents = extentMaps[file->indexRootDirBlock];
+    bool valid = superBlock->getVersion() > SUPERBLOCK_VERSION_NO_TAIL && file->blockCount == fileBlocks &&
+                 (fileBlocks == 0 ? file->lastBlock == FAT_END
+                                  : file->lastBlock > 0 && file->lastBlock < (int) superBlock->getNumDataBlocks()) &&
+                 (!extents->isLoaded() || extents->getLastBlock() == file->lastBlock);
+    if (valid)
+        return;
+    if (extents->isLoaded()) {
+        file->lastBlock = extents->getLastBlock();
+        file->blockCount = fileBlocks;
+    } else {
+        file->lastBlock = FAT_END;
+        file->blockCount = -1;
+    }
+}
+
+// fills the block of an entry, followed by the extent table of the file
+void Root::serialize(rootFile *file, char *buffer) {
     //void* memcpy( void* dest, const void* src, std::size_t count );
     // dest 	- 	pointer to the memory location to copy to
     // src 	- 	pointer to the memory location to copy from
     // count 	- 	number of bytes to copy
-    std::memcpy(buff, file, sizeof(rootFile));
-    this->blockDevice->write(ROOT_DIR_OFFSET + file->indexRootDirBlock, buff);
+    std::memset(buffer, 0, superBlock->getBlockSize());
+    std::memcpy(buffer, file, entrySize());
+    ExtentMap *extents = extentMaps[file->indexRootDirBlock];
+    if (extents != nullptr) {
+        extents->serialize(buffer + extentTableOffset(), superBlock->getBlockSize() - extentTableOffset());
+    }
+}
+
+bool Root::discWrite(rootFile *file) {
+    if (deferred) {
+        // flush() writes the entry as it is then, or an empty one if the file is deleted by that time
+        dirtyEntries.insert(file->indexRootDirBlock);
+        return true;
+    }
+    BlockBuffer buff(blockDevice->getBufferPool());
+    serialize(file, buff.data());
+    this->blockDevice->write(superBlock->getRootOffset() + file->indexRootDirBlock, buff.data());
     return true;
 }
 
+void Root::setDeferred(bool deferred) {
+    this->deferred = deferred;
+    if (!deferred)
+        flush();
+}
+
+// this method returns 0 if successful, -errno otherwise
+int Root::flush() {
+    if (dirtyEntries.empty())
+        return 0;
+    uint32_t blockSize = superBlock->getBlockSize();
+    BlockBuffer buffer(blockDevice->getBufferPool(), dirtyEntries.size());
+    std::vector<BlockRequest> requests;
+    for (int i: dirtyEntries) {
+        BlockRequest request;
+        request.blockNo = superBlock->getRootOffset() + i;
+        request.buffer = buffer.data() + requests.size() * blockSize;
+        if (rootFiles[i] != nullptr) {
+            serialize(rootFiles[i], request.buffer);
+        } else {
+            rootFile r = rootFile();
+            r.valid = false;
+            r.indexRootDirBlock = i;
+            serialize(&r, request.buffer);
+        }
+        requests.push_back(request);
+    }
+    dirtyEntries.clear();
+    return blockDevice->writeBlocks(requests.data(), requests.size());
+}
+
+size_t Root::getDirtyEntries() {
+    return dirtyEntries.size();
+}
+
 rootFile *Root::getFileAtIndex(int index) {
     if (index < NUM_DIR_ENTRIES) {
         return rootFiles[index];
@@ -69,6 +181,10 @@ rootFile *Root::getRootEntryFile(const char *path) {
     return nullptr;
 }
 
+ExtentMap *Root::getExtents(rootFile *file) {
+    return extentMaps[file->indexRootDirBlock];
+}
+
 
 rootFile *Root::createNewFile(const char *path) {
     path++;
@@ -82,10 +198,12 @@ rootFile *Root::createNewFile(const char *path) {
         auto *newFile = new rootFile();
         strcpy(newFile->name, path);
         newFile->firstBlock = FAT_END;
+        newFile->lastBlock = FAT_END;
+        newFile->blockCount = 0;
         newFile->valid = true;
 
         newFile->fileStats.st_mode = S_IFREG | 0644;
-        newFile->fileStats.st_blksize = BLOCK_SIZE;
+        newFile->fileStats.st_blksize = superBlock->getBlockSize();
         newFile->fileStats.st_size = 0;
         newFile->fileStats.st_nlink = 1;
         newFile->fileStats.st_atime = time(nullptr);
@@ -97,6 +215,8 @@ rootFile *Root::createNewFile(const char *path) {
         newFile->indexRootDirBlock = i;
 
         rootFiles[i] = newFile;
+        delete extentMaps[i];
+        extentMaps[i] = new ExtentMap();
         return newFile;
     } else {
         return nullptr;
@@ -112,6 +232,8 @@ int Root::deleteFile(const char *path) {
         if (rootFiles[i] != nullptr && strcmp(path, rootFiles[i]->name) == 0) {
             delete rootFiles[i];
             rootFiles[i] = nullptr;
+            delete extentMaps[i];
+            extentMaps[i] = nullptr;
             rootFile r = rootFile();
             r.valid = false;
             r.indexRootDirBlock = i;
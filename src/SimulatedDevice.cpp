@@ -0,0 +1,187 @@
+//
+// Created by user on 17.10.26.
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include "SimulatedDevice.h"
+
+SimulatedDevice::SimulatedDevice(BlockStorage *device, const SimulationParams &params) {
+    this->device = device;
+    this->params = params;
+    this->headPosition = 0;
+    this->deviceTimeNs = 0;
+    this->requests = 0;
+    this->blocks = 0;
+    this->seekDistance = 0;
+}
+
+SimulatedDevice::~SimulatedDevice() {
+    delete device;
+}
+
+bool SimulatedDevice::parseParams(const char *spec, SimulationParams *params) {
+    memset(params, 0, sizeof(*params));
+    if (spec == nullptr)
+        return false;
+    if (strcmp(spec, "hdd") == 0) {
+        // 7200 rpm disk: command overhead, seek up to a full stroke, 150 MB/s media rate
+        params->latencyNs = 100000;
+        params->seekNsPerBlock = 100;
+        params->maxSeekNs = 8000000;
+        params->bytesPerSecond = 150000000;
+    } else if (strcmp(spec, "ssd") == 0) {
+        params->latencyNs = 80000;
+        params->bytesPerSecond = 500000000;
+    } else if (strcmp(spec, "net") == 0) {
+        // network block device or throttled cloud volume
+        params->latencyNs = 1000000;
+        params->bytesPerSecond = 100000000;
+    } else {
+        unsigned long long latencyUs, seekNs, maxSeekUs, mbPerSecond;
+        if (sscanf(spec, "%llu:%llu:%llu:%llu", &latencyUs, &seekNs, &maxSeekUs, &mbPerSecond) != 4)
+            return false;
+        params->latencyNs = latencyUs * 1000;
+        params->seekNsPerBlock = seekNs;
+        params->maxSeekNs = maxSeekUs * 1000;
+        params->bytesPerSecond = mbPerSecond * 1000000;
+    }
+    return true;
+}
+
+// charges every run of contiguous blocks with latency, seek and transfer time
+int SimulatedDevice::simulate(bool doWrite, const BlockRequest *requests, size_t count) {
+    std::lock_guard<std::mutex> guard(lock);
+    uint64_t cost = 0;
+    size_t start = 0;
+    while (start < count) {
+        size_t end = start + 1;
+        while (end < count && requests[end].blockNo == requests[end - 1].blockNo + 1)
+            end++;
+
+        uint32_t first = requests[start].blockNo;
+        uint64_t distance = first > headPosition ? first - headPosition : headPosition - first;
+        uint64_t seek = distance * params.seekNsPerBlock;
+        if (params.maxSeekNs > 0 && seek > params.maxSeekNs)
+            seek = params.maxSeekNs;
+        uint64_t bytes = (uint64_t) (end - start) * device->getBlockSize();
+        uint64_t transfer = params.bytesPerSecond > 0 ? bytes * 1000000000ULL / params.bytesPerSecond : 0;
+        cost += params.latencyNs + seek + transfer;
+
+        this->requests++;
+        this->blocks += end - start;
+        this->seekDistance += distance;
+        headPosition = requests[end - 1].blockNo + 1;
+        start = end;
+    }
+    deviceTimeNs += cost;
+
+    int ret = doWrite ? device->writeBlocks(requests, count) : device->readBlocks(requests, count);
+    if (params.delay)
+        std::this_thread::sleep_for(std::chrono::nanoseconds(cost));
+    return ret;
+}
+
+int SimulatedDevice::open(const char *path) {
+    return device->open(path);
+}
+
+int SimulatedDevice::create(const char *path) {
+    return device->create(path);
+}
+
+int SimulatedDevice::close() {
+    return device->close();
+}
+
+int SimulatedDevice::sync() {
+    return device->sync();
+}
+
+// this method returns 0 if successful, -errno otherwise
+int SimulatedDevice::read(uint32_t blockNo, char *buffer) {
+    BlockRequest request = {blockNo, buffer};
+    return simulate(false, &request, 1);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int SimulatedDevice::write(uint32_t blockNo, char *buffer) {
+    BlockRequest request = {blockNo, buffer};
+    return simulate(true, &request, 1);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int SimulatedDevice::readBlocks(const BlockRequest *requests, size_t count) {
+    return simulate(false, requests, count);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int SimulatedDevice::writeBlocks(const BlockRequest *requests, size_t count) {
+    return simulate(true, requests, count);
+}
+
+void SimulatedDevice::setBlockSize(uint32_t blockSize) {
+    device->setBlockSize(blockSize);
+}
+
+uint32_t SimulatedDevice::getBlockSize() {
+    return device->getBlockSize();
+}
+
+BufferPool *SimulatedDevice::getBufferPool() {
+    return device->getBufferPool();
+}
+
+int SimulatedDevice::enableAsync(unsigned queueDepth) {
+    return device->enableAsync(queueDepth);
+}
+
+int SimulatedDevice::enableDirect() {
+    return device->enableDirect();
+}
+
+int SimulatedDevice::discard(uint32_t firstBlock, uint32_t count) {
+    return device->discard(firstBlock, count);
+}
+
+int SimulatedDevice::preallocate(uint32_t firstBlock, uint32_t count) {
+    return device->preallocate(firstBlock, count);
+}
+
+IoStats *SimulatedDevice::getStats() {
+    return device->getStats();
+}
+
+BlockStorage *SimulatedDevice::getDevice() {
+    return device;
+}
+
+uint64_t SimulatedDevice::getDeviceTimeNs() {
+    std::lock_guard<std::mutex> guard(lock);
+    return deviceTimeNs;
+}
+
+uint64_t SimulatedDevice::getRequests() {
+    std::lock_guard<std::mutex> guard(lock);
+    return requests;
+}
+
+uint64_t SimulatedDevice::getBlocks() {
+    std::lock_guard<std::mutex> guard(lock);
+    return blocks;
+}
+
+uint64_t SimulatedDevice::getSeekDistance() {
+    std::lock_guard<std::mutex> guard(lock);
+    return seekDistance;
+}
+
+void SimulatedDevice::resetStats() {
+    std::lock_guard<std::mutex> guard(lock);
+    deviceTimeNs = 0;
+    requests = 0;
+    blocks = 0;
+    seekDistance = 0;
+}
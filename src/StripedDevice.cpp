@@ -0,0 +1,139 @@
+//
+// Created by user on 17.10.26.
+//
+
+#include <algorithm>
+#include "StripedDevice.h"
+
+StripedDevice::StripedDevice(const std::vector<BlockStorage *> &members, uint32_t stripeUnit) : MultiDevice(members) {
+    this->stripeUnit = stripeUnit;
+    this->stripeBlocks = std::max(1u, stripeUnit / getBlockSize());
+    this->parallelRequests = 0;
+    this->memberBlocks.assign(members.size(), 0);
+}
+
+StripedDevice::~StripedDevice() {
+
+}
+
+// this method returns 0 if successful, -errno otherwise
+int StripedDevice::read(uint32_t blockNo, char *buffer) {
+    BlockRequest request = {blockNo, buffer};
+    return transfer(MEMBER_READ, &request, 1);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int StripedDevice::write(uint32_t blockNo, char *buffer) {
+    BlockRequest request = {blockNo, buffer};
+    return transfer(MEMBER_WRITE, &request, 1);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int StripedDevice::readBlocks(const BlockRequest *requests, size_t count) {
+    return transfer(MEMBER_READ, requests, count);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int StripedDevice::writeBlocks(const BlockRequest *requests, size_t count) {
+    return transfer(MEMBER_WRITE, requests, count);
+}
+
+// translates a logical block into the member holding it and the block number on that member
+BlockRequest StripedDevice::map(uint32_t blockNo, char *buffer, size_t *member) {
+    uint32_t unit = blockNo / stripeBlocks;
+    *member = unit % members.size();
+    BlockRequest request = {(uint32_t) (unit / members.size()) * stripeBlocks + blockNo % stripeBlocks, buffer};
+    return request;
+}
+
+// splits the requests by member; blocks that are contiguous on a member stay in order, so the member can merge them
+int StripedDevice::transfer(MemberOp op, const BlockRequest *requests, size_t count) {
+    std::vector<Job> jobs(members.size());
+    size_t involved = 0;
+    size_t last = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t member;
+        BlockRequest request = map(requests[i].blockNo, requests[i].buffer, &member);
+        if (jobs[member].requests.empty()) {
+            involved++;
+            last = member;
+        }
+        jobs[member].op = op;
+        jobs[member].requests.push_back(request);
+    }
+    if (involved == 0)
+        return 0;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (size_t i = 0; i < jobs.size(); i++)
+            memberBlocks[i] += jobs[i].requests.size();
+        if (involved > 1)
+            parallelRequests++;
+    }
+    if (involved == 1)
+        return execute(last, op, jobs[last].requests);
+    return run(jobs);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int StripedDevice::discard(uint32_t firstBlock, uint32_t count) {
+    return manageRange(true, firstBlock, count);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int StripedDevice::preallocate(uint32_t firstBlock, uint32_t count) {
+    return manageRange(false, firstBlock, count);
+}
+
+// cuts the range at stripe unit boundaries; pieces that are adjacent on their member are handled together
+int StripedDevice::manageRange(bool doDiscard, uint32_t firstBlock, uint32_t count) {
+    std::vector<uint32_t> runStart(members.size(), 0);
+    std::vector<uint32_t> runLength(members.size(), 0);
+    int ret = 0;
+    uint64_t end = (uint64_t) firstBlock + count;
+    for (uint64_t blockNo = firstBlock; blockNo < end;) {
+        uint32_t length = (uint32_t) std::min((uint64_t) stripeBlocks - blockNo % stripeBlocks, end - blockNo);
+        size_t member;
+        BlockRequest piece = map((uint32_t) blockNo, nullptr, &member);
+        if (runLength[member] > 0 && runStart[member] + runLength[member] == piece.blockNo) {
+            runLength[member] += length;
+        } else {
+            if (runLength[member] > 0) {
+                int memberRet = manageSpace(member, doDiscard, runStart[member], runLength[member]);
+                if (memberRet < 0 && ret == 0)
+                    ret = memberRet;
+            }
+            runStart[member] = piece.blockNo;
+            runLength[member] = length;
+        }
+        blockNo += length;
+    }
+    for (size_t i = 0; i < members.size(); i++) {
+        if (runLength[i] > 0) {
+            int memberRet = manageSpace(i, doDiscard, runStart[i], runLength[i]);
+            if (memberRet < 0 && ret == 0)
+                ret = memberRet;
+        }
+    }
+    return ret;
+}
+
+void StripedDevice::setBlockSize(uint32_t blockSize) {
+    MultiDevice::setBlockSize(blockSize);
+    stripeBlocks = std::max(1u, stripeUnit / blockSize);
+}
+
+uint32_t StripedDevice::getStripeUnit() {
+    return stripeUnit;
+}
+
+uint64_t StripedDevice::getParallelRequests() {
+    std::lock_guard<std::mutex> guard(lock);
+    return parallelRequests;
+}
+
+uint64_t StripedDevice::getMemberBlocks(size_t member) {
+    std::lock_guard<std::mutex> guard(lock);
+    return memberBlocks[member];
+}
@@ -0,0 +1,105 @@
+//
+// Created by user on 17.10.26.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include "SuperBlock.h"
+#include "myfs-structs.h"
+
+SuperBlock::SuperBlock(BlockStorage *blockDevice) {
+    this->blockDevice = blockDevice;
+    memset(&data, 0, sizeof(data));
+}
+
+SuperBlock::~SuperBlock() {
+
+}
+
+/**
+ * Berechnet das Layout des Containers für die gewählte Blockgröße:
+ * Superblock | FAT | DMAP | CMAP | DDT | Root | Daten
+ */
+int SuperBlock::format(uint32_t blockSize, uint32_t numDataBlocks, uint32_t fatEntrySize) {
+    if (fatEntrySize == 0)
+        fatEntrySize = numDataBlocks <= NUMBER_BLOCKS ? FAT16_ENTRY_SIZE : FAT32_ENTRY_SIZE;
+    return layout(SUPERBLOCK_VERSION, blockSize, numDataBlocks, fatEntrySize);
+}
+
+// version 2 containers have no compression map and version 3 containers no dedup table, the following regions move up
+int SuperBlock::layout(uint32_t version, uint32_t blockSize, uint32_t numDataBlocks, uint32_t fatEntrySize) {
+    // power of two between MIN_BLOCK_SIZE and MAX_BLOCK_SIZE
+    if (blockSize < MIN_BLOCK_SIZE || blockSize > MAX_BLOCK_SIZE || (blockSize & (blockSize - 1)) != 0)
+        return -EINVAL;
+    if (version <= SUPERBLOCK_VERSION_FAT16)
+        fatEntrySize = FAT16_ENTRY_SIZE;
+    if (fatEntrySize != FAT16_ENTRY_SIZE && fatEntrySize != FAT32_ENTRY_SIZE)
+        return -EINVAL;
+    if (numDataBlocks == 0 || numDataBlocks > (fatEntrySize == FAT16_ENTRY_SIZE ? NUMBER_BLOCKS : MAX_DATA_BLOCKS))
+        return -EINVAL;
+
+    data.magic = SUPERBLOCK_MAGIC;
+    data.version = version;
+    data.blockSize = blockSize;
+    data.numDataBlocks = numDataBlocks;
+    data.fatEntrySize = fatEntrySize;
+    data.fatOffset = 1;
+    data.fatSize = ((uint64_t) numDataBlocks * fatEntrySize + blockSize - 1) / blockSize;
+    data.dmapOffset = data.fatOffset + data.fatSize;
+    data.dmapSize = (numDataBlocks + blockSize - 1) / blockSize;
+    data.cmapOffset = data.dmapOffset + data.dmapSize;
+    if (version == SUPERBLOCK_VERSION_NO_CMAP) {
+        data.cmapSize = 0;
+        data.unitBlocks = 0;
+    } else {
+        data.cmapSize = (numDataBlocks + blockSize - 1) / blockSize;
+        // a unit of one block could never be stored in fewer blocks
+        data.unitBlocks = std::max(2u, COMPRESSION_UNIT_SIZE / blockSize);
+    }
+    data.ddtOffset = data.cmapOffset + data.cmapSize;
+    if (version <= SUPERBLOCK_VERSION_NO_DDT)
+        data.ddtSize = 0;
+    else
+        data.ddtSize = ((uint64_t) numDataBlocks * DDT_ENTRY_SIZE + blockSize - 1) / blockSize;
+    data.rootOffset = data.ddtOffset + data.ddtSize;
+    data.rootSize = NUM_DIR_ENTRIES;
+    data.dataOffset = data.rootOffset + data.rootSize;
+    return 0;
+}
+
+/**
+ * Liest den Superblock. Der Block Device muss dafür noch mit BD_BLOCK_SIZE arbeiten.
+ */
+int SuperBlock::init() {
+    BlockBuffer buffer(blockDevice->getBufferPool());
+    int ret = blockDevice->read(0, buffer.data());
+    if (ret < 0)
+        return ret;
+
+    superBlockData onDisk;
+    memcpy(&onDisk, buffer.data(), sizeof(onDisk));
+    if (onDisk.magic != SUPERBLOCK_MAGIC || onDisk.version < SUPERBLOCK_VERSION_NO_CMAP ||
+        onDisk.version > SUPERBLOCK_VERSION)
+        return -EINVAL;
+
+    // recompute the layout, so a damaged superblock can not point anywhere
+    ret = layout(onDisk.version, onDisk.blockSize, onDisk.numDataBlocks, onDisk.fatEntrySize);
+    size_t compared = sizeof(data);
+    if (onDisk.version == SUPERBLOCK_VERSION_NO_CMAP)
+        compared = offsetof(superBlockData, cmapOffset);
+    else if (onDisk.version == SUPERBLOCK_VERSION_NO_DDT)
+        compared = offsetof(superBlockData, ddtOffset);
+    else if (onDisk.version == SUPERBLOCK_VERSION_FAT16)
+        compared = offsetof(superBlockData, fatEntrySize);
+    if (ret < 0 || memcmp(&onDisk, &data, compared) != 0)
+        return -EINVAL;
+    return 0;
+}
+
+void SuperBlock::discWrite() {
+    BlockBuffer buffer(blockDevice->getBufferPool());
+    memcpy(buffer.data(), &data, sizeof(data));
+    blockDevice->write(0, buffer.data());
+}
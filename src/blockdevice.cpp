@@ -10,20 +10,54 @@
 
 #include <cstdlib>
 #include <cassert>
+#include <cstring>
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <limits.h>
+#include <vector>
 #include <sys/types.h>
 #include "macros.h"
 
 #include "blockdevice.h"
+#include "IoUring.h"
+#include "IoTracer.h"
 
 #undef DEBUG
 
 BlockDevice::BlockDevice(uint32_t blockSize) {
     assert(blockSize % 512 == 0);
     this->blockSize= blockSize;
+    this->contFile= -1;
+    this->ring= nullptr;
+    this->inFlight= 0;
+    this->asyncError= 0;
+    this->mapping= nullptr;
+    this->mappingBlocks= 0;
+    this->direct= false;
+    this->bufferPool= new BufferPool(blockSize);
+    this->tracer= nullptr;
+}
+
+BlockDevice::~BlockDevice() {
+    delete this->ring;
+    delete this->bufferPool;
+}
+
+void BlockDevice::setBlockSize(uint32_t blockSize) {
+    assert(blockSize % 512 == 0);
+    assert(this->inFlight == 0 && this->mapping == nullptr);
+    this->blockSize= blockSize;
+    this->bufferPool->setBlockSize(blockSize);
+    if (this->tracer != nullptr)
+        this->tracer->record(TRACE_BLOCK_SIZE, blockSize, IoTracer::now());
+}
+
+uint32_t BlockDevice::getBlockSize() {
+    return this->blockSize;
 }
 
 int BlockDevice::create(const char *path) {
@@ -74,41 +108,500 @@ int BlockDevice::close() {
 
     int ret= 0;
 
+    if (this->ring != nullptr) {
+        // wait for outstanding requests before the file goes away
+        complete();
+        delete this->ring;
+        this->ring= nullptr;
+    }
+
+    if (this->mapping != nullptr) {
+        if (munmap(this->mapping, this->mappingBlocks * this->blockSize) < 0)
+            ret= -errno;
+        this->mapping= nullptr;
+        this->mappingBlocks= 0;
+    }
+
     if(::close(this->contFile) < 0)
         ret= -errno;
+    this->direct= false;
     
     return ret;
 }
 
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::sync() {
+    uint64_t start = IoStats::now();
+    int ret = syncFile();
+    this->stats.record(STATS_SYNC, start);
+    if (this->tracer != nullptr)
+        this->tracer->record(TRACE_SYNC, 0, start);
+    return ret;
+}
+
+int BlockDevice::syncFile() {
+    if (this->mapping != nullptr && msync(this->mapping, this->mappingBlocks * this->blockSize, MS_SYNC) < 0)
+        return -errno;
+    if (fsync(this->contFile) < 0)
+        return -errno;
+    return 0;
+}
+
 // this method returns 0 if successful, -errno otherwise
 int BlockDevice::read(uint32_t blockNo, char *buffer) {
+    uint64_t start = IoStats::now();
+    int ret = readBlock(blockNo, buffer);
+    BlockRequest request = {blockNo, buffer};
+    account(false, &request, 1, start);
+    return ret;
+}
+
+int BlockDevice::readBlock(uint32_t blockNo, char *buffer) {
 #ifdef DEBUG
     fprintf(stderr, "BlockDevice: Reading block %d\n", blockNo);
 #endif
+    if (blockNo < this->mappingBlocks) {
+        memcpy(buffer, this->mapping + (size_t) blockNo * this->blockSize, this->blockSize);
+        return 0;
+    }
+    BlockRequest request = {blockNo, buffer};
+    if (needsBounce(&request, 1))
+        return bounce(false, &request, 1);
+
     off_t pos = (off_t) blockNo * this->blockSize;
-    if (lseek (this->contFile, pos, SEEK_SET) != pos)
-        return -errno;
-    
-    int size = (this->blockSize);
-    if (::read (this->contFile, buffer, size) != size)
-        return -errno;
+    size_t size = this->blockSize;
+    size_t done = 0;
+
+    // pread() carries its own offset, so concurrent callers never race on the file position
+    while (done < size) {
+        ssize_t n = ::pread(this->contFile, buffer + done, size - done, pos + done);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        if (n == 0) {
+            // block lies behind the end of the container file, it has never been written
+            memset(buffer + done, 0, size - done);
+            break;
+        }
+        done += n;
+    }
 
     return 0;
 }
 
 // this method returns 0 if successful, -errno otherwise
 int BlockDevice::write(uint32_t blockNo, char *buffer) {
+    uint64_t start = IoStats::now();
+    int ret = writeBlock(blockNo, buffer);
+    BlockRequest request = {blockNo, buffer};
+    account(true, &request, 1, start);
+    return ret;
+}
+
+int BlockDevice::writeBlock(uint32_t blockNo, char *buffer) {
 #ifdef DEBUG
     fprintf(stderr, "BlockDevice: Writing block %d\n", blockNo);
 #endif
+    if (blockNo < this->mappingBlocks) {
+        memcpy(this->mapping + (size_t) blockNo * this->blockSize, buffer, this->blockSize);
+        return 0;
+    }
+    BlockRequest request = {blockNo, buffer};
+    if (needsBounce(&request, 1))
+        return bounce(true, &request, 1);
+
     off_t pos = (off_t) blockNo * this->blockSize;
-    if (lseek (this->contFile, pos, SEEK_SET) != pos)
+    size_t size = this->blockSize;
+    size_t done = 0;
+
+    while (done < size) {
+        ssize_t n = ::pwrite(this->contFile, buffer + done, size - done, pos + done);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        done += n;
+    }
+
+    return 0;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::readBlocks(const BlockRequest *requests, size_t count) {
+    uint64_t start = IoStats::now();
+    int ret = access(false, requests, count);
+    account(false, requests, count, start);
+    return ret;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::writeBlocks(const BlockRequest *requests, size_t count) {
+    uint64_t start = IoStats::now();
+    int ret = access(true, requests, count);
+    account(true, requests, count, start);
+    return ret;
+}
+
+// counts a call and records it in the trace, both use the same clock
+void BlockDevice::account(bool doWrite, const BlockRequest *requests, size_t count, uint64_t startNs) {
+    this->stats.record(doWrite ? STATS_WRITE : STATS_READ, requests, count, this->blockSize, startNs);
+    if (this->tracer != nullptr)
+        this->tracer->record(doWrite ? TRACE_WRITE : TRACE_READ, requests, count, startNs);
+}
+
+IoStats *BlockDevice::getStats() {
+    return &this->stats;
+}
+
+// transfers several blocks with the backend in use, without tracing
+int BlockDevice::access(bool doWrite, const BlockRequest *requests, size_t count) {
+    if (needsBounce(requests, count))
+        return bounce(doWrite, requests, count);
+    if (this->ring != nullptr && this->mapping == nullptr) {
+        // one submission for all runs, then wait for them together
+        int ret = submit(doWrite, requests, count);
+        int err = complete();
+        return ret < 0 ? ret : err;
+    }
+    return transfer(doWrite, requests, count);
+}
+
+// with direct I/O, every buffer must be aligned to the block size
+bool BlockDevice::needsBounce(const BlockRequest *requests, size_t count) {
+    if (!this->direct)
+        return false;
+    for (size_t i = 0; i < count; i++) {
+        if ((uintptr_t) requests[i].buffer % this->blockSize != 0)
+            return true;
+    }
+    return false;
+}
+
+// transfers the requests through aligned buffers of the pool, copying from/to the unaligned buffers of the caller
+int BlockDevice::bounce(bool doWrite, const BlockRequest *requests, size_t count) {
+    char *aligned = this->bufferPool->get(count);
+    if (aligned == nullptr)
+        return -ENOMEM;
+    std::vector<BlockRequest> bounced(requests, requests + count);
+    for (size_t i = 0; i < count; i++) {
+        bounced[i].buffer = aligned + i * this->blockSize;
+        if (doWrite)
+            memcpy(bounced[i].buffer, requests[i].buffer, this->blockSize);
+    }
+
+    int ret = access(doWrite, bounced.data(), count);
+    if (ret == 0 && !doWrite) {
+        for (size_t i = 0; i < count; i++)
+            memcpy(requests[i].buffer, bounced[i].buffer, this->blockSize);
+    }
+    this->bufferPool->put(aligned, count);
+    return ret;
+}
+
+// splits the requests into runs of physically contiguous blocks and transfers each run at once
+int BlockDevice::transfer(bool doWrite, const BlockRequest *requests, size_t count) {
+    size_t start = 0;
+    while (start < count) {
+        size_t end = start + 1;
+        while (end < count && end - start < IOV_MAX && requests[end].blockNo == requests[end - 1].blockNo + 1)
+            end++;
+
+        int ret = transferRun(doWrite, requests + start, end - start);
+        if (ret < 0)
+            return ret;
+        start = end;
+    }
+    return 0;
+}
+
+// transfers a run of contiguous blocks with a single preadv/pwritev call (retried on short transfers)
+int BlockDevice::transferRun(bool doWrite, const BlockRequest *requests, size_t count) {
+#ifdef DEBUG
+    fprintf(stderr, "BlockDevice: %s %zu blocks starting at %d\n", doWrite ? "Writing" : "Reading", count,
+            requests[0].blockNo);
+#endif
+    if (count == 1 || requests[count - 1].blockNo < this->mappingBlocks) {
+        // a single block, or a run inside the mapping where every block is a plain memcpy
+        for (size_t i = 0; i < count; i++) {
+            int ret = doWrite ? writeBlock(requests[i].blockNo, requests[i].buffer)
+                              : readBlock(requests[i].blockNo, requests[i].buffer);
+            if (ret < 0)
+                return ret;
+        }
+        return 0;
+    }
+
+    std::vector<struct iovec> iov(count);
+    for (size_t i = 0; i < count; i++) {
+        iov[i].iov_base = requests[i].buffer;
+        iov[i].iov_len = this->blockSize;
+    }
+
+    off_t pos = (off_t) requests[0].blockNo * this->blockSize;
+    size_t first = 0;
+    while (first < count) {
+        ssize_t n = doWrite ? ::pwritev(this->contFile, &iov[first], count - first, pos)
+                            : ::preadv(this->contFile, &iov[first], count - first, pos);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        if (n == 0 && !doWrite) {
+            // rest of the run lies behind the end of the container file
+            for (size_t i = first; i < count; i++)
+                memset(iov[i].iov_base, 0, iov[i].iov_len);
+            break;
+        }
+        pos += n;
+        // skip the iovecs that have been transferred completely
+        while (first < count && (size_t) n >= iov[first].iov_len) {
+            n -= iov[first].iov_len;
+            first++;
+        }
+        if (first < count && n > 0) {
+            iov[first].iov_base = (char *) iov[first].iov_base + n;
+            iov[first].iov_len -= n;
+        }
+    }
+
+    return 0;
+}
+
+int BlockDevice::enableAsync(unsigned queueDepth) {
+    if (this->ring != nullptr)
+        return 0;
+
+    IoUring *newRing = new IoUring();
+    int ret = newRing->init(queueDepth);
+    if (ret < 0) {
+        delete newRing;
+        return ret;
+    }
+    this->ring = newRing;
+    return 0;
+}
+
+bool BlockDevice::isAsync() {
+    return this->ring != nullptr;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::submitRead(const BlockRequest *requests, size_t count) {
+    // the duration of an asynchronous call only covers its submission
+    uint64_t start = IoStats::now();
+    int ret = submit(false, requests, count);
+    account(false, requests, count, start);
+    return ret;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::submitWrite(const BlockRequest *requests, size_t count) {
+    // the duration of an asynchronous call only covers its submission
+    uint64_t start = IoStats::now();
+    int ret = submit(true, requests, count);
+    account(true, requests, count, start);
+    return ret;
+}
+
+// queues one read/write per run of contiguous blocks, the kernel sees them all at the next io_uring_enter()
+int BlockDevice::submit(bool doWrite, const BlockRequest *requests, size_t count) {
+    if (this->ring == nullptr || needsBounce(requests, count)) {
+        // synchronous fallback, the result is reported by complete()
+        int ret = needsBounce(requests, count) ? bounce(doWrite, requests, count) : transfer(doWrite, requests, count);
+        if (ret < 0 && this->asyncError == 0)
+            this->asyncError = ret;
+        return 0;
+    }
+
+    size_t start = 0;
+    while (start < count) {
+        size_t end = start + 1;
+        while (end < count && end - start < IOV_MAX && requests[end].blockNo == requests[end - 1].blockNo + 1)
+            end++;
+
+        AsyncOp *op = new AsyncOp();
+        op->doWrite = doWrite;
+        op->requests.assign(requests + start, requests + end);
+        op->iov.resize(end - start);
+        for (size_t i = 0; i < op->iov.size(); i++) {
+            op->iov[i].iov_base = requests[start + i].buffer;
+            op->iov[i].iov_len = this->blockSize;
+        }
+
+        // keep at most one ring full of requests in flight, so completions can never overflow
+        if (this->inFlight >= this->ring->size()) {
+            int ret = reap(1);
+            if (ret < 0) {
+                delete op;
+                return ret;
+            }
+        }
+        off_t pos = (off_t) requests[start].blockNo * this->blockSize;
+        while (!this->ring->prepare(doWrite, this->contFile, op->iov.data(), op->iov.size(), pos,
+                                    (uint64_t) (uintptr_t) op)) {
+            int ret = this->ring->submit(0);
+            if (ret < 0) {
+                delete op;
+                return ret;
+            }
+        }
+        this->inFlight++;
+        start = end;
+    }
+
+    return this->ring->submit(0);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::complete() {
+    if (this->ring != nullptr) {
+        int ret = reap(this->inFlight);
+        if (ret < 0 && this->asyncError == 0)
+            this->asyncError = ret;
+    }
+    int ret = this->asyncError;
+    this->asyncError = 0;
+    return ret;
+}
+
+// collects completions until at most inFlight - waitNr requests are left
+int BlockDevice::reap(unsigned waitNr) {
+    unsigned target = this->inFlight - waitNr;
+    while (this->inFlight > target) {
+        uint64_t userData;
+        int res;
+        if (!this->ring->popCompletion(&userData, &res)) {
+            int ret = this->ring->submit(1);
+            if (ret < 0)
+                return ret;
+            continue;
+        }
+        this->inFlight--;
+
+        AsyncOp *op = (AsyncOp *) (uintptr_t) userData;
+        if (res < 0) {
+            if (this->asyncError == 0)
+                this->asyncError = res;
+        } else if ((size_t) res < op->requests.size() * this->blockSize) {
+            // short transfer (e.g. reading behind the end of the container), redo it synchronously
+            int ret = transferRun(op->doWrite, op->requests.data(), op->requests.size());
+            if (ret < 0 && this->asyncError == 0)
+                this->asyncError = ret;
+        }
+        delete op;
+    }
+    return 0;
+}
+
+int BlockDevice::enableMmap(uint32_t numBlocks) {
+    if (this->mapping != nullptr)
+        return 0;
+    if (this->direct)
+        return -EINVAL;
+
+    // the mapping must not reach behind the end of the file
+    struct stat st;
+    if (fstat(this->contFile, &st) < 0)
+        return -errno;
+    off_t size = (off_t) numBlocks * this->blockSize;
+    if (st.st_size < size && ftruncate(this->contFile, size) < 0)
         return -errno;
 
-    int __size = (this->blockSize);
-    if (::write (this->contFile, buffer, __size) != __size)
+    void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, this->contFile, 0);
+    if (addr == MAP_FAILED)
         return -errno;
 
+    this->mapping = (char *) addr;
+    this->mappingBlocks = numBlocks;
     return 0;
 }
 
+int BlockDevice::enableDirect() {
+    if (this->direct)
+        return 0;
+    if (this->mapping != nullptr)
+        return -EINVAL;
+
+    int flags = fcntl(this->contFile, F_GETFL);
+    if (flags < 0 || fcntl(this->contFile, F_SETFL, flags | O_DIRECT) < 0)
+        return -errno;
+    this->direct= true;
+
+    // the file system must accept transfers of one block, otherwise every request would fail with EINVAL
+    char *probe = this->bufferPool->get();
+    ssize_t n = probe != nullptr ? ::pread(this->contFile, probe, this->blockSize, 0) : -1;
+    int ret = n < 0 ? (probe == nullptr ? -ENOMEM : -errno) : 0;
+    this->bufferPool->put(probe);
+    if (ret < 0) {
+        (void) fcntl(this->contFile, F_SETFL, flags);
+        this->direct= false;
+    }
+    return ret;
+}
+
+bool BlockDevice::isDirect() {
+    return this->direct;
+}
+
+BufferPool *BlockDevice::getBufferPool() {
+    return this->bufferPool;
+}
+
+void BlockDevice::setTracer(IoTracer *tracer) {
+    this->tracer = tracer;
+}
+
+bool BlockDevice::isMapped() {
+    return this->mapping != nullptr;
+}
+
+const char *BlockDevice::getBlock(uint32_t blockNo) {
+    if (blockNo >= this->mappingBlocks)
+        return nullptr;
+    return this->mapping + (size_t) blockNo * this->blockSize;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::discard(uint32_t firstBlock, uint32_t count) {
+    if (count == 0)
+        return 0;
+    if (fallocate(this->contFile, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t) firstBlock * this->blockSize,
+                  (off_t) count * this->blockSize) < 0)
+        return -errno;
+    return 0;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::preallocate(uint32_t firstBlock, uint32_t count) {
+    if (count == 0)
+        return 0;
+    if (fallocate(this->contFile, 0, (off_t) firstBlock * this->blockSize, (off_t) count * this->blockSize) < 0)
+        return -errno;
+    return 0;
+}
+
+void BlockDevice::adviseSequential(uint32_t firstBlock, uint32_t count) {
+    advise(firstBlock, count, MADV_SEQUENTIAL);
+}
+
+void BlockDevice::adviseWillNeed(uint32_t firstBlock, uint32_t count) {
+    advise(firstBlock, count, MADV_WILLNEED);
+}
+
+// madvise() needs a page aligned start address, so the range is widened to full pages
+void BlockDevice::advise(uint32_t firstBlock, uint32_t count, int advice) {
+    if (this->mapping == nullptr || firstBlock >= this->mappingBlocks)
+        return;
+    if (count > this->mappingBlocks - firstBlock)
+        count = this->mappingBlocks - firstBlock;
+
+    size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+    size_t start = (size_t) firstBlock * this->blockSize;
+    size_t end = start + (size_t) count * this->blockSize;
+    start -= start % pageSize;
+    (void) madvise(this->mapping + start, end - start, advice);
+}
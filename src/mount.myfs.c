@@ -21,22 +21,54 @@
 struct fuse_operations myfs_oper;
 
 struct myfs_config {
-    char *containerFileName;
+    char *containerFileNames[MAX_CONTAINER_FILES];
+    int numContainerFiles;
+    int stripeUnit;
+    char *mirror;
     char *logFileName;
+    char *backend;
+    int cacheBlocks;
+    int writeBack;
+    int flushOnRelease;
+    int blockSize;
+    int directIo;
+    char *simulate;
+    int simulateDelay;
+    char *traceFile;
+    int compress;
+    int dedup;
+    int commit;
+    char *size;
 };
 enum {
     KEY_HELP,
     KEY_VERSION,
+    KEY_CONTAINER,
 };
 
 #define MYFS_OPT(t, p, v) { t, offsetof(struct myfs_config, p), v }
 
 static struct fuse_opt myfs_opts[] = {
-        MYFS_OPT("-c %s",             containerFileName, 0),
-        MYFS_OPT("containerfile=%s",  containerFileName, 0),
         MYFS_OPT("-l %s",             logFileName, 0),
         MYFS_OPT("logfile=%s",        logFileName, 0),
+        MYFS_OPT("backend=%s",        backend, 0),
+        MYFS_OPT("cache=%d",          cacheBlocks, 0),
+        MYFS_OPT("writeback",         writeBack, 1),
+        MYFS_OPT("flushonrelease",    flushOnRelease, 1),
+        MYFS_OPT("blocksize=%d",      blockSize, 0),
+        MYFS_OPT("direct",            directIo, 1),
+        MYFS_OPT("simulate=%s",       simulate, 0),
+        MYFS_OPT("simdelay",          simulateDelay, 1),
+        MYFS_OPT("trace=%s",          traceFile, 0),
+        MYFS_OPT("stripe=%d",         stripeUnit, 0),
+        MYFS_OPT("mirror=%s",         mirror, 0),
+        MYFS_OPT("compress",          compress, 1),
+        MYFS_OPT("dedup",             dedup, 1),
+        MYFS_OPT("commit=%d",         commit, 0),
+        MYFS_OPT("size=%s",           size, 0),
 
+        FUSE_OPT_KEY("-c ",            KEY_CONTAINER),
+        FUSE_OPT_KEY("containerfile=", KEY_CONTAINER),
         FUSE_OPT_KEY("-V",             KEY_VERSION),
         FUSE_OPT_KEY("--version",      KEY_VERSION),
         FUSE_OPT_KEY("-h",             KEY_HELP),
@@ -54,9 +86,44 @@ static int myfs_opt_proc(void *data, const char *arg, int key, struct fuse_args
                     "\n"
                     "Myfs options:\n"
                     "    -o containerfile=FILE\n"
-                    "    -c FILE            same as '-o containerfile=FILE'\n"
+                    "    -c FILE            same as '-o containerfile=FILE'; given several times, the\n"
+                    "                       blocks are striped (or mirrored) over all files (always\n"
+                    "                       give the same files in the same order)\n"
+                    "    -o stripe=BYTES    stripe unit with several container files (default: 65536)\n"
+                    "    -o mirror=queue|locality\n"
+                    "                       keep identical copies in all container files instead of\n"
+                    "                       striping; reads go to the member with the fewest blocks\n"
+                    "                       in flight (queue) or the nearest position (locality)\n"
                     "    -o logfile=FILE\n"
-                    "    -l FILE            same as '-o logfile=FILE'\n");
+                    "    -l FILE            same as '-o logfile=FILE'\n"
+                    "    -o backend=sync|uring|mmap|ram\n"
+                    "                       block I/O backend (default: sync), ram keeps the\n"
+                    "                       container in memory only\n"
+                    "    -o cache=BLOCKS    capacity of the block cache, 0 disables it\n"
+                    "    -o writeback       write-back caching, dirty blocks are written by a\n"
+                    "                       background thread\n"
+                    "    -o flushonrelease  with writeback, flush dirty blocks when a file is closed\n"
+                    "    -o blocksize=BYTES block size of a new container, a power of two between\n"
+                    "                       512 and 65536 (default: 4096)\n"
+                    "    -o direct          open the container with O_DIRECT, bypassing the page\n"
+                    "                       cache of the host (not with backend=mmap)\n"
+                    "    -o simulate=hdd|ssd|net|LATENCY_US:SEEK_NS_PER_BLOCK:MAX_SEEK_US:MB_PER_S\n"
+                    "                       account device time of a slow device (not with\n"
+                    "                       backend=mmap), the time is logged on unmount\n"
+                    "    -o simdelay        with simulate, really wait for the simulated time\n"
+                    "    -o trace=FILE      record all block I/O on the container in FILE, replay\n"
+                    "                       it with replay.myfs (not with backend=ram or several\n"
+                    "                       container files)\n"
+                    "    -o compress        compress file data with LZ4 in units of 64 KiB; compressed\n"
+                    "                       files stay readable when mounting without it\n"
+                    "    -o dedup           store blocks whose content is stored already only once\n"
+                    "                       (not with compress)\n"
+                    "    -o commit=OPS      write metadata changes once every OPS operations\n"
+                    "                       instead of after each one; a crash may lose the metadata\n"
+                    "                       changes of the last OPS operations (default: 1)\n"
+                    "    -o size=SIZE       file data a new container holds, e.g. 4G (suffixes K, M,\n"
+                    "                       G and T); more than 65536 blocks need 32 bit FAT entries\n"
+                    "                       (default: 55912 blocks)\n");
             exit(1);
 
         case KEY_VERSION:
@@ -64,10 +131,57 @@ static int myfs_opt_proc(void *data, const char *arg, int key, struct fuse_args
             fuse_opt_add_arg(outargs, "--version");
             fuse_main(outargs->argc, outargs->argv, &myfs_oper, NULL);
             exit(0);
+
+        case KEY_CONTAINER: {
+            // several container files are collected for striping
+            struct myfs_config *conf = data;
+            if (conf->numContainerFiles == MAX_CONTAINER_FILES) {
+                fprintf(stderr, "Error: At most %d container files are supported\n", MAX_CONTAINER_FILES);
+                exit(EXIT_FAILURE);
+            }
+            const char *fileName = strncmp(arg, "-c", 2) == 0 ? arg + 2 : strchr(arg, '=') + 1;
+            conf->containerFileNames[conf->numContainerFiles++] = strdup(fileName);
+            return 0;
+        }
     }
     return 1;
 }
 
+// returns the absolute path of a container file, exits if the file or its directory can not be accessed
+static char *checkContainerFile(const char *name) {
+    char *fileName= realpath(name, NULL);
+
+    if(fileName == NULL) {
+        // container file does not exist, check if path is writable
+        char *fileNameCpy= malloc(strlen(name)+1);
+        strcpy(fileNameCpy, name);
+        char *dirName= dirname(fileNameCpy);
+        char *containerPathName= realpath(dirName, NULL);
+        // free(dirName);
+        if (containerPathName == NULL || access(containerPathName, R_OK | W_OK) != 0 ) {
+            fprintf(stderr, "Error: Cannot access container directory %s\n", containerPathName == NULL ? "" : containerPathName);
+            exit(EXIT_FAILURE);
+        }
+        fileName= (char *) malloc(PATH_MAX);
+        strcpy(fileNameCpy, name);
+        char *containerBaseName= basename(fileNameCpy);
+        strcpy(fileName, containerPathName);
+        strcat(fileName, "/");
+        strcat(fileName, containerBaseName);
+        // free(containerBaseName);
+        free(containerPathName);
+        free(fileNameCpy);
+    } else {
+        // container file does exit, check if it is writable
+        if (fileName == NULL || access(fileName, R_OK | W_OK) != 0 ) {
+            fprintf(stderr, "Error: Cannot access container file %s\n", fileName);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return fileName;
+}
+
 int main(int argc, char *argv[]) {
     int fuse_stat;
 
@@ -112,42 +226,31 @@ int main(int argc, char *argv[]) {
     struct myfs_config conf;
 
     memset(&conf, 0, sizeof(conf));
+    conf.cacheBlocks= -1;
 
     fuse_opt_parse(&args, &conf, myfs_opts, myfs_opt_proc);
 
     // FsInfo will be used to pass information to fuse functions
     struct MyFsInfo *FsInfo;
     FsInfo= malloc(sizeof(struct MyFsInfo));
-    // check if container file is accessible
-    if(conf.containerFileName != NULL) {
-        containerFileName= realpath(conf.containerFileName, NULL);
-
-        if(containerFileName == NULL) {
-            // container file does not exist, check if path is writable
-            char *containerFileNameCpy= malloc(strlen(conf.containerFileName)+1);
-            strcpy(containerFileNameCpy, conf.containerFileName);
-            char *dirName= dirname(containerFileNameCpy);
-            char *containerPathName= realpath(dirName, NULL);
-            // free(dirName);
-            if (containerPathName == NULL || access(containerPathName, R_OK | W_OK) != 0 ) {
-                fprintf(stderr, "Error: Cannot access container directory %s\n", containerPathName == NULL ? "" : containerPathName);
-                exit(EXIT_FAILURE);
-            }
-            containerFileName= (char *) malloc(PATH_MAX);
-            strcpy(containerFileNameCpy, conf.containerFileName);
-            char *containerBaseName= basename(containerFileNameCpy);
-            strcpy(containerFileName, containerPathName);
-            strcat(containerFileName, "/");
-            strcat(containerFileName, containerBaseName);
-            // free(containerBaseName);
-            free(containerPathName);
-            free(containerFileNameCpy);
-        } else {
-            // container file does exit, check if it is writable
-            if (containerFileName == NULL || access(containerFileName, R_OK | W_OK) != 0 ) {
-                fprintf(stderr, "Error: Cannot access container file %s\n", containerFileName);
-                exit(EXIT_FAILURE);
+    // check if container files are accessible
+    if(conf.numContainerFiles > 0) {
+        // several container files are passed as one list, see MultiDevice
+        size_t length= 0;
+        char *fileNames[MAX_CONTAINER_FILES];
+        for(int i= 0; i < conf.numContainerFiles; i++) {
+            fileNames[i]= checkContainerFile(conf.containerFileNames[i]);
+            length+= strlen(fileNames[i]) + 1;
+        }
+        containerFileName= (char *) malloc(length);
+        containerFileName[0]= '\0';
+        for(int i= 0; i < conf.numContainerFiles; i++) {
+            if(i > 0) {
+                strcat(containerFileName, ":");
             }
+            strcat(containerFileName, fileNames[i]);
+            free(fileNames[i]);
+            free(conf.containerFileNames[i]);
         }
 
         // container file is used, so we are not in memory!
@@ -174,7 +277,23 @@ int main(int argc, char *argv[]) {
     // everything ok, lets go
     // container & log file name will be passed to fuse functions
     FsInfo->contFile= containerFileName;
+    FsInfo->numContFiles= conf.numContainerFiles;
+    FsInfo->stripeUnit= conf.stripeUnit;
+    FsInfo->mirror= conf.mirror;
     FsInfo->logFile= logFileName;
+    FsInfo->backend= conf.backend;
+    FsInfo->cacheBlocks= conf.cacheBlocks;
+    FsInfo->writeBack= conf.writeBack;
+    FsInfo->flushOnRelease= conf.flushOnRelease;
+    FsInfo->blockSize= conf.blockSize;
+    FsInfo->directIo= conf.directIo;
+    FsInfo->simulate= conf.simulate;
+    FsInfo->simulateDelay= conf.simulateDelay;
+    FsInfo->traceFile= conf.traceFile;
+    FsInfo->compress= conf.compress;
+    FsInfo->dedup= conf.dedup;
+    FsInfo->commit= conf.commit;
+    FsInfo->size= conf.size;
 
     // add additoinal "-s"
     fuse_opt_add_arg(&args, "-s");
@@ -17,11 +17,16 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
 
 #include "macros.h"
 #include "myfs.h"
 #include "myfs-info.h"
 #include "blockdevice.h"
+#include "RamBlockDevice.h"
 #include "myinmemoryfs.h"
 
 
@@ -29,13 +34,22 @@
 ///
 /// You may add your own constructor code here.
 MyOnDiskFS::MyOnDiskFS() : MyFS() {
-    // create a block device object
-    this->blockDevice = new BlockDevice(BLOCK_SIZE);
-
-    root = new Root(blockDevice);
-    buffer = new char[BLOCK_SIZE];
-    dmap = new DMAP(blockDevice);
-    fat = new FAT(blockDevice);
+    // the storage backend is selected at mount time, see createStorage()
+    this->blockSize = BD_BLOCK_SIZE;
+    this->blockDevice = nullptr;
+    this->simulatedDevice = nullptr;
+    this->stripedDevice = nullptr;
+    this->mirroredDevice = nullptr;
+    this->tracer = nullptr;
+    this->scheduler = nullptr;
+    this->cache = nullptr;
+    this->superBlock = nullptr;
+    root = nullptr;
+    dmap = nullptr;
+    cmap = nullptr;
+    compressor = nullptr;
+    ddt = nullptr;
+    fat = nullptr;
     for (int i = 0; i < NUM_OPEN_FILES; i++) {
         openFiles[i] = nullptr;
     }
@@ -48,8 +62,14 @@ MyOnDiskFS::~MyOnDiskFS() {
     // free block device object
     delete root;
     delete fat;
+    delete ddt;
     delete dmap;
+    delete compressor;
+    delete cmap;
+    delete superBlock;
 
+    delete this->cache;
+    delete this->scheduler;
     delete this->blockDevice;
 
 
@@ -65,6 +85,8 @@ MyOnDiskFS::~MyOnDiskFS() {
 /// \return 0 on success, -ERRNO on failure.
 int MyOnDiskFS::fuseMknod(const char *path, mode_t mode, dev_t dev) {
     LOGM();
+    IoBatch batch(scheduler);
+    MetadataCommit commit(this);
     int ret = 0;
     std::string name = std::string(path);
     if (root->getRootEntryFile(path) != nullptr) {
@@ -79,6 +101,8 @@ int MyOnDiskFS::fuseMknod(const char *path, mode_t mode, dev_t dev) {
         }
         this->root->discWrite(file);
     }
+    ret = commit.end(ret);
+    ret = batch.end(ret);
     RETURN(ret);
 }
 
@@ -91,6 +115,8 @@ int MyOnDiskFS::fuseMknod(const char *path, mode_t mode, dev_t dev) {
 /// \return 0 on success, -ERRNO on failure.
 int MyOnDiskFS::fuseUnlink(const char *path) {
     LOGM();
+    IoBatch batch(scheduler);
+    MetadataCommit commit(this);
 
     int ret = 0;
     rootFile *file = root->getRootEntryFile(path);
@@ -100,18 +126,25 @@ int MyOnDiskFS::fuseUnlink(const char *path) {
         LOGF("firstFAT: %d", file->firstBlock);
         if (file->firstBlock != FAT_END) {
             int actualBlock = file->firstBlock;
+            std::vector<int> freed;
+            freed.reserve(std::max(file->blockCount, 0));
 
             while (actualBlock != FAT_END) {
                 int nextBlock = fat->getNext(actualBlock);
-                dmap->setBlock(actualBlock, false);
+                freed.push_back(actualBlock);
                 fat->freeBlock(actualBlock);
                 actualBlock = nextBlock;
             }
+            // the space of the freed blocks goes back to the host, unless other files still share their content
+            dmap->freeBlocks(ddt->release(freed));
+            compressor->release(freed);
         }
         root->deleteFile(path);
 
     }
 
+    ret = commit.end(ret);
+    ret = batch.end(ret);
     RETURN(ret);
 
 }
@@ -127,6 +160,8 @@ int MyOnDiskFS::fuseUnlink(const char *path) {
 /// \return 0 on success, -ERRNO on failure.
 int MyOnDiskFS::fuseRename(const char *path, const char *newpath) {
     LOGM();
+    IoBatch batch(scheduler);
+    MetadataCommit commit(this);
 
     int ret = 0;
     newpath++;
@@ -140,6 +175,8 @@ int MyOnDiskFS::fuseRename(const char *path, const char *newpath) {
         strcpy(file->name, newpath);
         root->discWrite(file);
     }
+    ret = commit.end(ret);
+    ret = batch.end(ret);
     RETURN(ret);
 }
 
@@ -178,6 +215,8 @@ int MyOnDiskFS::fuseGetattr(const char *path, struct stat *statbuf) {
 /// \return 0 on success, -ERRNO on failure.
 int MyOnDiskFS::fuseChmod(const char *path, mode_t mode) {
     LOGM();
+    IoBatch batch(scheduler);
+    MetadataCommit commit(this);
     int ret = 0;
     if (root->getRootEntryFile(path) == nullptr) {
         ret = -ENOENT;
@@ -187,6 +226,8 @@ int MyOnDiskFS::fuseChmod(const char *path, mode_t mode) {
         file->fileStats.st_mtime = time(NULL);
         root->discWrite(file);
     }
+    ret = commit.end(ret);
+    ret = batch.end(ret);
     RETURN(ret);
 }
 
@@ -200,6 +241,8 @@ int MyOnDiskFS::fuseChmod(const char *path, mode_t mode) {
 /// \return 0 on success, -ERRNO on failure.
 int MyOnDiskFS::fuseChown(const char *path, uid_t uid, gid_t gid) {
     LOGM();
+    IoBatch batch(scheduler);
+    MetadataCommit commit(this);
 
     int ret = 0;
     if (root->getRootEntryFile(path) == nullptr) {
@@ -211,6 +254,8 @@ int MyOnDiskFS::fuseChown(const char *path, uid_t uid, gid_t gid) {
         file->fileStats.st_mtime = time(NULL);
         root->discWrite(file);
     }
+    ret = commit.end(ret);
+    ret = batch.end(ret);
     RETURN(ret);
 }
 
@@ -233,6 +278,8 @@ int MyOnDiskFS::fuseOpen(const char *path, struct fuse_file_info *fileInfo) {
 
         openFile *openFile = new ::openFile();
         openFile->file = root->getRootEntryFile(path);
+        // the blocks of the file are indexed in a flat array while it is open
+        getExtents(openFile->file)->open();
 
         int openIndex = getIndexOpen();
         LOGF("openIndex: %d", openIndex);
@@ -270,34 +317,56 @@ int MyOnDiskFS::fuseRead(const char *path, char *buf, size_t size, off_t offset,
         ret = -EBADF;
     } else {
         rootFile *file = root->getRootEntryFile(path);
+        if (offset >= file->fileStats.st_size) {
+            RETURN(0);
+        }
         if (offset + size > file->fileStats.st_size) {
             size = file->fileStats.st_size - offset;
 
         }
         LOGF("--> Trying to read %s, %lu, %lu\n", path, (unsigned long) offset, size);
 
-        int offsetBlock = offset / BLOCK_SIZE;
-        int blocks = ceil((size + (offset % BLOCK_SIZE)) / (double) BLOCK_SIZE);
-        int currentBlock = file->firstBlock;
-        int newOffset = 0;
+        if (compressedRange(file, offset, size)) {
+            ret = readUnits(file, buf, size, offset);
+            RETURN(ret);
+        }
+
+        int offsetBlock = offset / blockSize;
+        int blocks = ceil((size + (offset % blockSize)) / (double) blockSize);
+        std::vector<BlockRequest> requests(blocks);
+        collectBlocks(file, offsetBlock, requests);
 
-        for (int i = 0; i < offsetBlock; i++) currentBlock = fat->getNext(currentBlock);
+        if (this->blockDevice->isMapped()) {
+            readMapped(requests, buf, size, offset % blockSize);
+            RETURN((int) size);
+        }
 
+        // full blocks are read directly into buf, the partial first and last block are copied out of the cache
+        int headOffset = offset % blockSize;
+        std::vector<BlockRequest> fullBlocks;
+        size_t done = 0;
         for (int i = 0; i < blocks; i++) {
-            char buff[BLOCK_SIZE] = {};
-            this->blockDevice->read(currentBlock + DATA_OFFSET, buff);
-            if (i == 0) {
-                memcpy(buf, &(buff[offset % BLOCK_SIZE]),
-                       (size < BLOCK_SIZE - (offset % BLOCK_SIZE) ? size : BLOCK_SIZE - (offset % BLOCK_SIZE)));
-                newOffset += BLOCK_SIZE - (offset % BLOCK_SIZE);
-            } else if (i == blocks - 1) {
-                memcpy(buf + newOffset, buff, size - newOffset);
+            int inBlock = i == 0 ? headOffset : 0;
+            size_t len = std::min(size - done, (size_t) (blockSize - inBlock));
+            if (ddt->isZero(requests[i].blockNo - superBlock->getDataOffset())) {
+                // blocks of zeros are holes, there is nothing to read
+                memset(buf + done, 0, len);
+            } else if (len == blockSize) {
+                requests[i].buffer = buf + done;
+                fullBlocks.push_back(requests[i]);
             } else {
-                memcpy(buf + newOffset, buff, BLOCK_SIZE);
-                newOffset += BLOCK_SIZE;
+                ret = readPartial(requests[i].blockNo, buf + done, inBlock, len);
+                if (ret < 0) {
+                    RETURN(ret);
+                }
             }
-            currentBlock = fat->getNext(currentBlock);
+            done += len;
+        }
+        ret = this->cache->readBlocks(fullBlocks.data(), fullBlocks.size());
+        if (ret < 0) {
+            RETURN(ret);
         }
+        readAhead(openFiles[fileInfo->fh], offset, size, offsetBlock + blocks - 1);
         ret = size;
     }
     RETURN(ret)
@@ -321,84 +390,467 @@ int MyOnDiskFS::fuseRead(const char *path, char *buf, size_t size, off_t offset,
 int
 MyOnDiskFS::fuseWrite(const char *path, const char *buf, size_t size, off_t offset, struct fuse_file_info *fileInfo) {
     LOGM();
+    IoBatch batch(scheduler);
+    MetadataCommit commit(this);
 
     int ret = 0;
 
-    if (openFiles[fileInfo->fh] != nullptr) {
+    if (openFiles[fileInfo->fh] != nullptr && size == 0) {
+        ret = 0;
+    } else if (openFiles[fileInfo->fh] != nullptr) {
         rootFile *file = openFiles[fileInfo->fh]->file;
+        off_t oldSize = file->fileStats.st_size;
 
+        int oldBlocks = numBlocks(oldSize);
         if (size + offset > file->fileStats.st_size) {
-            this->setFATBlocks(size, offset, file);
+            ret = this->setFATBlocks(size, offset, file);
+            if (ret < 0) {
+                RETURN(ret);
+            }
+            // new blocks in the gap between the old end of the file and the written range read as zeros
+            std::vector<int> gap;
+            for (int i = oldBlocks; i < offset / blockSize; i++) {
+                gap.push_back(getExtents(file)->getBlock(i));
+            }
+            ret = clearBlocks(gap);
+            if (ret < 0) {
+                RETURN(ret);
+            }
         }
-        int offsetBlock = offset / BLOCK_SIZE;
-        int blocks = ceil((size + (offset % BLOCK_SIZE)) / (double) BLOCK_SIZE);
-        int currentBlock = file->firstBlock;
-        int newOffset = 0;
-
-        for (int i = 0; i < offsetBlock; i++) currentBlock = fat->getNext(currentBlock);
-
+        if (compressor->isEnabled() || compressedRange(file, offset, size)) {
+            // whole units are read, patched and written, compressed if enabled
+            ret = writeUnits(file, buf, size, offset, oldSize);
+            if (ret >= 0) {
+                root->discWrite(file);
+                writtenBytes += size;
+            }
+            ret = commit.end(ret);
+            ret = batch.end(ret);
+            RETURN(ret);
+        }
+        int offsetBlock = offset / blockSize;
+        int blocks = ceil((size + (offset % blockSize)) / (double) blockSize);
+        std::vector<BlockRequest> requests(blocks);
+        collectBlocks(file, offsetBlock, requests, true);
+
+        // full blocks are written directly from buf, the partial first and last block are read, patched and
+        // written back; blocks sharing content are read from the shared block, holes of zeros and blocks new to the
+        // file are not read at all
+        uint32_t dataOffset = superBlock->getDataOffset();
+        BlockBuffer headBuffer(cache->getBufferPool());
+        BlockBuffer tailBuffer(cache->getBufferPool());
+        char *head = headBuffer.data();
+        char *tail = tailBuffer.data();
+        int headOffset = offset % blockSize;
+        BlockRequest partial[2];
+        int numPartial = 0;
         for (int i = 0; i < blocks; i++) {
-            char buff[BLOCK_SIZE] = {};
-            this->blockDevice->read(currentBlock + DATA_OFFSET, buff);
-            if (i == 0) {
-                memcpy(&(buff[offset % BLOCK_SIZE]), buf,
-                       (size < BLOCK_SIZE - (offset % BLOCK_SIZE) ? size : BLOCK_SIZE - (offset % BLOCK_SIZE)));
-                newOffset += BLOCK_SIZE - (offset % BLOCK_SIZE);
-                this->blockDevice->write(currentBlock + DATA_OFFSET, buff);
-            } else if (i == blocks - 1) {
-                memcpy(buff, buf + newOffset, size - newOffset);
-                this->blockDevice->write(currentBlock + DATA_OFFSET, buff);
+            long start = (long) i * blockSize - headOffset;
+            if (start < 0 || start + blockSize > (long) size) {
+                requests[i].buffer = start < 0 ? head : tail;
+                int block = requests[i].blockNo - dataOffset;
+                if (ddt->isZero(block) || offsetBlock + i >= oldBlocks) {
+                    memset(requests[i].buffer, 0, blockSize);
+                } else {
+                    partial[numPartial] = requests[i];
+                    partial[numPartial++].blockNo = ddt->getStorage(block) + dataOffset;
+                }
             } else {
-                memcpy(buff, buf + newOffset, BLOCK_SIZE);
-                newOffset += BLOCK_SIZE;
-                this->blockDevice->write(currentBlock + DATA_OFFSET, buff);
+                requests[i].buffer = const_cast<char *>(buf + start);
             }
-            currentBlock = fat->getNext(currentBlock);
         }
+        ret = this->cache->readBlocks(partial, numPartial);
+        if (ret < 0) {
+            RETURN(ret);
+        }
+
+        if (requests[0].buffer == head) {
+            memcpy(head + headOffset, buf, std::min(size, (size_t) (blockSize - headOffset)));
+        }
+        if (requests[blocks - 1].buffer == tail) {
+            long start = (long) (blocks - 1) * blockSize - headOffset;
+            memcpy(tail, buf + start, size - start);
+        }
+        if (ddt->hasTable()) {
+            // blocks of zeros and blocks whose content is stored already are not written, shared blocks are not
+            // overwritten
+            ret = ddt->writeBlocks(requests.data(), blocks);
+        } else {
+            ret = this->cache->writeBlocks(requests.data(), blocks);
+        }
+        if (ret < 0) {
+            RETURN(ret);
+        }
+
         if ((off_t) (offset + size) > file->fileStats.st_size) {
             file->fileStats.st_size = offset + size;
         }
         root->discWrite(file);
+        writtenBytes += size;
         ret = size;
     } else {
         ret = -EBADF;
     }
 
+    ret = commit.end(ret);
+    ret = batch.end(ret);
     RETURN(ret)
 }
 
-int MyOnDiskFS::numBlocks(int size) {
-    return (size >> 9) + ((size % BLOCK_SIZE) != 0 ? 1 : 0);
+int MyOnDiskFS::numBlocks(off_t size) {
+    return size / blockSize + ((size % blockSize) != 0 ? 1 : 0);
 }
 
-void MyOnDiskFS::setFATBlocks(size_t size, off_t offset, rootFile *file) {
-    int blocks = numBlocks(size + offset) - numBlocks(file->fileStats.st_size); //Blöcke zum schreiben
-    int offsetBlock = offset / BLOCK_SIZE; //offset um auf existierendem block zu schreiben
-    int blocksAll = blocks + offsetBlock - (file->fileStats.st_size / BLOCK_SIZE); //neue blöcke anhängen
-    LOGF("blocks: %d, offsetBlock: %d, blocksAll: %d", blocks, offsetBlock, blocksAll);
+/// Appends the blocks a file of size + offset bytes needs to its FAT chain. Returns -ENOSPC, without changing the file,
+/// if the container has not enough free blocks.
+int MyOnDiskFS::setFATBlocks(size_t size, off_t offset, rootFile *file, bool holes) {
+    // the FAT chain of a file always holds exactly numBlocks(st_size) blocks; a file larger than the data region can
+    // never fit, checking it first keeps the block counts in the range of an int
+    if ((uint64_t) (size + offset) / blockSize >= superBlock->getNumDataBlocks()) {
+        return -ENOSPC;
+    }
+    int oldBlocks = numBlocks(file->fileStats.st_size);
+    int blocksAll = numBlocks(size + offset) - oldBlocks; //neue blöcke anhängen
+    LOGF("blocksAll: %d", blocksAll);
     if (blocksAll > 0) {
-        //find old last Block
-        int *newBlocks = dmap->getCertainNumberOfFreeBlocks(blocksAll);
-        int currentBlock = file->firstBlock;
-        if (currentBlock == FAT_END) {
+        // holes are not reserved in the container, they are punched right away
+        int *newBlocks = dmap->getCertainNumberOfFreeBlocks(blocksAll, !(holes && ddt->hasTable()));
+        if (newBlocks == nullptr) {
+            LOGF("ERROR: No space for %d more blocks", blocksAll);
+            return -ENOSPC;
+        }
+        if (file->blockCount < 0) {
+            // entries of older containers have no tail pointer, the extent map finds the last block once
+            file->lastBlock = getExtents(file)->getLastBlock();
+            file->blockCount = oldBlocks;
+        }
+        if (file->firstBlock == FAT_END) {
             file->firstBlock = newBlocks[0];
         } else {
-            while (fat->getNext(currentBlock) != FAT_END) {
-                currentBlock = fat->getNext(currentBlock);
-            }
-            fat->setNext(currentBlock, newBlocks[0]);
+            // new blocks are linked behind the tail pointer of the entry, the chain is not walked
+            fat->setNext(file->lastBlock, newBlocks[0]);
         }
-        currentBlock = newBlocks[0];
+        // a map that is not loaded yet is built from the chain later, which then holds the new blocks already
+        ExtentMap *extents = root->getExtents(file);
+        if (extents->isLoaded()) {
+            extents->append(newBlocks, blocksAll);
+        }
+        file->lastBlock = newBlocks[blocksAll - 1];
+        file->blockCount = oldBlocks + blocksAll;
+        int currentBlock = newBlocks[0];
         //set new Blocks
         for (int i = 1; i < blocksAll; i++) {
             fat->setNext(currentBlock, newBlocks[i]);
             currentBlock = newBlocks[i];
         }
         fat->setNext(currentBlock, FAT_END);
+        int ret = holes ? clearBlocks(std::vector<int>(newBlocks, newBlocks + blocksAll)) : 0;
         delete[] newBlocks;
+        return ret;
+    }
+    return 0;
+}
+
+/// Makes newly allocated data blocks read as zeros. They become holes if the container has a dedup table and can punch
+/// them, otherwise zeros are written.
+int MyOnDiskFS::clearBlocks(const std::vector<int> &blocks) {
+    if (blocks.empty() || (ddt->hasTable() && ddt->makeHoles(blocks) >= 0)) {
+        return 0;
+    }
+    BlockBuffer zeros(cache->getBufferPool());
+    memset(zeros.data(), 0, blockSize);
+    std::vector<BlockRequest> requests(blocks.size());
+    for (size_t i = 0; i < blocks.size(); i++) {
+        requests[i].blockNo = blocks[i] + superBlock->getDataOffset();
+        requests[i].buffer = zeros.data();
+    }
+    return this->cache->writeBlocks(requests.data(), requests.size());
+}
+
+/// Zeroes the bytes behind the end of a file in its last block, so they read as zeros when the file grows again. The
+/// block must not be part of a compressed unit.
+int MyOnDiskFS::clearTail(rootFile *file) {
+    off_t size = file->fileStats.st_size;
+    int inBlock = size % blockSize;
+    int block = getExtents(file)->getBlock(size / blockSize);
+    if (inBlock == 0 || block == FAT_END || ddt->isZero(block)) {
+        return 0;
+    }
+    // a block sharing its content is read from the shared block, the DDT writes it to its own
+    BlockBuffer buffer(cache->getBufferPool());
+    BlockRequest request;
+    request.blockNo = ddt->getStorage(block) + superBlock->getDataOffset();
+    request.buffer = buffer.data();
+    int ret = this->cache->readBlocks(&request, 1);
+    if (ret < 0) {
+        return ret;
+    }
+    memset(buffer.data() + inBlock, 0, blockSize - inBlock);
+    request.blockNo = block + superBlock->getDataOffset();
+    return ddt->hasTable() ? ddt->writeBlocks(&request, 1) : this->cache->writeBlocks(&request, 1);
+}
+
+/// Detects sequential reads of an open file and prefetches the following blocks into the block cache, looked up in the
+/// extent map of the file. The readahead window doubles with every sequential read up to
+/// READAHEAD_MAX_BLOCKS and is reset by a random access. New blocks are fetched once the reader has consumed half of
+/// the prefetched ones, so the device sees few large requests.
+void MyOnDiskFS::readAhead(openFile *openFile, off_t offset, size_t size, int lastFileBlock) {
+    bool sequential = offset == openFile->nextReadOffset;
+    openFile->nextReadOffset = offset + size;
+    if (!sequential || this->cache->getCapacity() == 0) {
+        openFile->readAheadWindow = 0;
+        openFile->readAheadEnd = 0;
+        return;
+    }
+    openFile->readAheadWindow = openFile->readAheadWindow == 0 ? READAHEAD_MIN_BLOCKS
+                                                                : std::min(2 * openFile->readAheadWindow,
+                                                                           READAHEAD_MAX_BLOCKS);
+
+    int first = std::max(openFile->readAheadEnd, lastFileBlock + 1);
+    if (first - (lastFileBlock + 1) >= openFile->readAheadWindow / 2) {
+        return;
+    }
+    int end = std::min(lastFileBlock + 1 + openFile->readAheadWindow,
+                       numBlocks(openFile->file->fileStats.st_size));
+    if (first >= end) {
+        return;
+    }
+
+    std::vector<BlockRequest> blocks(end - first);
+    collectBlocks(openFile->file, first, blocks, true);
+    std::vector<uint32_t> blockNos;
+    for (const BlockRequest &request: blocks) {
+        int block = request.blockNo - superBlock->getDataOffset();
+        if (!ddt->isZero(block)) {
+            blockNos.push_back(ddt->getStorage(block) + superBlock->getDataOffset());
+        }
+    }
+    LOGF("Readahead of %lu blocks (window %d)", (unsigned long) blockNos.size(), openFile->readAheadWindow);
+    this->cache->prefetch(blockNos.data(), blockNos.size());
+    openFile->readAheadEnd = end;
+}
+
+/// Copies a part of a block into buf. The block is pinned in the cache, so hot blocks are copied only once.
+int MyOnDiskFS::readPartial(uint32_t blockNo, char *buf, int inBlock, size_t len) {
+    int ret = 0;
+    const char *block = this->cache->pin(blockNo, &ret);
+    if (block != nullptr) {
+        memcpy(buf, block + inBlock, len);
+        this->cache->unpin(blockNo);
+    } else if (ret == 0) {
+        // cache is disabled
+        BlockBuffer buff(cache->getBufferPool());
+        ret = this->cache->read(blockNo, buff.data());
+        memcpy(buf, buff.data() + inBlock, len);
+    }
+    return ret;
+}
+
+/// Copies the blocks of a read request straight from the memory mapped container into buf. Large reads tell the kernel
+/// to read ahead sequentially along each run of contiguous blocks.
+void MyOnDiskFS::readMapped(std::vector<BlockRequest> &requests, char *buf, size_t size, int headOffset) {
+    if (requests.size() >= SEQUENTIAL_READ_BLOCKS) {
+        size_t start = 0;
+        for (size_t i = 1; i <= requests.size(); i++) {
+            if (i == requests.size() || requests[i].blockNo != requests[i - 1].blockNo + 1) {
+                this->blockDevice->adviseSequential(requests[start].blockNo, i - start);
+                start = i;
+            }
+        }
+    }
+
+    size_t done = 0;
+    for (size_t i = 0; i < requests.size(); i++) {
+        int inBlock = i == 0 ? headOffset : 0;
+        size_t len = std::min(size - done, (size_t) (blockSize - inBlock));
+        if (ddt->isZero(requests[i].blockNo - superBlock->getDataOffset())) {
+            memset(buf + done, 0, len);
+        } else {
+            const char *block = this->blockDevice->getBlock(requests[i].blockNo);
+            memcpy(buf + done, block + inBlock, len);
+        }
+        done += len;
     }
 }
 
+/// Returns the extent map of a file. A file whose directory entry has no extent table is mapped from its FAT chain
+/// here; the table is stored with the next write of the entry.
+ExtentMap *MyOnDiskFS::getExtents(rootFile *file) {
+    ExtentMap *extents = root->getExtents(file);
+    if (!extents->isLoaded()) {
+        extents->build(fat, file->firstBlock);
+        LOGF("Mapped %s from the FAT chain: %d blocks in %lu extents", file->name, extents->getBlocks(),
+             (unsigned long) extents->getExtents());
+    }
+    return extents;
+}
+
+/// Fills in the numbers of the device blocks that hold the file blocks starting at firstFileBlock, one per request. A
+/// block sharing the content of another one is read from that block, unless chain asks for the blocks of the FAT chain
+/// themselves. The first block is looked up in the extent map, the following ones are taken along its extents.
+void MyOnDiskFS::collectBlocks(rootFile *file, int firstFileBlock, std::vector<BlockRequest> &requests, bool chain) {
+    ExtentMap *extents = getExtents(file);
+    int currentBlock = FAT_END;
+    int run = 0;
+    for (size_t i = 0; i < requests.size(); i++, currentBlock++, run--) {
+        if (run == 0) {
+            currentBlock = extents->getBlock(firstFileBlock + i, &run);
+            if (currentBlock == FAT_END) {
+                break;
+            }
+        }
+        requests[i].blockNo = (chain ? currentBlock : ddt->getStorage(currentBlock)) + superBlock->getDataOffset();
+    }
+}
+
+/// Tells whether a byte range of a file lies in a compressed unit, so it has to be accessed in whole units.
+bool MyOnDiskFS::compressedRange(rootFile *file, off_t offset, size_t size) {
+    if (!compressor->hasCompressedUnits() || size == 0) {
+        return false;
+    }
+    int unitBlocks = compressor->getUnitBlocks();
+    int first = offset / blockSize / unitBlocks * unitBlocks;
+    int last = (offset + size - 1) / blockSize;
+    ExtentMap *extents = getExtents(file);
+    for (int i = first; i <= last; i += unitBlocks) {
+        int block = extents->getBlock(i);
+        if (block == FAT_END) {
+            break;
+        }
+        if (compressor->isCompressed(block + superBlock->getDataOffset())) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Reads a byte range of a file by decompressing the units it touches. Units stored uncompressed are read as a whole,
+/// too. Returns size on success.
+int MyOnDiskFS::readUnits(rootFile *file, char *buf, size_t size, off_t offset) {
+    int unitBlocks = compressor->getUnitBlocks();
+    off_t unitSize = (off_t) unitBlocks * blockSize;
+    int fileBlocks = numBlocks(file->fileStats.st_size);
+    int firstUnit = offset / unitSize;
+    int lastUnit = (offset + size - 1) / unitSize;
+    std::vector<BlockRequest> blocks(std::min(fileBlocks, (lastUnit + 1) * unitBlocks) - firstUnit * unitBlocks);
+    collectBlocks(file, firstUnit * unitBlocks, blocks);
+
+    std::vector<char> data(unitSize);
+    for (int unit = firstUnit; unit <= lastUnit; unit++) {
+        int count = std::min(unitBlocks, fileBlocks - unit * unitBlocks);
+        int ret = compressor->readUnit(blocks.data() + (unit - firstUnit) * unitBlocks, count, count, data.data());
+        if (ret < 0) {
+            return ret;
+        }
+        off_t unitStart = unit * unitSize;
+        off_t start = std::max(offset, unitStart);
+        off_t end = std::min((off_t) (offset + size), unitStart + unitSize);
+        memcpy(buf + (start - offset), data.data() + (start - unitStart), end - start);
+    }
+    return (int) size;
+}
+
+/// Writes a byte range of a file in whole units: units only partly written are read first. The FAT chain must already
+/// cover the range. Updates the size of the file and returns size on success.
+int MyOnDiskFS::writeUnits(rootFile *file, const char *buf, size_t size, off_t offset, off_t oldSize) {
+    int unitBlocks = compressor->getUnitBlocks();
+    off_t unitSize = (off_t) unitBlocks * blockSize;
+    off_t newSize = std::max(oldSize, (off_t) (offset + size));
+    int fileBlocks = numBlocks(newSize);
+    int oldBlocks = numBlocks(oldSize);
+    int firstUnit = offset / unitSize;
+    int lastUnit = (offset + size - 1) / unitSize;
+    std::vector<BlockRequest> blocks(std::min(fileBlocks, (lastUnit + 1) * unitBlocks) - firstUnit * unitBlocks);
+    collectBlocks(file, firstUnit * unitBlocks, blocks);
+    std::vector<BlockRequest> chain;
+    if (ddt->hasSharedBlocks() || ddt->hasZeroBlocks()) {
+        // blocks sharing content are read from the shared block, but written to their own; holes of zeros get content
+        chain.resize(blocks.size());
+        collectBlocks(file, firstUnit * unitBlocks, chain, true);
+    }
+
+    std::vector<char> data(unitSize);
+    for (int unit = firstUnit; unit <= lastUnit; unit++) {
+        int count = std::min(unitBlocks, fileBlocks - unit * unitBlocks);
+        int valid = std::max(0, std::min(count, oldBlocks - unit * unitBlocks));
+        BlockRequest *unitBlockRequests = blocks.data() + (unit - firstUnit) * unitBlocks;
+        off_t unitStart = unit * unitSize;
+        off_t unitEnd = unitStart + (off_t) count * blockSize;
+        off_t start = std::max(offset, unitStart);
+        off_t end = std::min((off_t) (offset + size), unitEnd);
+
+        if (start > unitStart || end < std::min(newSize, unitEnd)) {
+            int ret = compressor->readUnit(unitBlockRequests, count, valid, data.data());
+            if (ret < 0) {
+                return ret;
+            }
+            // the last block may hold stale bytes behind the old end of the file
+            if (oldSize > unitStart && oldSize < unitEnd) {
+                memset(data.data() + (oldSize - unitStart), 0, unitEnd - oldSize);
+            }
+        } else {
+            memset(data.data() + (end - unitStart), 0, unitEnd - end);
+        }
+        memcpy(data.data() + (start - unitStart), buf + (start - offset), end - start);
+        for (int i = 0; i < count && !chain.empty(); i++) {
+            unitBlockRequests[i].blockNo = chain[(unit - firstUnit) * unitBlocks + i].blockNo;
+            int ret = ddt->unshare(unitBlockRequests[i].blockNo - superBlock->getDataOffset());
+            if (ret < 0) {
+                return ret;
+            }
+        }
+        int ret = compressor->writeUnit(unitBlockRequests, count, valid, data.data());
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    file->fileStats.st_size = newSize;
+    return (int) size;
+}
+
+/// Reads the content of a compressed unit that will be cut by truncating the file to newSize. Its compressed data may
+/// use blocks that are freed, so it is written again by writeTailUnit(). tail stays empty if there is no such unit.
+int MyOnDiskFS::readTailUnit(rootFile *file, off_t newSize, std::vector<char> &tail) {
+    if (!compressor->hasCompressedUnits()) {
+        return 0;
+    }
+    int unitBlocks = compressor->getUnitBlocks();
+    off_t unitSize = (off_t) unitBlocks * blockSize;
+    if (newSize % unitSize == 0) {
+        return 0;
+    }
+    int first = newSize / unitSize * unitBlocks;
+    int count = std::min(unitBlocks, numBlocks(file->fileStats.st_size) - first);
+    std::vector<BlockRequest> blocks(count);
+    collectBlocks(file, first, blocks);
+    if (!compressor->isCompressed(blocks[0].blockNo)) {
+        return 0;
+    }
+    tail.resize(count * blockSize);
+    return compressor->readUnit(blocks.data(), count, count, tail.data());
+}
+
+/// Stores the last unit read by readTailUnit() again, with the new size of the file.
+int MyOnDiskFS::writeTailUnit(rootFile *file, std::vector<char> &tail) {
+    int unitBlocks = compressor->getUnitBlocks();
+    off_t unitSize = (off_t) unitBlocks * blockSize;
+    off_t unitStart = file->fileStats.st_size / unitSize * unitSize;
+    int first = unitStart / blockSize;
+    int count = numBlocks(file->fileStats.st_size) - first;
+    std::vector<BlockRequest> blocks(count);
+    collectBlocks(file, first, blocks, true);
+    for (int i = 0; i < count; i++) {
+        int ret = ddt->unshare(blocks[i].blockNo - superBlock->getDataOffset());
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    // the cut off bytes read as zeros if the file grows again
+    off_t kept = file->fileStats.st_size - unitStart;
+    memset(tail.data() + kept, 0, count * blockSize - kept);
+    return compressor->writeUnit(blocks.data(), count, count, tail.data());
+}
+
 /// @brief Close a file.
 ///
 /// \param [in] path Name of the file, starting with "/".
@@ -406,6 +858,7 @@ void MyOnDiskFS::setFATBlocks(size_t size, off_t offset, rootFile *file) {
 /// \return 0 on success, -ERRNO on failure.
 int MyOnDiskFS::fuseRelease(const char *path, struct fuse_file_info *fileInfo) {
     LOGM();
+    IoBatch batch(scheduler);
     int ret = 0;
     if (root->getRootEntryFile(path) == nullptr) {
         ret = -ENOENT;
@@ -413,11 +866,41 @@ int MyOnDiskFS::fuseRelease(const char *path, struct fuse_file_info *fileInfo) {
         ret = -EBADF;
     } else {
         int openIndex = fileInfo->fh;
+        root->getExtents(openFiles[openIndex]->file)->close();
         delete openFiles[openIndex];
         openFiles[openIndex] = nullptr;
         openCount--;
+        if (flushOnRelease) {
+            ret = commitMetadata(true);
+            if (ret >= 0) {
+                ret = this->cache->flush();
+            }
+        }
     }
 
+    ret = batch.end(ret);
+    RETURN(ret);
+}
+
+/// @brief Synchronize a file.
+///
+/// Write all dirty blocks of the block cache (i.e. file data and metadata) to the container file and wait until it is
+/// on stable storage.
+/// \param [in] path Name of the file, starting with "/".
+/// \param [in] datasync Can be ignored, metadata is always written, too.
+/// \param [in] fileInfo Can be ignored.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::fuseFsync(const char *path, int datasync, struct fuse_file_info *fileInfo) {
+    LOGM();
+    IoBatch batch(scheduler);
+    int ret = commitMetadata(true);
+    if (ret >= 0) {
+        ret = this->cache->flush();
+    }
+    if (ret >= 0) {
+        ret = this->scheduler->sync();
+    }
+    ret = batch.end(ret);
     RETURN(ret);
 }
 
@@ -450,33 +933,63 @@ int MyOnDiskFS::fuseTruncate(const char *path, off_t newSize) {
 
 int MyOnDiskFS::fuseTruncate(const char *path, off_t newSize, struct fuse_file_info *fileInfo) {
     LOGM();
+    IoBatch batch(scheduler);
+    MetadataCommit commit(this);
     int ret = 0;
     rootFile *file = root->getRootEntryFile(path);
     if (file == nullptr) {
         ret = -ENFILE;
     } else {
         if (newSize >= file->fileStats.st_size) {
-            this->setFATBlocks(newSize, 0, file);
+            // the new blocks read as zeros without being written
+            ret = this->setFATBlocks(newSize, 0, file, true);
+            if (ret < 0) {
+                RETURN(ret);
+            }
+            file->fileStats.st_size = newSize;
+            root->discWrite(file);
         } else {
-            int offsetBlock = ceil(newSize / (double) BLOCK_SIZE);
+            int offsetBlock = ceil(newSize / (double) blockSize);
+            std::vector<char> tail;
+            ret = readTailUnit(file, newSize, tail);
+            if (ret < 0) {
+                RETURN(ret);
+            }
+            // the new last block is looked up in the extent map, only the cut off part of the chain is walked
+            ExtentMap *extents = getExtents(file);
             int currentBlock = file->firstBlock;
-            if (newSize == 0) {
+            int lastBlock = FAT_END;
+            if (offsetBlock == 0) {
                 file->firstBlock = FAT_END;
-                root->discWrite(file);
+            } else {
+                lastBlock = extents->getBlock(offsetBlock - 1);
+                currentBlock = fat->getNext(lastBlock);
+                fat->setNext(lastBlock, FAT_END);
             }
-            for (int i = 0; currentBlock != FAT_END; i++) {
+            extents->truncate(offsetBlock);
+            file->lastBlock = lastBlock;
+            file->blockCount = offsetBlock;
+            std::vector<int> freed;
+            while (currentBlock != FAT_END) {
                 int nextBlock = fat->getNext(currentBlock);
-                if (i >= offsetBlock) {
-
-                    fat->setNext(currentBlock, FAT_END);
-                    dmap->setBlock(currentBlock, false);
-                }
+                fat->setNext(currentBlock, FAT_END);
+                freed.push_back(currentBlock);
                 currentBlock = nextBlock;
             }
+            dmap->freeBlocks(ddt->release(freed));
+            compressor->release(freed);
             file->fileStats.st_size = newSize;
+            if (!tail.empty()) {
+                ret = writeTailUnit(file, tail);
+            } else {
+                // the cut off bytes of the new last block read as zeros if the file grows again
+                ret = clearTail(file);
+            }
             root->discWrite(file);
         }
     }
+    ret = commit.end(ret);
+    ret = batch.end(ret);
     RETURN(ret);
 }
 
@@ -522,6 +1035,8 @@ int MyOnDiskFS::fuseReaddir(const char *path, void *buf, fuse_fill_dir_t filler,
 /// \param [in] conn Can be ignored.
 /// \return 0.
 void *MyOnDiskFS::fuseInit(struct fuse_conn_info *conn) {
+    createStorage(((MyFsInfo *) fuse_get_context()->private_data)->backend);
+
     // Open logfile
     this->logFile = fopen(((MyFsInfo *) fuse_get_context()->private_data)->logFile, "w+");
     if (this->logFile == NULL) {
@@ -534,42 +1049,465 @@ void *MyOnDiskFS::fuseInit(struct fuse_conn_info *conn) {
         LOG("Using on-disk mode");
         LOGF("Container file name: %s", ((MyFsInfo *) fuse_get_context()->private_data)->contFile);
 
+        int cacheBlocks = ((MyFsInfo *) fuse_get_context()->private_data)->cacheBlocks;
+        if (cacheBlocks >= 0) {
+            this->cache->setCapacity(cacheBlocks);
+        }
+        LOGF("Block cache capacity: %lu blocks", (unsigned long) this->cache->getCapacity());
+
         int ret = this->blockDevice->open(((MyFsInfo *) fuse_get_context()->private_data)->contFile);
 
         if (ret >= 0) {
             LOG("Container file does exist, reading");
-            root->initRootDir();
-            dmap->init();
-            fat->init();
+            ret = openContainer();
+            if (ret >= 0) {
+                enableBackend(((MyFsInfo *) fuse_get_context()->private_data)->backend);
+                root->initRootDir();
+                dmap->init();
+                fat->init();
+                cmap->init();
+                ddt->init();
+            }
 
 
         } else if (ret == -ENOENT) {
             LOG("Container file does not exist, creating a new one");
 
             ret = this->blockDevice->create(((MyFsInfo *) fuse_get_context()->private_data)->contFile);
-            root->init();
+            if (ret >= 0) {
+                int newBlockSize = ((MyFsInfo *) fuse_get_context()->private_data)->blockSize;
+                ret = formatContainer(newBlockSize > 0 ? newBlockSize : DEFAULT_BLOCK_SIZE);
+            }
 
 
         }
 
         if (ret < 0) {
             LOGF("ERROR: Access to container file failed with error %d", ret);
+        } else {
+            if (((MyFsInfo *) fuse_get_context()->private_data)->writeBack) {
+                enableWriteBack(((MyFsInfo *) fuse_get_context()->private_data)->flushOnRelease);
+            }
+            if (((MyFsInfo *) fuse_get_context()->private_data)->compress) {
+                enableCompression();
+            }
+            if (((MyFsInfo *) fuse_get_context()->private_data)->dedup) {
+                enableDeduplication();
+            }
+            if (((MyFsInfo *) fuse_get_context()->private_data)->commit > 1) {
+                this->commitInterval = ((MyFsInfo *) fuse_get_context()->private_data)->commit;
+                LOGF("Writing metadata changes every %d operations", commitInterval);
+            }
         }
     }
 
     return 0;
 }
 
+/// Create the storage stack: backend, I/O scheduler, block cache and the file system structures on top of it. The
+/// backend starts with the minimal block size, until the superblock tells the real one.
+void MyOnDiskFS::createStorage(const char *backend) {
+    if (backend != nullptr && strcmp(backend, "ram") == 0) {
+        this->blockDevice = new RamBlockDevice(BD_BLOCK_SIZE);
+    } else if (((MyFsInfo *) fuse_get_context()->private_data)->numContFiles > 1) {
+        std::vector<BlockStorage *> members;
+        for (int i = 0; i < ((MyFsInfo *) fuse_get_context()->private_data)->numContFiles; i++) {
+            members.push_back(new BlockDevice(BD_BLOCK_SIZE));
+        }
+        const char *mirror = ((MyFsInfo *) fuse_get_context()->private_data)->mirror;
+        if (mirror != nullptr) {
+            MirrorPolicy policy = MIRROR_READ_QUEUE;
+            MirroredDevice::parsePolicy(mirror, &policy);
+            this->mirroredDevice = new MirroredDevice(members, policy);
+            this->blockDevice = mirroredDevice;
+        } else {
+            int stripeUnit = ((MyFsInfo *) fuse_get_context()->private_data)->stripeUnit;
+            this->stripedDevice = new StripedDevice(members, stripeUnit > 0 ? stripeUnit : STRIPE_DEFAULT_UNIT);
+            this->blockDevice = stripedDevice;
+        }
+    } else {
+        BlockDevice *device = new BlockDevice(BD_BLOCK_SIZE);
+        const char *traceFile = ((MyFsInfo *) fuse_get_context()->private_data)->traceFile;
+        if (traceFile != nullptr) {
+            this->tracer = new IoTracer();
+            if (this->tracer->open(traceFile, BD_BLOCK_SIZE) < 0) {
+                delete this->tracer;
+                this->tracer = nullptr;
+            } else {
+                device->setTracer(tracer);
+            }
+        }
+        this->blockDevice = device;
+    }
+    SimulationParams params;
+    if (SimulatedDevice::parseParams(((MyFsInfo *) fuse_get_context()->private_data)->simulate, &params)) {
+        params.delay = ((MyFsInfo *) fuse_get_context()->private_data)->simulateDelay;
+        this->simulatedDevice = new SimulatedDevice(blockDevice, params);
+        this->blockDevice = simulatedDevice;
+    }
+    this->scheduler = new IoScheduler(blockDevice, IO_SCHEDULER_MAX_PENDING);
+    this->cache = new BlockCache(scheduler, BD_BLOCK_SIZE, DEFAULT_CACHE_BLOCKS);
+    this->superBlock = new SuperBlock(cache);
+
+    root = new Root(cache, superBlock);
+    dmap = new DMAP(cache, superBlock);
+    fat = new FAT(cache, superBlock);
+    // changed FAT, DMAP and dedup table blocks and root entries are written once per operation by commitMetadata()
+    root->setDeferred(true);
+    dmap->setDeferred(true);
+    fat->setDeferred(true);
+    cmap = new CMAP(cache, superBlock);
+    compressor = new Compressor(cache, superBlock, cmap);
+    ddt = new DDT(cache, superBlock, dmap);
+    ddt->setDeferred(true);
+}
+
+/// Read the superblock of an opened container and switch the block device to its block size.
+int MyOnDiskFS::openContainer() {
+    int ret = superBlock->init();
+    if (ret < 0) {
+        LOG("ERROR: Container file has no valid superblock");
+        return ret;
+    }
+    this->blockSize = superBlock->getBlockSize();
+    this->cache->setBlockSize(blockSize);
+    LOGF("Block size: %u bytes, %u data blocks, %u bit FAT entries", blockSize, superBlock->getNumDataBlocks(),
+         superBlock->getFatEntrySize() * 8);
+    return 0;
+}
+
+/// Parses a size with an optional suffix K, M, G or T (powers of 1024), e.g. "4G". Returns the number of bytes, 0 if
+/// the size is not valid.
+static uint64_t parseSize(const char *spec) {
+    char *end = nullptr;
+    errno = 0;
+    unsigned long long size = strtoull(spec, &end, 10);
+    if (errno != 0 || end == spec) {
+        return 0;
+    }
+    const char *suffixes = "KMGT";
+    const char *suffix = *end != '\0' ? strchr(suffixes, toupper(*end)) : nullptr;
+    if (suffix != nullptr) {
+        for (const char *s = suffixes; s <= suffix; s++) {
+            if (size > UINT64_MAX / 1024) {
+                return 0;
+            }
+            size *= 1024;
+        }
+        end++;
+    }
+    return *end == '\0' ? size : 0;
+}
+
+/// Lay out an empty file system with the given block size in a newly created container. Its data region holds the
+/// size given at mount time, NUMBER_DATA_BLOCKS blocks by default.
+int MyOnDiskFS::formatContainer(uint32_t blockSize) {
+    uint32_t numDataBlocks = NUMBER_DATA_BLOCKS;
+    const char *size = ((MyFsInfo *) fuse_get_context()->private_data)->size;
+    if (size != nullptr) {
+        uint64_t blocks = parseSize(size) / blockSize;
+        if (blocks == 0 || blocks > MAX_DATA_BLOCKS) {
+            LOGF("ERROR: Unsupported container size %s", size);
+            return -EINVAL;
+        }
+        numDataBlocks = blocks;
+    }
+    int ret = superBlock->format(blockSize, numDataBlocks);
+    if (ret < 0) {
+        LOGF("ERROR: Unsupported block size %u", blockSize);
+        return ret;
+    }
+    this->blockSize = blockSize;
+    this->cache->setBlockSize(blockSize);
+    LOGF("Block size: %u bytes, %u data blocks, %u bit FAT entries", blockSize, superBlock->getNumDataBlocks(),
+         superBlock->getFatEntrySize() * 8);
+
+    enableBackend(((MyFsInfo *) fuse_get_context()->private_data)->backend);
+    IoBatch batch(scheduler);
+    superBlock->discWrite();
+    dmap->firstInit();
+    fat->firstInit();
+    cmap->firstInit();
+    ddt->firstInit();
+    root->init();
+    return batch.end(0);
+}
+
+/// Switch the block device to the backend selected at mount time. Falls back to synchronous I/O if the backend is not
+/// available.
+void MyOnDiskFS::enableBackend(const char *backend) {
+    if (this->stripedDevice != nullptr) {
+        LOGF("Striping blocks over %lu container files in units of %u bytes",
+             (unsigned long) stripedDevice->getNumMembers(), stripedDevice->getStripeUnit());
+    }
+    const char *mirror = ((MyFsInfo *) fuse_get_context()->private_data)->mirror;
+    if (this->mirroredDevice != nullptr) {
+        MirrorPolicy policy;
+        if (!MirroredDevice::parsePolicy(mirror, &policy)) {
+            LOGF("WARNING: unknown mirror read policy %s, using queue", mirror);
+        }
+        LOGF("Mirroring blocks on %lu container files, reads by %s",
+             (unsigned long) mirroredDevice->getNumMembers(),
+             mirroredDevice->getPolicy() == MIRROR_READ_LOCALITY ? "locality" : "queue depth");
+    } else if (mirror != nullptr) {
+        LOG("WARNING: mirroring needs several container files");
+    }
+
+    const char *simulate = ((MyFsInfo *) fuse_get_context()->private_data)->simulate;
+    if (this->simulatedDevice != nullptr) {
+        LOGF("Simulating device %s%s", simulate,
+             ((MyFsInfo *) fuse_get_context()->private_data)->simulateDelay ? ", waiting for the device time" : "");
+    } else if (simulate != nullptr) {
+        LOGF("WARNING: unknown device simulation %s, using the device as it is", simulate);
+    }
+
+    const char *traceFile = ((MyFsInfo *) fuse_get_context()->private_data)->traceFile;
+    if (this->tracer != nullptr) {
+        LOGF("Tracing block I/O to %s", traceFile);
+    } else if (traceFile != nullptr) {
+        LOGF("WARNING: cannot trace block I/O to %s", traceFile);
+    }
+
+    if (((MyFsInfo *) fuse_get_context()->private_data)->directIo) {
+        int ret = (backend != nullptr && strcmp(backend, "mmap") == 0) ? -EINVAL : this->blockDevice->enableDirect();
+        if (ret < 0) {
+            LOGF("WARNING: direct I/O not available (error %d), using the page cache", ret);
+        } else {
+            LOG("Using direct I/O, the block cache is the only cache of container blocks");
+        }
+    }
+
+    if (backend == nullptr || strcmp(backend, "sync") == 0) {
+        LOG("Using synchronous block I/O");
+    } else if (strcmp(backend, "ram") == 0) {
+        LOG("Using a container in RAM, its content is lost when unmounting");
+        // blocks are copied from memory anyway, an extra copy in our cache would only cost memory
+        this->cache->setCapacity(0);
+    } else if (strcmp(backend, "mmap") == 0) {
+        int ret = this->blockDevice->enableMmap(superBlock->getContainerBlocks());
+        if (ret < 0) {
+            LOGF("mmap of container failed (error %d), falling back to synchronous block I/O", ret);
+        } else {
+            LOG("Using memory mapped container");
+            // the mapping is served from the page cache, an extra copy in our cache would only cost memory
+            this->cache->setCapacity(0);
+            // FAT, DMAP and root directory are read right after mounting
+            this->blockDevice->adviseWillNeed(0, superBlock->getDataOffset());
+        }
+    } else if (strcmp(backend, "uring") == 0) {
+        int ret = this->blockDevice->enableAsync(IO_QUEUE_DEPTH);
+        if (ret < 0) {
+            LOGF("io_uring not available (error %d), falling back to synchronous block I/O", ret);
+        } else {
+            LOG("Using io_uring block I/O");
+        }
+    } else {
+        LOGF("WARNING: unknown backend %s, using synchronous block I/O", backend);
+    }
+}
+
+/// Keep written blocks dirty in the block cache and let a background thread write them to the container.
+void MyOnDiskFS::enableWriteBack(bool flushOnRelease) {
+    if (this->cache->getCapacity() == 0) {
+        LOG("WARNING: write-back needs the block cache, using write-through");
+        return;
+    }
+    this->cache->setWriteBack(true, this->cache->getCapacity() / 2, WRITEBACK_MAX_AGE_MS);
+    this->cache->startFlusher();
+    this->flushOnRelease = flushOnRelease;
+    LOGF("Using write-back caching (flush on release: %s)", flushOnRelease ? "yes" : "no");
+}
+
+/// Compress file data from now on. Units already stored stay as they are until they are written again.
+void MyOnDiskFS::enableCompression() {
+    if (compressor->setEnabled(true) < 0) {
+        LOG("WARNING: the container has no compression map, storing file data uncompressed");
+        return;
+    }
+    // most blocks of a compressed unit stay holes, reserving them first would only cost time
+    dmap->setPreallocate(false);
+    LOGF("Compressing file data with LZ4 in units of %u blocks", compressor->getUnitBlocks());
+}
+
+/// Share the content of blocks written from now on with blocks that hold the same content already.
+void MyOnDiskFS::enableDeduplication() {
+    if (compressor->isEnabled()) {
+        LOG("WARNING: compressed units are not deduplicated, compressing only");
+        return;
+    }
+    if (ddt->setEnabled(true) < 0) {
+        LOG("WARNING: the container has no dedup table, storing every block");
+        return;
+    }
+    // blocks sharing content stay holes, reserving them first would only cost time
+    dmap->setPreallocate(false);
+    LOGF("Deduplicating file data, %lu blocks share the content of others", (unsigned long) ddt->getSharedBlocks());
+}
+
+/// Writes the dedup table, FAT and DMAP blocks and the root entries changed since the last commit, each of them once, at
+/// the end of every commitInterval-th operation that changed any, or at once if force is set. The dedup table comes
+/// first, so no block is free in the DMAP while the table still counts blocks sharing it. The entries are written last
+/// and never before the allocation they refer to, so a container cut off between commits has no entry pointing at
+/// blocks its DMAP still shows as free. A failed stage ends the commit, the later ones stay dirty for the next one.
+/// Returns 0 on success, -ERRNO on failure.
+int MyOnDiskFS::commitMetadata(bool force) {
+    if (fat->getDirtyBlocks() == 0 && dmap->getDirtyBlocks() == 0 && ddt->getDirtyBlocks() == 0 &&
+        root->getDirtyEntries() == 0) {
+        return 0;
+    }
+    if (!force && ++uncommittedOps < commitInterval) {
+        return 0;
+    }
+    uncommittedOps = 0;
+    // the block cache and the I/O scheduler write in block order, only the barriers keep the stages in order
+    int ret = ddt->flush();
+    if (ret >= 0) {
+        ret = writeBarrier();
+    }
+    if (ret >= 0) {
+        ret = dmap->flush();
+        int fatRet = fat->flush();
+        if (ret >= 0) {
+            ret = fatRet;
+        }
+    }
+    if (ret >= 0) {
+        ret = writeBarrier();
+    }
+    if (ret >= 0) {
+        ret = root->flush();
+    }
+    if (ret < 0) {
+        LOGF("ERROR: Writing FAT, DMAP, dedup table and root entries failed with error %d", ret);
+    }
+    return ret;
+}
+
+/// Passes everything the block cache and the I/O scheduler hold back on to the device, so blocks written afterwards
+/// reach it later. Returns 0 on success, -ERRNO on failure.
+int MyOnDiskFS::writeBarrier() {
+    int ret = this->cache->flush();
+    int dispatchRet = this->scheduler->dispatch();
+    return ret < 0 ? ret : dispatchRet;
+}
+
 /// @brief Clean up a file system.
 ///
 /// This function is called when the file system is unmounted. You may add some cleanup code here.
 void MyOnDiskFS::fuseDestroy() {
     LOGM();
+    // write all dirty blocks before the container is closed
+    this->cache->stopFlusher();
+    int ret = commitMetadata(true);
+    if (ret >= 0) {
+        ret = this->cache->flush();
+    }
+    if (ret >= 0) {
+        ret = this->scheduler->dispatch();
+    }
+    if (ret < 0) {
+        LOGF("ERROR: Writing dirty blocks failed with error %d", ret);
+    }
+    LOGF("Block cache: %lu hits, %lu misses, %lu prefetched, %lu block writes", (unsigned long) this->cache->getHits(),
+         (unsigned long) this->cache->getMisses(), (unsigned long) this->cache->getPrefetched(),
+         (unsigned long) this->cache->getDeviceWrites());
+    if (this->simulatedDevice != nullptr) {
+        LOGF("Simulated device: %lu requests, %lu blocks, seek distance %lu blocks, device time %.3f ms",
+             (unsigned long) simulatedDevice->getRequests(), (unsigned long) simulatedDevice->getBlocks(),
+             (unsigned long) simulatedDevice->getSeekDistance(), simulatedDevice->getDeviceTimeNs() / 1e6);
+    }
+    if (this->stripedDevice != nullptr) {
+        LOGF("Striped device: %lu requests spread over several container files",
+             (unsigned long) stripedDevice->getParallelRequests());
+        for (size_t i = 0; i < stripedDevice->getNumMembers(); i++) {
+            LOGF("Container file %lu: %lu blocks", (unsigned long) i,
+                 (unsigned long) stripedDevice->getMemberBlocks(i));
+        }
+    }
+    if (this->mirroredDevice != nullptr) {
+        for (size_t i = 0; i < mirroredDevice->getNumMembers(); i++) {
+            LOGF("Container file %lu: %lu reads of %lu blocks, %lu failed, %lu blocks written", (unsigned long) i,
+                 (unsigned long) mirroredDevice->getMemberReads(i),
+                 (unsigned long) mirroredDevice->getMemberReadBlocks(i),
+                 (unsigned long) mirroredDevice->getMemberFailedReads(i),
+                 (unsigned long) mirroredDevice->getMemberWrittenBlocks(i));
+        }
+    }
+    if (this->compressor->getWrittenBlocks() > 0) {
+        LOGF("Compression: %lu units compressed, %lu stored uncompressed, %lu blocks of file data stored in %lu "
+             "blocks, %lu units decompressed", (unsigned long) compressor->getCompressedUnits(),
+             (unsigned long) compressor->getRawUnits(), (unsigned long) compressor->getWrittenBlocks(),
+             (unsigned long) compressor->getStoredBlocks(), (unsigned long) compressor->getDecompressions());
+    }
+    if (this->ddt->getWrittenBlocks() > 0) {
+        LOGF("Deduplication: %lu blocks of file data written, %lu of them stored already, %lu shared blocks copied, "
+             "%lu blocks share the content of others", (unsigned long) ddt->getWrittenBlocks(),
+             (unsigned long) ddt->getDedupedBlocks(), (unsigned long) ddt->getCopiedBlocks(),
+             (unsigned long) ddt->getSharedBlocks());
+        LOGF("Zero blocks: %lu written blocks held only zeros, %lu blocks are holes of zeros",
+             (unsigned long) ddt->getHoleBlocks(), (unsigned long) ddt->getZeroBlocks());
+    }
+    if (this->writtenBytes > 0) {
+        uint64_t metadataBytes = (fat->getWrittenBlocks() + dmap->getWrittenBlocks()) * (uint64_t) blockSize;
+        LOGF("Metadata: %lu FAT and %lu DMAP blocks written for %lu bytes of file data, %.4f bytes per byte",
+             (unsigned long) fat->getWrittenBlocks(), (unsigned long) dmap->getWrittenBlocks(),
+             (unsigned long) writtenBytes, (double) metadataBytes / writtenBytes);
+    }
+    LOGF("I/O scheduler: %lu block writes queued, %lu absorbed, %lu written in %lu dispatches",
+         (unsigned long) this->scheduler->getQueuedWrites(), (unsigned long) this->scheduler->getAbsorbedWrites(),
+         (unsigned long) this->scheduler->getDeviceWrites(), (unsigned long) this->scheduler->getDispatches());
+    if (this->logFile != nullptr) {
+        // time spent in block I/O, per container file
+        MultiDevice *multiDevice = this->stripedDevice != nullptr ? (MultiDevice *) this->stripedDevice
+                                                                  : (MultiDevice *) this->mirroredDevice;
+        if (multiDevice != nullptr) {
+            for (size_t i = 0; i < multiDevice->getNumMembers(); i++) {
+                IoStats *stats = multiDevice->getMember(i)->getStats();
+                char name[48];
+                snprintf(name, sizeof(name), "Container file %lu", (unsigned long) i);
+                if (stats != nullptr) {
+                    stats->dump(this->logFile, name);
+                }
+            }
+        } else if (this->blockDevice->getStats() != nullptr) {
+            this->blockDevice->getStats()->dump(this->logFile, "Container file");
+        }
+    }
+    this->blockDevice->close();
+    if (this->tracer != nullptr) {
+        ret = this->tracer->close();
+        if (ret < 0) {
+            LOGF("ERROR: Writing the block I/O trace failed with error %d", ret);
+        }
+        LOGF("Block I/O trace: %lu records", (unsigned long) this->tracer->getRecords());
+    }
+
     delete root;
     delete fat;
+    delete ddt;
     delete dmap;
+    delete compressor;
+    delete cmap;
+    delete superBlock;
 
+    delete this->cache;
+    delete this->scheduler;
     delete this->blockDevice;
+    delete this->tracer;
+    superBlock = nullptr;
+    root = nullptr;
+    fat = nullptr;
+    dmap = nullptr;
+    compressor = nullptr;
+    ddt = nullptr;
+    cmap = nullptr;
+    cache = nullptr;
+    scheduler = nullptr;
+    blockDevice = nullptr;
+    simulatedDevice = nullptr;
+    stripedDevice = nullptr;
+    mirroredDevice = nullptr;
+    tracer = nullptr;
 
     LOG("--> Delete all Files");
 }
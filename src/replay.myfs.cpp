@@ -0,0 +1,199 @@
+//
+// Created by user on 17.10.26.
+//
+// Replays a block I/O trace recorded with "mount.myfs -o trace=FILE" against a container and reports throughput and
+// latency percentiles. Writes change the container, so replay against a copy or skip them with -r.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "blockdevice.h"
+#include "IoTracer.h"
+#include "myfs-structs.h"
+
+struct OpStats {
+    const char *name;
+    std::vector<uint64_t> latencyNs;    // measured while replaying
+    std::vector<uint64_t> recordedNs;   // durations stored in the trace
+    uint64_t blocks = 0;
+    uint64_t bytes = 0;
+    uint64_t errors = 0;
+};
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [-m] [-r] [-d] TRACEFILE CONTAINER\n"
+            "    -m    replay at maximum speed (default: keep the timing of the trace)\n"
+            "    -r    skip writes, the container is not changed\n"
+            "    -d    open the container with O_DIRECT\n", name);
+}
+
+// the p-th percentile (0..100) of sorted values
+static uint64_t percentile(const std::vector<uint64_t> &sorted, double p) {
+    if (sorted.empty())
+        return 0;
+    size_t rank = (size_t) (p / 100.0 * sorted.size() + 0.999999);
+    return sorted[rank == 0 ? 0 : std::min(rank, sorted.size()) - 1];
+}
+
+static void printLatencies(const char *what, std::vector<uint64_t> &values) {
+    std::sort(values.begin(), values.end());
+    printf("    %-9s p50 %9.1f  p90 %9.1f  p99 %9.1f  p99.9 %9.1f  max %9.1f us\n", what,
+           percentile(values, 50) / 1e3, percentile(values, 90) / 1e3, percentile(values, 99) / 1e3,
+           percentile(values, 99.9) / 1e3, (values.empty() ? 0 : values.back()) / 1e3);
+}
+
+int main(int argc, char *argv[]) {
+    bool maxSpeed = false;
+    bool skipWrites = false;
+    bool direct = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "mrdh")) != -1) {
+        switch (opt) {
+            case 'm': maxSpeed = true; break;
+            case 'r': skipWrites = true; break;
+            case 'd': direct = true; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (argc - optind != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *tracePath = argv[optind];
+    const char *containerPath = argv[optind + 1];
+
+    IoTraceHeader header;
+    std::vector<IoTraceRecord> records;
+    int ret = IoTracer::load(tracePath, &header, &records);
+    if (ret < 0) {
+        fprintf(stderr, "Error: cannot read trace %s: %s\n", tracePath, strerror(-ret));
+        return 1;
+    }
+
+    // the largest call determines the size of the transfer buffer
+    size_t maxBytes = MAX_BLOCK_SIZE;
+    uint32_t blockSize = header.blockSize;
+    size_t callBlocks = 0;
+    for (const IoTraceRecord &record : records) {
+        if (!(record.op & TRACE_CONTINUED))
+            callBlocks = 0;
+        if ((record.op & ~TRACE_CONTINUED) == TRACE_BLOCK_SIZE)
+            blockSize = record.blockNo;
+        callBlocks += record.blocks;
+        maxBytes = std::max(maxBytes, callBlocks * blockSize);
+    }
+    char *buffer = nullptr;
+    if (posix_memalign((void **) &buffer, MAX_BLOCK_SIZE, maxBytes) != 0) {
+        fprintf(stderr, "Error: cannot allocate %zu bytes\n", maxBytes);
+        return 1;
+    }
+    memset(buffer, 0, maxBytes);
+
+    BlockDevice device(header.blockSize);
+    ret = device.open(containerPath);
+    if (ret < 0) {
+        fprintf(stderr, "Error: cannot open container %s: %s\n", containerPath, strerror(-ret));
+        free(buffer);
+        return 1;
+    }
+    if (direct && (ret = device.enableDirect()) < 0) {
+        fprintf(stderr, "Warning: direct I/O not available (%s), using the page cache\n", strerror(-ret));
+    }
+
+    OpStats stats[3];
+    stats[TRACE_READ].name = "read";
+    stats[TRACE_WRITE].name = "write";
+    stats[TRACE_SYNC].name = "sync";
+    uint64_t skipped = 0;
+    std::vector<BlockRequest> requests;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t next = 0;
+    while (next < records.size()) {
+        // a call consists of its first record and all records continuing it
+        size_t end = next + 1;
+        while (end < records.size() && (records[end].op & TRACE_CONTINUED))
+            end++;
+        const IoTraceRecord &first = records[next];
+        uint8_t op = first.op & ~TRACE_CONTINUED;
+
+        if (!maxSpeed)
+            std::this_thread::sleep_until(start + std::chrono::nanoseconds(first.timestampNs));
+
+        if (op == TRACE_BLOCK_SIZE) {
+            device.setBlockSize(first.blockNo);
+        } else if (op == TRACE_SYNC) {
+            uint64_t callStart = IoTracer::now();
+            if (device.sync() < 0)
+                stats[op].errors++;
+            stats[op].latencyNs.push_back(IoTracer::now() - callStart);
+            stats[op].recordedNs.push_back(first.durationNs);
+        } else if (op == TRACE_READ || op == TRACE_WRITE) {
+            if (op == TRACE_WRITE && skipWrites) {
+                skipped++;
+                next = end;
+                continue;
+            }
+            requests.clear();
+            char *data = buffer;
+            for (size_t i = next; i < end; i++) {
+                for (uint32_t b = 0; b < records[i].blocks; b++) {
+                    requests.push_back({records[i].blockNo + b, data});
+                    data += device.getBlockSize();
+                }
+            }
+            uint64_t callStart = IoTracer::now();
+            ret = op == TRACE_WRITE ? device.writeBlocks(requests.data(), requests.size())
+                                    : device.readBlocks(requests.data(), requests.size());
+            stats[op].latencyNs.push_back(IoTracer::now() - callStart);
+            stats[op].recordedNs.push_back(first.durationNs);
+            if (ret < 0)
+                stats[op].errors++;
+            stats[op].blocks += requests.size();
+            stats[op].bytes += (uint64_t) requests.size() * device.getBlockSize();
+        }
+        next = end;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    device.close();
+    free(buffer);
+
+    double traceSeconds = records.empty() ? 0 : records.back().timestampNs / 1e9;
+    printf("Trace %s: %zu records over %.3f s, block size %u\n", tracePath, records.size(), traceSeconds,
+           header.blockSize);
+    printf("Replayed at %s speed in %.3f s%s\n", maxSpeed ? "maximum" : "original", seconds,
+           skipWrites ? ", writes skipped" : "");
+
+    uint64_t totalBytes = 0;
+    uint64_t totalCalls = 0;
+    uint64_t errors = 0;
+    for (OpStats &s : stats) {
+        if (s.latencyNs.empty())
+            continue;
+        printf("%s: %zu calls, %lu blocks, %.1f MB, %.1f MB/s, %.0f calls/s\n", s.name, s.latencyNs.size(),
+               (unsigned long) s.blocks, s.bytes / 1e6, seconds > 0 ? s.bytes / 1e6 / seconds : 0,
+               seconds > 0 ? s.latencyNs.size() / seconds : 0);
+        printLatencies("replayed", s.latencyNs);
+        printLatencies("recorded", s.recordedNs);
+        totalBytes += s.bytes;
+        totalCalls += s.latencyNs.size();
+        errors += s.errors;
+    }
+    printf("total: %lu calls, %.1f MB, %.1f MB/s\n", (unsigned long) totalCalls, totalBytes / 1e6,
+           seconds > 0 ? totalBytes / 1e6 / seconds : 0);
+    if (skipped > 0)
+        printf("%lu write calls skipped\n", (unsigned long) skipped);
+    if (errors > 0) {
+        printf("%lu calls failed\n", (unsigned long) errors);
+        return 2;
+    }
+    return 0;
+}